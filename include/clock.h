@@ -0,0 +1,25 @@
+/**
+ * @brief   Module which scales the system clock to the work at hand: the
+ *          PLL with the over-drive for processing bursts, and a divided HSI
+ *          on the lowest voltage scale for bus waits and idle.
+ */
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** System clock modes. */
+typedef enum
+{
+    CLOCK_MODE_IDLE,            /**< HSI / 2 (8MHz), voltage scale 3. */
+    CLOCK_MODE_BURST            /**< PLL (180MHz), over-drive. */
+
+} Clock_Mode_t;
+
+void Clock_Init(void);
+bool Clock_SetMode(Clock_Mode_t mode);
+Clock_Mode_t Clock_GetMode(void);
+
+#endif /* CLOCK_H_ */
@@ -0,0 +1,17 @@
+/**
+ * @brief   Cycle counter based on the Data Watchpoint and Trace (DWT) unit,
+ *          used to profile the firmware.
+ */
+
+#ifndef CYCLES_H_
+#define CYCLES_H_
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+
+/** Current value of the cycle counter. */
+#define CYCLES_GET()                (DWT->CYCCNT)
+
+void Cycles_Init(void);
+
+#endif /* CYCLES_H_ */
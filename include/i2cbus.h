@@ -0,0 +1,108 @@
+/**
+ * @brief   I2C bus shared by all devices connected to it. Transfers are
+ *          queued by priority and executed back to back from interrupts.
+ */
+
+#ifndef I2CBUS_H_
+#define I2CBUS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Highest transfer priority. */
+#define I2CBUS_PRIORITY_HIGHEST     0
+
+/** Lowest transfer priority. */
+#define I2CBUS_PRIORITY_LOWEST      0xFF
+
+/** Transfer flag to use the register-level fast path (reads only). */
+#define I2CBUS_FLAG_FAST            0x01
+
+/** Transfer direction. */
+typedef enum
+{
+    I2CBUS_DIR_READ,
+    I2CBUS_DIR_WRITE
+
+} I2CBus_Direction_t;
+
+/** Transfer status. */
+typedef enum
+{
+    I2CBUS_STATUS_IDLE,
+    I2CBUS_STATUS_PENDING,
+    I2CBUS_STATUS_DONE,
+    I2CBUS_STATUS_ERROR
+
+} I2CBus_Status_t;
+
+/** Transfer error. */
+typedef enum
+{
+    I2CBUS_ERROR_NONE,
+    I2CBUS_ERROR_NACK,          /**< Not acknowledged by the device. */
+    I2CBUS_ERROR_TIMEOUT,       /**< Bus busy or transfer timed out. */
+    I2CBUS_ERROR_BUS,           /**< Bus error or arbitration lost. */
+    I2CBUS_ERROR_OTHER          /**< Overrun or DMA error. */
+
+} I2CBus_Error_t;
+
+/** Path used to execute a transfer. */
+typedef enum
+{
+    I2CBUS_PATH_HAL,
+    I2CBUS_PATH_FAST,
+    I2CBUS_PATH_NUM
+
+} I2CBus_Path_t;
+
+/** CPU cost of the transfers executed by a path. */
+typedef struct
+{
+    uint32_t transfers;     /**< Number of completed transfers. */
+    uint32_t cycles;        /**< CPU cycles spent by the bus driver. */
+
+} I2CBus_Profile_t;
+
+struct I2CBus_Transfer;
+
+typedef void (*I2CBus_Callback_t)(struct I2CBus_Transfer *xfer);
+
+/** I2C transfer. The memory is owned by the caller and it shall be kept
+ * valid until the transfer has been completed. */
+typedef struct I2CBus_Transfer
+{
+    struct I2CBus_Transfer *next;       /**< Next queued transfer. */
+    uint8_t deviceAddress;              /**< 7-bit device address. */
+    uint8_t regAddress;                 /**< Register address. */
+    uint8_t *data;                      /**< Data to be read or written. */
+    uint16_t size;                      /**< Size of the data. */
+    I2CBus_Direction_t direction;       /**< Transfer direction. */
+    uint8_t priority;                   /**< Priority (0 is the highest). */
+    uint8_t flags;                      /**< Transfer flags. */
+    volatile I2CBus_Status_t status;    /**< Transfer status. */
+    I2CBus_Error_t error;               /**< Error of a failed transfer. */
+    uint32_t cycles;                    /**< Cycles from the transfer start
+                                             to its completion. */
+    I2CBus_Callback_t callbackFromISR;  /**< Optional completion callback. */
+    void *context;                      /**< Caller context. */
+
+} I2CBus_Transfer_t;
+
+void I2CBus_Init(void);
+bool I2CBus_Submit(I2CBus_Transfer_t *xfer);
+bool I2CBus_Execute(I2CBus_Transfer_t *xfer);
+bool I2CBus_MemRead(uint8_t deviceAddress, uint8_t regAddress, uint8_t *data,
+        uint16_t size);
+bool I2CBus_MemWrite(uint8_t deviceAddress, uint8_t regAddress,
+        const uint8_t *data, uint16_t size);
+bool I2CBus_FastRead(uint8_t deviceAddress, uint8_t regAddress, uint8_t *data,
+        uint16_t size);
+void I2CBus_GetProfile(I2CBus_Path_t path, I2CBus_Profile_t *profile);
+uint32_t I2CBus_GetRecoveries(void);
+bool I2CBus_IsIdle(void);
+bool I2CBus_Hold(void);
+void I2CBus_Release(void);
+void I2CBus_UpdateTiming(void);
+
+#endif /* I2CBUS_H_ */
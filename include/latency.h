@@ -0,0 +1,32 @@
+/**
+ * @brief   Wake-up latency measurement, from a sensor event latched by the
+ *          RTC to the time its data is committed.
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include "rtc.h"
+#include <stdint.h>
+
+/** Number of histogram bins. Bin 0 holds latencies under 1us, and bin n
+ * the ones from 2^(n - 1) to 2^n - 1us. The last bin holds the rest */
+#define LATENCY_BINS                    20
+
+/** Latency histogram. */
+typedef struct
+{
+    uint32_t bins[LATENCY_BINS];    /**< Events per latency range. */
+    uint32_t events;                /**< Events measured. */
+    uint32_t missed;                /**< Commits without a captured event. */
+    uint32_t max;                   /**< Maximum latency (us). */
+
+} Latency_Histogram_t;
+
+void Latency_EventFromISR(RTC_Timestamp_t timestamp);
+void Latency_MarkFromISR(void);
+void Latency_CommitFromISR(void);
+void Latency_GetHistogram(Latency_Histogram_t *histogram);
+void Latency_Reset(void);
+
+#endif /* LATENCY_H_ */
@@ -5,7 +5,9 @@
 #ifndef LIS2DE12_H_
 #define LIS2DE12_H_
 
+#include "circbuf.h"
 #include <stdint.h>
+#include <stdbool.h>
 
 /** LI2DE12 I2C address when SA0 is low */
 #define LIS2DE12_I2C_ADDR_1         0x18
@@ -58,12 +60,232 @@
 #define LI2DE12_TEMP_DISABLED       (0b00 << 6)
 #define LI2DE12_TEMP_ENABLED        (0b11 << 6)
 
+/** LI2DE12 temperature new data available (STATUS_REG_AUX). */
+#define LI2DE12_TDA                 (1 << 2)
+
+/** LI2DE12 high-pass filter mode (CTRL_REG2). */
+#define LI2DE12_HPM_NORMAL_RESET    (0b00 << 6)
+#define LI2DE12_HPM_REFERENCE       (0b01 << 6)
+#define LI2DE12_HPM_NORMAL          (0b10 << 6)
+#define LI2DE12_HPM_AUTORESET       (0b11 << 6)
+#define LI2DE12_HPM_MASK            (0b11 << 6)
+
+/** LI2DE12 high-pass filter cutoff (CTRL_REG2), from 0 (highest) to 3
+ * (lowest) as a fraction of the data rate. */
+#define LI2DE12_HPCF(cutoff)        (((cutoff) & 0b11) << 4)
+#define LI2DE12_HPCF_MASK           (0b11 << 4)
+
+/** LI2DE12 high-pass filter paths (CTRL_REG2). */
+#define LI2DE12_HP_IA1              (1 << 0)
+#define LI2DE12_HP_IA2              (1 << 1)
+#define LI2DE12_HP_CLICK            (1 << 2)
+#define LI2DE12_HP_FDS              (1 << 3)
+#define LI2DE12_HP_PATHS_MASK       0x0F
+
+/** LI2DE12 block data update (CTRL_REG4), needed to read the temperature. */
+#define LI2DE12_BDU                 (1 << 7)
+
+/** LI2DE12 self-test mode (CTRL_REG4). */
+#define LI2DE12_ST_OFF              (0b00 << 1)
+#define LI2DE12_ST_0                (0b01 << 1)
+#define LI2DE12_ST_1                (0b10 << 1)
+
+/** LI2DE12 output data rate (CTRL_REG1). */
+#define LI2DE12_ODR_POWER_DOWN      (0x0 << 4)
+#define LI2DE12_ODR_1HZ             (0x1 << 4)
+#define LI2DE12_ODR_10HZ            (0x2 << 4)
+#define LI2DE12_ODR_25HZ            (0x3 << 4)
+#define LI2DE12_ODR_50HZ            (0x4 << 4)
+#define LI2DE12_ODR_100HZ           (0x5 << 4)
+#define LI2DE12_ODR_200HZ           (0x6 << 4)
+#define LI2DE12_ODR_400HZ           (0x7 << 4)
+#define LI2DE12_ODR_1620HZ          (0x8 << 4)
+#define LI2DE12_ODR_5376HZ          (0x9 << 4)
+
+#define LI2DE12_ODR_MASK            (0xF << 4)
+
+/** LI2DE12 low power mode and axes enable (CTRL_REG1). */
+#define LI2DE12_LP_EN               (1 << 3)
+#define LI2DE12_XYZ_EN              0x07
+
+/** LI2DE12 interrupt generators on INT2 pin (CTRL_REG6). */
+#define LI2DE12_I2_IA1              (1 << 6)
+#define LI2DE12_I2_IA2              (1 << 5)
+
+/** LI2DE12 interrupt generator 2 latch and 4D detection (CTRL_REG5). */
+#define LI2DE12_LIR_INT2            (1 << 1)
+#define LI2DE12_D4D_INT2            (1 << 0)
+
+/** LI2DE12 interrupt generator events (INT1_CFG/INT2_CFG). */
+#define LI2DE12_INT_XLIE            (1 << 0)
+#define LI2DE12_INT_XHIE            (1 << 1)
+#define LI2DE12_INT_YLIE            (1 << 2)
+#define LI2DE12_INT_YHIE            (1 << 3)
+#define LI2DE12_INT_ZLIE            (1 << 4)
+#define LI2DE12_INT_ZHIE            (1 << 5)
+#define LI2DE12_INT_6D              (1 << 6)
+#define LI2DE12_INT_AOI             (1 << 7)
+
+/** LI2DE12 interrupt generator sources (INT1_SRC/INT2_SRC). */
+#define LI2DE12_SRC_XL              (1 << 0)
+#define LI2DE12_SRC_XH              (1 << 1)
+#define LI2DE12_SRC_YL              (1 << 2)
+#define LI2DE12_SRC_YH              (1 << 3)
+#define LI2DE12_SRC_ZL              (1 << 4)
+#define LI2DE12_SRC_ZH              (1 << 5)
+#define LI2DE12_SRC_IA              (1 << 6)
+
+/** LI2DE12 FIFO watermark interrupt on INT1 (CTRL_REG3). */
+#define LI2DE12_I1_WTM              (1 << 2)
+
+/** LI2DE12 FIFO enable (CTRL_REG5). */
+#define LI2DE12_FIFO_EN             (1 << 6)
+
+/** LI2DE12 FIFO mode (FIFO_CTRL_REG). */
+#define LI2DE12_FIFO_MODE_BYPASS    (0b00 << 6)
+#define LI2DE12_FIFO_MODE_FIFO      (0b01 << 6)
+#define LI2DE12_FIFO_MODE_STREAM    (0b10 << 6)
+
+/** LI2DE12 FIFO status (FIFO_SRC_REG). */
+#define LI2DE12_FIFO_OVRN           (1 << 6)
+#define LI2DE12_FIFO_FSS_MASK       0x1F
+
+/** Number of samples the LI2DE12 FIFO can hold. */
+#define LIS2DE12_FIFO_SIZE          32
+
+/** Acceleration sample, laid out as the output registers, so a FIFO burst
+ * can be read straight into an array of samples. */
+typedef struct
+{
+    uint8_t reserved0;
+    int8_t x;
+    uint8_t reserved1;
+    int8_t y;
+    uint8_t reserved2;
+    int8_t z;
+
+} LIS2DE12_Sample_t;
+
+/** Temperature calibration magic number ("TCAL"). */
+#define LIS2DE12_TEMP_CALIB_MAGIC   0x4C414354
+
+/** Unity temperature gain (Q2.14). */
+#define LIS2DE12_TEMP_GAIN_UNITY    0x4000
+
+/** Per-device temperature calibration, programmed into one of the flash OTP
+ * blocks during production. The last valid block is used, so the
+ * calibration can be updated by programming the next block. */
+typedef struct
+{
+    uint32_t magic;         /**< LIS2DE12_TEMP_CALIB_MAGIC. */
+    int16_t offset;         /**< Temperature (Q8.8 °C) of a zero reading. */
+    uint16_t gain;          /**< Gain (Q2.14) applied to the reading. */
+
+} LIS2DE12_TempCalib_t;
+
+/** Number of samples read from the FIFO on each watermark interrupt when
+ * streaming. The stream buffer size shall be a multiple of twice this. */
+#define LIS2DE12_STREAM_WATERMARK   16
+
+/** Duration, in cycles, of each phase of a one-shot read. */
+typedef struct
+{
+    uint32_t powerUp;       /**< Waking the device up. */
+    uint32_t settle;        /**< Waiting for the first conversion. */
+    uint32_t read;          /**< Reading the conversion. */
+    uint32_t powerDown;     /**< Powering the device down. */
+
+} LIS2DE12_OneShotTiming_t;
+
+/** Device orientation, given by the axis pointing up. */
+typedef enum
+{
+    LIS2DE12_ORIENT_UNKNOWN,
+    LIS2DE12_ORIENT_X_UP,
+    LIS2DE12_ORIENT_X_DOWN,
+    LIS2DE12_ORIENT_Y_UP,
+    LIS2DE12_ORIENT_Y_DOWN,
+    LIS2DE12_ORIENT_Z_UP,
+    LIS2DE12_ORIENT_Z_DOWN
+
+} LIS2DE12_Orientation_t;
+
+/** Orientation change event, as stored in the events buffer. */
+typedef struct
+{
+    uint8_t orientation;    /**< New orientation (LIS2DE12_Orientation_t). */
+    uint8_t source;         /**< Raw INT2_SRC register. */
+
+} LIS2DE12_OrientEvent_t;
+
+/** Self-test axes. */
+#define LIS2DE12_AXIS_X             0
+#define LIS2DE12_AXIS_Y             1
+#define LIS2DE12_AXIS_Z             2
+#define LIS2DE12_AXES               3
+
+/** Self-test result. */
+typedef struct
+{
+    int16_t averageOff[LIS2DE12_AXES];  /**< Average with self-test off. */
+    int16_t averageOn[LIS2DE12_AXES];   /**< Average with self-test on. */
+    int16_t delta[LIS2DE12_AXES];       /**< Absolute output change. */
+    uint8_t failedAxes;                 /**< Bit mask of the axes whose
+                                             change is out of limits. */
+    bool passed;                        /**< Whether all axes passed. */
+
+} LIS2DE12_SelfTestResult_t;
+
+/** Transfer statistics. */
+typedef struct
+{
+    uint32_t transactions;  /**< Transfers, including the failed ones. */
+    uint32_t bytes;         /**< Bytes successfully transferred. */
+    uint32_t nacks;         /**< Transfers not acknowledged. */
+    uint32_t timeouts;      /**< Transfers timed out (bus busy). */
+    uint32_t errors;        /**< Transfers failed for any other reason. */
+    uint32_t recoveries;    /**< Bus recoveries. */
+    uint32_t minLatency;    /**< Minimum transfer latency (cycles). */
+    uint32_t avgLatency;    /**< Average transfer latency (cycles). */
+    uint32_t maxLatency;    /**< Maximum transfer latency (cycles). */
+
+} LIS2DE12_Stats_t;
+
+typedef void (*LIS2DE12_Callback_t)(void);
+typedef void (*LIS2DE12_StreamCallback_t)(const LIS2DE12_Sample_t *samples,
+        uint16_t count);
+typedef void (*LIS2DE12_TempCallback_t)(bool success, int16_t temp);
+
 void LIS2DE12_Init();
 uint8_t LIS2DE12_ReadReg(uint8_t deviceAddress, uint8_t regAddress,
         uint8_t *data);
 uint8_t LIS2DE12_WriteReg(uint8_t deviceAddress, uint8_t regAddress,
         uint8_t data);
 uint8_t LIS2DE12_EnableTemp();
-uint8_t LIS2DE12_ReadTemp(int *val);
+uint8_t LIS2DE12_ReadTemp(int16_t *val);
+uint8_t LIS2DE12_ReadTempQ8(int16_t *temp);
+int16_t LIS2DE12_ConvertTemp(int16_t raw, const LIS2DE12_TempCalib_t *calib);
+uint8_t LIS2DE12_ReadFifo(LIS2DE12_Sample_t *samples, uint8_t count);
+uint8_t LIS2DE12_StartStream(uint8_t odr, LIS2DE12_Sample_t *buffer,
+        uint16_t size, LIS2DE12_StreamCallback_t callbackFromISR);
+uint8_t LIS2DE12_StopStream(void);
+uint8_t LIS2DE12_SetOdr(uint8_t odr);
+uint8_t LIS2DE12_ReadTempOneShot(int16_t *temp,
+        LIS2DE12_OneShotTiming_t *timing);
+uint8_t LIS2DE12_StartTempOneShot(LIS2DE12_TempCallback_t callbackFromISR);
+uint8_t LIS2DE12_EnableActivityInt(uint8_t threshold, uint8_t duration,
+        LIS2DE12_Callback_t callbackFromISR);
+uint8_t LIS2DE12_DisableActivityInt(void);
+uint8_t LIS2DE12_EnableOrientation(bool mode4D, uint8_t threshold,
+        uint8_t duration, CircularBuffer_t *events,
+        LIS2DE12_Callback_t callbackFromISR);
+uint8_t LIS2DE12_DisableOrientation(void);
+LIS2DE12_Orientation_t LIS2DE12_DecodeOrientation(uint8_t source);
+uint8_t LIS2DE12_ConfigHpFilter(uint8_t mode, uint8_t cutoff, uint8_t paths);
+uint8_t LIS2DE12_ResetHpFilter(void);
+void LIS2DE12_GetStats(LIS2DE12_Stats_t *snapshot);
+uint8_t LIS2DE12_SnapshotStats(CircularBuffer_t *telemetry);
+void LIS2DE12_ResetStats(void);
+uint8_t LIS2DE12_SelfTest(uint8_t samples, LIS2DE12_SelfTestResult_t *result);
 
 #endif /* LIS2DE12_H_ */
@@ -0,0 +1,33 @@
+/**
+ * @brief   Adaptive output data rate control of the accelerometer. The
+ *          sensor runs at a low data rate while the signal is quiet and
+ *          switches to a high data rate while there is activity.
+ */
+
+#ifndef ODRCTL_H_
+#define ODRCTL_H_
+
+#include "lis2de12.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Adaptive data rate configuration. */
+typedef struct
+{
+    uint8_t lowOdr;             /**< Data rate while quiet (LI2DE12_ODR_*). */
+    uint8_t highOdr;            /**< Data rate while active (LI2DE12_ODR_*). */
+    uint8_t activityThreshold;  /**< Activity interrupt threshold
+                                     (16mg/digit at +-2g). */
+    uint32_t varianceThreshold; /**< Variance (digit^2) of any axis which is
+                                     considered activity. */
+    uint32_t holdTime;          /**< Time in milliseconds kept at the high
+                                     data rate after the last activity. */
+
+} OdrCtl_Config_t;
+
+bool OdrCtl_Init(const OdrCtl_Config_t *config);
+void OdrCtl_ProcessSamples(const LIS2DE12_Sample_t *samples, uint16_t count);
+bool OdrCtl_Update(void);
+bool OdrCtl_IsActive(void);
+
+#endif /* ODRCTL_H_ */
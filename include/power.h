@@ -0,0 +1,30 @@
+/**
+ * @brief   Module which manages the HAL time base and the low power modes
+ *          the core idles in.
+ */
+
+#ifndef POWER_H_
+#define POWER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** STOP mode statistics. */
+typedef struct
+{
+    uint32_t count;             /**< Times the STOP mode was entered. */
+    uint32_t lastExit;          /**< Last exit latency (us). */
+    uint32_t maxExit;           /**< Maximum exit latency (us). */
+
+} Power_StopStats_t;
+
+void Power_Sleep(void);
+void Power_Stop(bool flashPowerDown);
+void Power_GetStopStats(Power_StopStats_t *stats);
+void Power_RunFromInterrupts(void);
+void Power_SetDeepSleep(bool deep);
+void Power_Standby(void);
+bool Power_WokeFromStandby(void);
+void *Power_EnableBackupRam(void);
+
+#endif /* POWER_H_ */
@@ -1,16 +1,83 @@
 /**
- * @brief   Module which manages the Real Time Counter (RTC) and the
- *          periodic alarm.
+ * @brief   Module which manages the Real Time Counter (RTC) and the software
+ *          timers multiplexed on its wake-up timer.
  */
 
 #ifndef RTC_H_
 #define RTC_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+
+/** Timestamp in ticks since 2000-01-01 00:00:00. A tick is a sub-second
+ * count, see RTC_GetTimestampFrequency. */
+typedef uint64_t RTC_Timestamp_t;
+
+/** RTC clock source. */
+typedef enum
+{
+    RTC_CLOCK_LSE = 1,          /**< External 32.768KHz crystal. */
+    RTC_CLOCK_LSI = 2           /**< Internal RC oscillator, calibrated. */
+
+} RTC_ClockSource_t;
+
+/** Batch window, each one on its own RTC alarm. */
+typedef enum
+{
+    RTC_WINDOW_A,               /**< Window on the Alarm A. */
+    RTC_WINDOW_B,               /**< Window on the Alarm B. */
+    RTC_WINDOW_NUM
+
+} RTC_Window_t;
+
+/** Batch window repetition. */
+typedef enum
+{
+    RTC_REPEAT_HOURLY,          /**< Every hour, at the given minute. */
+    RTC_REPEAT_DAILY            /**< Every day, at the given hour and minute. */
+
+} RTC_Repeat_t;
 
 typedef void (*RTC_Callback_t)(void);
+typedef void (*RTC_EventCallback_t)(RTC_Timestamp_t timestamp);
+
+/**
+ * Software timer. It shall be zero initialized before its first start and
+ * it's owned by the RTC module while active.
+ */
+typedef struct RTC_Timer
+{
+    struct RTC_Timer *next;         /**< Next timer of the wheel slot. */
+    struct RTC_Timer *prev;         /**< Previous timer of the wheel slot. */
+    RTC_Timestamp_t expiry;         /**< Expiry time. */
+    uint32_t period;                /**< Period (ms), 0 if one-shot. */
+    uint32_t step;                  /**< Whole ticks of the period. */
+    uint32_t stepFraction;          /**< Fraction of tick of the period. */
+    uint32_t fraction;              /**< Accumulated fraction of tick. */
+    RTC_Callback_t callbackFromISR; /**< Callback called on expiry. */
+    uint8_t level;                  /**< Wheel level. */
+    uint8_t slot;                   /**< Wheel slot. */
+    bool active;                    /**< Whether the timer is running. */
+
+} RTC_Timer_t;
 
 void RTC_Init(void);
+bool RTC_Resume(void);
+void RTC_SetStandbyWakeUp(uint32_t period);
 void RTC_SetPeriodicAlarm(uint32_t periodicity, RTC_Callback_t callbackFromISR);
+void RTC_StartTimer(RTC_Timer_t *timer, uint32_t delay, uint32_t period,
+        RTC_Callback_t callbackFromISR);
+void RTC_StopTimer(RTC_Timer_t *timer);
+void RTC_SetLsiFrequency(uint32_t frequency);
+void RTC_SetCalibrationRequest(RTC_Callback_t callbackFromISR);
+bool RTC_Calibrate(void);
+RTC_ClockSource_t RTC_GetClockSource(uint32_t *accuracy);
+void RTC_SetBatchWindow(RTC_Window_t window, RTC_Repeat_t repeat,
+        uint8_t hour, uint8_t minute, RTC_Callback_t callbackFromISR);
+void RTC_ClearBatchWindow(RTC_Window_t window);
+void RTC_EnableEventCapture(RTC_EventCallback_t callbackFromISR);
+void RTC_DisableEventCapture(void);
+RTC_Timestamp_t RTC_GetTimestamp(void);
+uint32_t RTC_GetTimestampFrequency(void);
 
 #endif /* RTC_H_ */
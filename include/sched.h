@@ -0,0 +1,34 @@
+/**
+ * @brief   Run-to-completion scheduler. Interrupts post events, which are
+ *          dispatched to their handlers from the main loop by priority.
+ */
+
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Number of event types. */
+#define SCHED_EVENTS                    16
+
+/** Number of priority levels (0 is the highest). */
+#define SCHED_PRIORITIES                4
+
+/** Number of events each priority level can hold (power of 2). */
+#define SCHED_QUEUE_SIZE                8
+
+/** Event handler. */
+typedef void (*Sched_Handler_t)(uint32_t param);
+
+/** Idle hook, called with the interrupts disabled when no event is
+ * pending. It shall return once an interrupt is pending. */
+typedef void (*Sched_Idle_t)(void);
+
+void Sched_Init(void);
+void Sched_Subscribe(uint8_t event, uint8_t priority, Sched_Handler_t handler);
+bool Sched_Post(uint8_t event, uint32_t param);
+void Sched_Run(Sched_Idle_t idle);
+uint32_t Sched_GetDropped(void);
+
+#endif /* SCHED_H_ */
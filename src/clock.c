@@ -0,0 +1,187 @@
+/**
+ * @brief   Module which scales the system clock to the work at hand: the
+ *          PLL with the over-drive for processing bursts, and a divided HSI
+ *          on the lowest voltage scale for bus waits and idle.
+ *
+ * The core races through a burst at full speed and drops back to the idle
+ * clock as soon as it's done. Each switch reprograms the HAL tick (from
+ * HAL_RCC_ClockConfig) and the I2C timing, so both keep their rates.
+ */
+
+#include "clock.h"
+#include "i2cbus.h"
+#include "assert.h"
+#include "stm32f4xx_hal.h"
+
+/* PLL fed by the HSI: 16MHz / 8 * 180 / 2 = 180MHz */
+#define CLOCK_PLL_M                     8
+#define CLOCK_PLL_N                     180
+#define CLOCK_PLL_P                     RCC_PLLP_DIV2
+#define CLOCK_PLL_Q                     8
+#define CLOCK_PLL_R                     2
+
+static void Clock_Enter(Clock_Mode_t mode);
+static void Clock_EnterIdle(void);
+static void Clock_EnterBurst(void);
+
+/** System clock mode in use. */
+static Clock_Mode_t clockMode = CLOCK_MODE_IDLE;
+
+/**
+ * Initialize the system clock on the idle mode.
+ */
+void Clock_Init(void)
+{
+    __HAL_RCC_PWR_CLK_ENABLE();
+
+    ASSERT(I2CBus_Hold());
+
+    Clock_Enter(CLOCK_MODE_IDLE);
+
+    I2CBus_Release();
+}
+
+/**
+ * Switch the system clock to a mode. The switch waits for the PLL and the
+ * regulator, some tens of microseconds when going up, so it's meant to
+ * bracket bursts of processing, not single operations. It can't happen while
+ * an I2C transfer is in progress, as the bus clock is derived from it: the
+ * bus is held through the switch instead, which runs with the interrupts
+ * enabled, so the HAL timeouts still count on the tick.
+ *
+ * @param   mode    System clock mode.
+ *
+ * @returns It returns true if the mode has been switched to. Otherwise (the
+ *          I2C bus is busy), it returns false.
+ */
+bool Clock_SetMode(Clock_Mode_t mode)
+{
+    if (mode == clockMode)
+    {
+        return true;
+    }
+
+    if (!I2CBus_Hold())
+    {
+        return false;
+    }
+
+    Clock_Enter(mode);
+
+    I2CBus_Release();
+
+    return true;
+}
+
+/**
+ * Get the system clock mode in use.
+ *
+ * @returns It returns the system clock mode.
+ */
+Clock_Mode_t Clock_GetMode(void)
+{
+    return clockMode;
+}
+
+/**
+ * Switch the system clock to a mode and update the I2C timing. The HAL tick
+ * is reprogrammed for the new clock by HAL_RCC_ClockConfig, which also
+ * enables its interrupt, so it's suspended again if it was.
+ *
+ * @param   mode    System clock mode.
+ */
+static void Clock_Enter(Clock_Mode_t mode)
+{
+    bool tickSuspended;
+
+    tickSuspended = !READ_BIT(SysTick->CTRL, SysTick_CTRL_TICKINT_Msk);
+
+    if (mode == CLOCK_MODE_BURST)
+    {
+        Clock_EnterBurst();
+    }
+    else
+    {
+        Clock_EnterIdle();
+    }
+
+    if (tickSuspended)
+    {
+        HAL_SuspendTick();
+    }
+
+    clockMode = mode;
+
+    I2CBus_UpdateTiming();
+}
+
+/**
+ * Switch the system clock to the HSI divided by 2, turn the PLL and the
+ * over-drive off and lower the voltage scale. APB1 stays above the 2MHz the
+ * I2C needs.
+ */
+static void Clock_EnterIdle(void)
+{
+    RCC_ClkInitTypeDef clkInit;
+    RCC_OscInitTypeDef oscInit;
+
+    /* The flash latency is lowered after the clock, by the HAL */
+    clkInit.ClockType = RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_HCLK
+        | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    clkInit.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
+    clkInit.AHBCLKDivider = RCC_SYSCLK_DIV2;
+    clkInit.APB1CLKDivider = RCC_HCLK_DIV1;
+    clkInit.APB2CLKDivider = RCC_HCLK_DIV1;
+
+    ASSERT(HAL_RCC_ClockConfig(&clkInit, FLASH_LATENCY_0) == HAL_OK);
+
+    if (READ_BIT(PWR->CR, PWR_CR_ODEN))
+    {
+        ASSERT(HAL_PWREx_DisableOverDrive() == HAL_OK);
+    }
+
+    /* The scale is only latched while the PLL runs, which the HAL turns on
+     * for it */
+    ASSERT(HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE3)
+        == HAL_OK);
+
+    oscInit.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+    oscInit.PLL.PLLState = RCC_PLL_OFF;
+
+    ASSERT(HAL_RCC_OscConfig(&oscInit) == HAL_OK);
+}
+
+/**
+ * Start the PLL, raise the voltage scale with the over-drive and switch the
+ * system clock to the PLL. APB1 is limited to 45MHz and APB2 to 90MHz.
+ */
+static void Clock_EnterBurst(void)
+{
+    RCC_ClkInitTypeDef clkInit;
+    RCC_OscInitTypeDef oscInit;
+
+    oscInit.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+    oscInit.PLL.PLLState = RCC_PLL_ON;
+    oscInit.PLL.PLLSource = RCC_PLLSOURCE_HSI;
+    oscInit.PLL.PLLM = CLOCK_PLL_M;
+    oscInit.PLL.PLLN = CLOCK_PLL_N;
+    oscInit.PLL.PLLP = CLOCK_PLL_P;
+    oscInit.PLL.PLLQ = CLOCK_PLL_Q;
+    oscInit.PLL.PLLR = CLOCK_PLL_R;
+
+    ASSERT(HAL_RCC_OscConfig(&oscInit) == HAL_OK);
+
+    ASSERT(HAL_PWREx_ControlVoltageScaling(PWR_REGULATOR_VOLTAGE_SCALE1)
+        == HAL_OK);
+    ASSERT(HAL_PWREx_EnableOverDrive() == HAL_OK);
+
+    /* The flash latency is raised before the clock, by the HAL */
+    clkInit.ClockType = RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_HCLK
+        | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    clkInit.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+    clkInit.AHBCLKDivider = RCC_SYSCLK_DIV1;
+    clkInit.APB1CLKDivider = RCC_HCLK_DIV4;
+    clkInit.APB2CLKDivider = RCC_HCLK_DIV2;
+
+    ASSERT(HAL_RCC_ClockConfig(&clkInit, FLASH_LATENCY_5) == HAL_OK);
+}
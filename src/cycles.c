@@ -0,0 +1,16 @@
+/**
+ * @brief   Cycle counter based on the Data Watchpoint and Trace (DWT) unit,
+ *          used to profile the firmware.
+ */
+
+#include "cycles.h"
+
+/**
+ * Initialize and start the cycle counter.
+ */
+void Cycles_Init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
@@ -0,0 +1,1059 @@
+/**
+ * @brief   I2C bus shared by all devices connected to it. Transfers are
+ *          queued by priority and executed back to back from interrupts.
+ */
+
+#include "i2cbus.h"
+#include "assert.h"
+#include "cycles.h"
+#include "stm32f4xx_hal.h"
+
+#define I2CBUS_CLK_HZ                           100000
+
+#define I2CBUS_CLK_ENABLE()                     __HAL_RCC_I2C1_CLK_ENABLE()
+#define I2CBUS_SDA_GPIO_CLK_ENABLE()            __HAL_RCC_GPIOB_CLK_ENABLE()
+#define I2CBUS_SCL_GPIO_CLK_ENABLE()            __HAL_RCC_GPIOB_CLK_ENABLE()
+
+#define I2CBUS_SCL_PIN                          GPIO_PIN_6
+#define I2CBUS_SCL_GPIO_PORT                    GPIOB
+#define I2CBUS_SCL_AF                           GPIO_AF4_I2C1
+
+#define I2CBUS_SDA_PIN                          GPIO_PIN_9
+#define I2CBUS_SDA_GPIO_PORT                    GPIOB
+#define I2CBUS_SDA_AF                           GPIO_AF4_I2C1
+
+#define I2CBUS_INSTANCE                         I2C1
+#define I2CBUS_EV_IRQn                          I2C1_EV_IRQn
+#define I2CBUS_ER_IRQn                          I2C1_ER_IRQn
+
+#define I2CBUS_DMA_CLK_ENABLE()                 __HAL_RCC_DMA1_CLK_ENABLE()
+#define I2CBUS_DMA_RX_STREAM                    DMA1_Stream0
+#define I2CBUS_DMA_RX_CHANNEL                   DMA_CHANNEL_1
+#define I2CBUS_DMA_RX_IRQn                      DMA1_Stream0_IRQn
+#define I2CBUS_DMA_RX_FLAGS                     (DMA_LISR_TCIF0 | \
+                                                 DMA_LISR_HTIF0 | \
+                                                 DMA_LISR_TEIF0 | \
+                                                 DMA_LISR_DMEIF0 | \
+                                                 DMA_LISR_FEIF0)
+
+/* The I2C interrupts shall preempt the RTC one (0x0F), so the blocking
+ * transfers can be issued from the RTC callbacks */
+#define I2CBUS_IRQ_PRIORITY                     0x0E
+
+#define I2CBUS_SHIFTED_ADDR(addr)               (addr << 1)
+
+/* Number of SCL pulses needed to make a slave release the SDA line */
+#define I2CBUS_RECOVERY_PULSES                  9
+
+/* Approximated number of cycles spent by each iteration of the delay loop */
+#define I2CBUS_DELAY_LOOP_CYCLES                4
+
+/* Errors which indicate that the bus got stuck and needs to be recovered */
+#define I2CBUS_BUS_ERRORS                       (HAL_I2C_ERROR_BERR | \
+                                                 HAL_I2C_ERROR_ARLO | \
+                                                 HAL_I2C_ERROR_TIMEOUT)
+
+/* Fast path interrupts */
+#define I2CBUS_FAST_IT                          (I2C_CR2_ITEVTEN | \
+                                                 I2C_CR2_ITERREN | \
+                                                 I2C_CR2_ITBUFEN)
+
+/* Fast path error flags */
+#define I2CBUS_FAST_ERRORS                      (I2C_SR1_BERR | I2C_SR1_ARLO | \
+                                                 I2C_SR1_AF | I2C_SR1_OVR)
+
+/* Fast path reads of this size or bigger receive the data through DMA, so
+ * a FIFO burst costs a single interrupt instead of one per byte */
+#define I2CBUS_FAST_DMA_MIN_SIZE                4
+
+/* Maximum number of loops waiting for a pending STOP condition */
+#define I2CBUS_STOP_WAIT_LOOPS                  1000
+
+/** Register-level fast path states. */
+typedef enum
+{
+    I2CBUS_FAST_IDLE,
+    I2CBUS_FAST_START,          /**< Waiting START to send address (write). */
+    I2CBUS_FAST_ADDR_WRITE,     /**< Waiting address (write) acknowledge. */
+    I2CBUS_FAST_REG,            /**< Waiting register address to be sent. */
+    I2CBUS_FAST_RESTART,        /**< Waiting START to send address (read). */
+    I2CBUS_FAST_ADDR_READ,      /**< Waiting address (read) acknowledge. */
+    I2CBUS_FAST_DATA,           /**< Receiving data. */
+    I2CBUS_FAST_DMA             /**< Receiving data through DMA. */
+
+} I2CBus_FastState_t;
+
+static void I2CBus_StartNext(void);
+static HAL_StatusTypeDef I2CBus_Start(I2CBus_Transfer_t *xfer);
+static bool I2CBus_IsFree(void);
+static HAL_StatusTypeDef I2CBus_FastStart(I2CBus_Transfer_t *xfer);
+static void I2CBus_FastEvent(void);
+static void I2CBus_FastError(void);
+static void I2CBus_FastStop(void);
+static void I2CBus_FastStartDma(void);
+static void I2CBus_Complete(I2CBus_Status_t status, I2CBus_Error_t error);
+static bool I2CBus_Read(uint8_t deviceAddress, uint8_t regAddress,
+        uint8_t *data, uint16_t size, uint8_t flags);
+static void I2CBus_RecoverBus(void);
+static void I2CBus_Delay(void);
+
+static I2C_HandleTypeDef i2cHandle;
+
+/** Fast path state and the data remaining to be received. */
+static volatile I2CBus_FastState_t fastState;
+static uint8_t *fastData;
+static uint16_t fastRemaining;
+
+/** CPU cost of each path, and cycles spent in the completion callbacks,
+ * which are not accounted to the bus driver. */
+static I2CBus_Profile_t profile[I2CBUS_PATH_NUM];
+static uint32_t callbackCycles;
+
+/** Number of bus recoveries. */
+static volatile uint32_t recoveries;
+
+/** Transfers waiting for the bus, sorted by priority. */
+static I2CBus_Transfer_t *queueHead;
+
+/** Transfer which currently owns the bus. */
+static I2CBus_Transfer_t *volatile currentXfer;
+
+/** Whether the bus is held, which keeps the transfers queued. */
+static volatile bool held;
+
+/**
+ * Initialize the I2C bus. It may be called by every device driver which uses
+ * the bus, only the first call initializes the peripheral.
+ */
+void I2CBus_Init(void)
+{
+    if (i2cHandle.State != HAL_I2C_STATE_RESET)
+    {
+        return;
+    }
+
+    i2cHandle.Instance = I2C1;
+
+    i2cHandle.Init.ClockSpeed = I2CBUS_CLK_HZ;
+    i2cHandle.Init.DutyCycle = I2C_DUTYCYCLE_16_9;
+    i2cHandle.Init.OwnAddress1 = 0;
+    i2cHandle.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
+    i2cHandle.Init.DualAddressMode = I2C_DUALADDRESS_DISABLE;
+    i2cHandle.Init.OwnAddress2 = 0;
+    i2cHandle.Init.GeneralCallMode = I2C_GENERALCALL_DISABLE;
+    i2cHandle.Init.NoStretchMode = I2C_NOSTRETCH_DISABLE;
+
+    queueHead = NULL;
+    currentXfer = NULL;
+    held = false;
+
+    ASSERT(HAL_I2C_Init(&i2cHandle) == HAL_OK);
+}
+
+/**
+ * Submit a transfer to the bus. The transfer is queued after all transfers
+ * with the same or higher priority and it's started as soon as the bus is
+ * free. This function may be called from any context.
+ *
+ * @param   xfer    Transfer to be submitted.
+ *
+ * @returns It returns 'true' if the transfer has been queued. Otherwise, it
+ *          returns 'false' (the transfer is already pending).
+ */
+bool I2CBus_Submit(I2CBus_Transfer_t *xfer)
+{
+    I2CBus_Transfer_t **link;
+    uint32_t primask;
+    bool result = false;
+
+    ASSERT(xfer);
+    ASSERT(xfer->data);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (xfer->status != I2CBUS_STATUS_PENDING)
+    {
+        xfer->status = I2CBUS_STATUS_PENDING;
+
+        /* Find the position keeping the FIFO order within a priority */
+        link = &queueHead;
+
+        while ((*link != NULL) && ((*link)->priority <= xfer->priority))
+        {
+            link = &(*link)->next;
+        }
+
+        xfer->next = *link;
+        *link = xfer;
+
+        result = true;
+    }
+
+    __set_PRIMASK(primask);
+
+    /* Started out of the critical section, as it might recover the bus */
+    if (result)
+    {
+        I2CBus_StartNext();
+    }
+
+    return result;
+}
+
+/**
+ * Check whether the bus is idle: no transfer owns it nor is waiting for it.
+ *
+ * @returns It returns 'true' if the bus is idle. Otherwise, it returns
+ *          'false'.
+ */
+bool I2CBus_IsIdle(void)
+{
+    return (currentXfer == NULL) && (queueHead == NULL);
+}
+
+/**
+ * Hold the bus if it's idle: the transfers submitted meanwhile are queued,
+ * and only started once it's released. It lets the bus clock be changed
+ * with the interrupts enabled. A blocking transfer shall not be issued while
+ * it's held, unless from the code which holds it, after the release.
+ *
+ * @returns It returns 'true' if the bus has been held. Otherwise (a transfer
+ *          is in progress or waiting, or the bus is already held), it
+ *          returns 'false'.
+ */
+bool I2CBus_Hold(void)
+{
+    uint32_t primask;
+    bool result = false;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (I2CBus_IsIdle() && !held)
+    {
+        held = true;
+        result = true;
+    }
+
+    __set_PRIMASK(primask);
+
+    return result;
+}
+
+/**
+ * Release the bus held by I2CBus_Hold, and start the transfers queued
+ * meanwhile.
+ */
+void I2CBus_Release(void)
+{
+    ASSERT(held);
+
+    held = false;
+
+    I2CBus_StartNext();
+}
+
+/**
+ * Compute the bus timing again from the current APB1 clock. It shall be
+ * called after every change of the APB1 clock, while the bus is held, so no
+ * transfer runs on a stale timing.
+ */
+void I2CBus_UpdateTiming(void)
+{
+    if (i2cHandle.State == HAL_I2C_STATE_RESET)
+    {
+        return;
+    }
+
+    ASSERT(held && (currentXfer == NULL));
+
+    /* The MSP is only initialized from the reset state, so this only
+     * reprograms the clock control and rise time registers */
+    ASSERT(HAL_I2C_Init(&i2cHandle) == HAL_OK);
+}
+
+/**
+ * Read registers from a device, waiting for the transfer to be completed.
+ *
+ * @note    It shall not be called from an ISR with priority higher than or
+ *          equal to the I2C interrupts.
+ *
+ * @param   deviceAddress       I2C device address.
+ * @param   regAddress          First register address to be read.
+ * @param   data                Memory to store the read data.
+ * @param   size                Number of bytes to be read.
+ *
+ * @returns It returns 'true' if the registers have been read with success.
+ *          Otherwise, it returns 'false'.
+ */
+bool I2CBus_MemRead(uint8_t deviceAddress, uint8_t regAddress, uint8_t *data,
+        uint16_t size)
+{
+    return I2CBus_Read(deviceAddress, regAddress, data, size, 0);
+}
+
+/**
+ * Write registers of a device, waiting for the transfer to be completed.
+ *
+ * @note    It shall not be called from an ISR with priority higher than or
+ *          equal to the I2C interrupts.
+ *
+ * @param   deviceAddress       I2C device address.
+ * @param   regAddress          First register address to be written.
+ * @param   data                Data to be written.
+ * @param   size                Number of bytes to be written.
+ *
+ * @returns It returns 'true' if the registers have been written with success.
+ *          Otherwise, it returns 'false'.
+ */
+bool I2CBus_MemWrite(uint8_t deviceAddress, uint8_t regAddress,
+        const uint8_t *data, uint16_t size)
+{
+    I2CBus_Transfer_t xfer = { 0 };
+
+    xfer.deviceAddress = deviceAddress;
+    xfer.regAddress = regAddress;
+    xfer.data = (uint8_t *) data;
+    xfer.size = size;
+    xfer.direction = I2CBUS_DIR_WRITE;
+    xfer.priority = I2CBUS_PRIORITY_HIGHEST;
+
+    return I2CBus_Execute(&xfer);
+}
+
+/**
+ * Read registers from a device through the register-level fast path, waiting
+ * for the transfer to be completed. It's meant for the hot transfers, which
+ * are issued on every sample.
+ *
+ * @note    It shall not be called from an ISR with priority higher than or
+ *          equal to the I2C interrupts.
+ *
+ * @param   deviceAddress       I2C device address.
+ * @param   regAddress          First register address to be read.
+ * @param   data                Memory to store the read data.
+ * @param   size                Number of bytes to be read.
+ *
+ * @returns It returns 'true' if the registers have been read with success.
+ *          Otherwise, it returns 'false'.
+ */
+bool I2CBus_FastRead(uint8_t deviceAddress, uint8_t regAddress, uint8_t *data,
+        uint16_t size)
+{
+    return I2CBus_Read(deviceAddress, regAddress, data, size,
+        I2CBUS_FLAG_FAST);
+}
+
+/**
+ * Get the CPU cost of the transfers executed by a given path. The cycles
+ * include the transfer start and the interrupts, but not the completion
+ * callbacks.
+ *
+ * @param   path        Path to be read.
+ * @param   prof        Memory to store the profile.
+ */
+void I2CBus_GetProfile(I2CBus_Path_t path, I2CBus_Profile_t *prof)
+{
+    uint32_t primask;
+
+    ASSERT(path < I2CBUS_PATH_NUM);
+    ASSERT(prof);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    *prof = profile[path];
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * Get the number of times the bus has been recovered.
+ *
+ * @returns It returns the number of bus recoveries.
+ */
+uint32_t I2CBus_GetRecoveries(void)
+{
+    return recoveries;
+}
+
+/**
+ * Read registers from a device, waiting for the transfer to be completed.
+ *
+ * @param   deviceAddress       I2C device address.
+ * @param   regAddress          First register address to be read.
+ * @param   data                Memory to store the read data.
+ * @param   size                Number of bytes to be read.
+ * @param   flags               Transfer flags.
+ *
+ * @returns It returns 'true' if the registers have been read with success.
+ *          Otherwise, it returns 'false'.
+ */
+static bool I2CBus_Read(uint8_t deviceAddress, uint8_t regAddress,
+        uint8_t *data, uint16_t size, uint8_t flags)
+{
+    I2CBus_Transfer_t xfer = { 0 };
+
+    xfer.deviceAddress = deviceAddress;
+    xfer.regAddress = regAddress;
+    xfer.data = data;
+    xfer.size = size;
+    xfer.direction = I2CBUS_DIR_READ;
+    xfer.priority = I2CBUS_PRIORITY_HIGHEST;
+    xfer.flags = flags;
+
+    return I2CBus_Execute(&xfer);
+}
+
+/**
+ * Submit a transfer and sleep until it has been completed. The transfer
+ * error and duration are kept in the transfer.
+ *
+ * @note    It shall not be called from an ISR with priority higher than or
+ *          equal to the I2C interrupts.
+ *
+ * @param   xfer    Transfer to be executed.
+ *
+ * @returns It returns 'true' if the transfer has been completed with success.
+ *          Otherwise, it returns 'false'.
+ */
+bool I2CBus_Execute(I2CBus_Transfer_t *xfer)
+{
+    if (!I2CBus_Submit(xfer))
+    {
+        return false;
+    }
+
+    /* The completion sends an event, so this loop doesn't poll the bus */
+    while (xfer->status == I2CBUS_STATUS_PENDING)
+    {
+        __WFE();
+    }
+
+    return (xfer->status == I2CBUS_STATUS_DONE);
+}
+
+/**
+ * Start the next queued transfer, if the bus is free. Transfers which can
+ * not be started even after a bus recovery are completed with error.
+ *
+ * Only taking the transfer off the queue runs with the interrupts disabled.
+ * The transfer owns the bus from then on, so it's started, or the bus
+ * recovered, with the interrupts enabled, while other contexts can still
+ * queue transfers. This function may be called from any context.
+ */
+static void I2CBus_StartNext(void)
+{
+    I2CBus_Transfer_t *xfer;
+    uint32_t primask;
+
+    while (1)
+    {
+        primask = __get_PRIMASK();
+        __disable_irq();
+
+        if ((currentXfer != NULL) || held || (queueHead == NULL))
+        {
+            __set_PRIMASK(primask);
+            return;
+        }
+
+        xfer = queueHead;
+        queueHead = xfer->next;
+        currentXfer = xfer;
+
+        __set_PRIMASK(primask);
+
+        if (I2CBus_Start(xfer) == HAL_OK)
+        {
+            return;
+        }
+
+        I2CBus_RecoverBus();
+
+        if (I2CBus_Start(xfer) == HAL_OK)
+        {
+            return;
+        }
+
+        xfer->error = I2CBUS_ERROR_TIMEOUT;
+        xfer->cycles = 0;
+        currentXfer = NULL;
+        xfer->status = I2CBUS_STATUS_ERROR;
+
+        if (xfer->callbackFromISR)
+        {
+            xfer->callbackFromISR(xfer);
+        }
+
+        __SEV();
+    }
+}
+
+/**
+ * Start a transfer on the I2C peripheral.
+ *
+ * @param   xfer    Transfer to be started.
+ *
+ * @returns It returns the HAL status of the transfer start, or HAL_BUSY if
+ *          the bus is stuck.
+ */
+static HAL_StatusTypeDef I2CBus_Start(I2CBus_Transfer_t *xfer)
+{
+    HAL_StatusTypeDef status;
+    I2CBus_Path_t path = I2CBUS_PATH_HAL;
+    uint32_t start = CYCLES_GET();
+    uint32_t primask;
+
+    xfer->cycles = start;
+    xfer->error = I2CBUS_ERROR_NONE;
+
+    /* A stuck bus is caught here, rather than by the HAL BUSY timeout */
+    if (!I2CBus_IsFree())
+    {
+        return HAL_BUSY;
+    }
+
+    if ((xfer->flags & I2CBUS_FLAG_FAST)
+            && (xfer->direction == I2CBUS_DIR_READ))
+    {
+        path = I2CBUS_PATH_FAST;
+        status = I2CBus_FastStart(xfer);
+    }
+    else if (xfer->direction == I2CBUS_DIR_READ)
+    {
+        status = HAL_I2C_Mem_Read_IT(&i2cHandle,
+            I2CBUS_SHIFTED_ADDR(xfer->deviceAddress), xfer->regAddress,
+            I2C_MEMADD_SIZE_8BIT, xfer->data, xfer->size);
+    }
+    else
+    {
+        status = HAL_I2C_Mem_Write_IT(&i2cHandle,
+            I2CBUS_SHIFTED_ADDR(xfer->deviceAddress), xfer->regAddress,
+            I2C_MEMADD_SIZE_8BIT, xfer->data, xfer->size);
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    profile[path].cycles += CYCLES_GET() - start;
+
+    __set_PRIMASK(primask);
+
+    return status;
+}
+
+/**
+ * Check whether the bus is free to start a transfer. A new START shall not
+ * be requested while the previous STOP is still pending, which takes a few
+ * microseconds, so that one is waited for. A bus still busy after that, or
+ * whose SDA line is held low, is stuck: a slave has been left in the middle
+ * of a transfer. It's not waited for any longer, so a stuck bus is caught
+ * within a few microseconds.
+ *
+ * @returns It returns 'true' if the bus is free. Otherwise, it returns
+ *          'false' and the bus shall be recovered.
+ */
+static bool I2CBus_IsFree(void)
+{
+    I2C_TypeDef *i2c = I2CBUS_INSTANCE;
+    uint32_t loops = I2CBUS_STOP_WAIT_LOOPS;
+
+    while ((i2c->CR1 & I2C_CR1_STOP) && --loops)
+        ;
+
+    return !(i2c->CR1 & I2C_CR1_STOP) && !(i2c->SR2 & I2C_SR2_BUSY)
+        && (HAL_GPIO_ReadPin(I2CBUS_SDA_GPIO_PORT, I2CBUS_SDA_PIN)
+            == GPIO_PIN_SET);
+}
+
+/**
+ * Start a read transfer on the register-level fast path. The transfer is
+ * driven by the I2C event and error interrupts, without any of the HAL
+ * checks, timeouts or locks.
+ *
+ * @param   xfer    Transfer to be started.
+ *
+ * @returns It returns HAL_OK once the transfer has been started.
+ */
+static HAL_StatusTypeDef I2CBus_FastStart(I2CBus_Transfer_t *xfer)
+{
+    I2C_TypeDef *i2c = I2CBUS_INSTANCE;
+
+    fastData = xfer->data;
+    fastRemaining = xfer->size;
+    fastState = I2CBUS_FAST_START;
+
+    CLEAR_BIT(i2c->CR1, I2C_CR1_POS);
+    SET_BIT(i2c->CR1, I2C_CR1_ACK | I2C_CR1_START);
+    SET_BIT(i2c->CR2, I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+
+    return HAL_OK;
+}
+
+/**
+ * Handle the I2C event interrupt of the fast path.
+ */
+static void I2CBus_FastEvent(void)
+{
+    I2C_TypeDef *i2c = I2CBUS_INSTANCE;
+    uint32_t sr1 = i2c->SR1;
+
+    switch (fastState)
+    {
+        case I2CBUS_FAST_START: /* Send device address for writing */
+            if (sr1 & I2C_SR1_SB)
+            {
+                i2c->DR = I2CBUS_SHIFTED_ADDR(currentXfer->deviceAddress);
+                fastState = I2CBUS_FAST_ADDR_WRITE;
+            }
+            break;
+
+        case I2CBUS_FAST_ADDR_WRITE: /* Send register address */
+            if (sr1 & I2C_SR1_ADDR)
+            {
+                (void) i2c->SR2;
+                i2c->DR = currentXfer->regAddress;
+                fastState = I2CBUS_FAST_REG;
+            }
+            break;
+
+        case I2CBUS_FAST_REG: /* Repeated START once register is sent */
+            if (sr1 & I2C_SR1_BTF)
+            {
+                SET_BIT(i2c->CR1, I2C_CR1_START);
+                fastState = I2CBUS_FAST_RESTART;
+            }
+            break;
+
+        case I2CBUS_FAST_RESTART: /* Send device address for reading */
+            if (sr1 & I2C_SR1_SB)
+            {
+                i2c->DR = I2CBUS_SHIFTED_ADDR(currentXfer->deviceAddress) | 1;
+                fastState = I2CBUS_FAST_ADDR_READ;
+            }
+            break;
+
+        case I2CBUS_FAST_ADDR_READ: /* Prepare the ACK/STOP handling */
+            if (sr1 & I2C_SR1_ADDR)
+            {
+                if (fastRemaining >= I2CBUS_FAST_DMA_MIN_SIZE)
+                {
+                    /* The DMA must be armed before the ADDR flag is cleared,
+                     * the LAST bit NACKs the last byte automatically */
+                    I2CBus_FastStartDma();
+                    (void) i2c->SR2;
+
+                    fastState = I2CBUS_FAST_DMA;
+                    break;
+                }
+                else if (fastRemaining == 1)
+                {
+                    CLEAR_BIT(i2c->CR1, I2C_CR1_ACK);
+                    (void) i2c->SR2;
+                    SET_BIT(i2c->CR1, I2C_CR1_STOP);
+                    SET_BIT(i2c->CR2, I2C_CR2_ITBUFEN);
+                }
+                else if (fastRemaining == 2)
+                {
+                    CLEAR_BIT(i2c->CR1, I2C_CR1_ACK);
+                    SET_BIT(i2c->CR1, I2C_CR1_POS);
+                    (void) i2c->SR2;
+                }
+                else
+                {
+                    (void) i2c->SR2;
+
+                    if (fastRemaining > 3)
+                    {
+                        SET_BIT(i2c->CR2, I2C_CR2_ITBUFEN);
+                    }
+                }
+
+                fastState = I2CBUS_FAST_DATA;
+            }
+            break;
+
+        case I2CBUS_FAST_DATA:
+            if ((fastRemaining == 1) || (fastRemaining > 3))
+            {
+                /* Single bytes are read as they arrive */
+                if (sr1 & I2C_SR1_RXNE)
+                {
+                    *fastData++ = i2c->DR;
+                    fastRemaining--;
+
+                    if (fastRemaining == 3)
+                    {
+                        CLEAR_BIT(i2c->CR2, I2C_CR2_ITBUFEN);
+                    }
+                    else if (fastRemaining == 0)
+                    {
+                        I2CBus_FastStop();
+                        I2CBus_Complete(I2CBUS_STATUS_DONE, I2CBUS_ERROR_NONE);
+                    }
+                }
+            }
+            else if (sr1 & I2C_SR1_BTF)
+            {
+                /* The last bytes are read in pairs to NACK the last one */
+                if (fastRemaining == 3)
+                {
+                    CLEAR_BIT(i2c->CR1, I2C_CR1_ACK);
+                    *fastData++ = i2c->DR;
+                    fastRemaining--;
+                }
+                else
+                {
+                    SET_BIT(i2c->CR1, I2C_CR1_STOP);
+                    *fastData++ = i2c->DR;
+                    *fastData++ = i2c->DR;
+                    fastRemaining = 0;
+
+                    I2CBus_FastStop();
+                    I2CBus_Complete(I2CBUS_STATUS_DONE, I2CBUS_ERROR_NONE);
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * Handle the I2C error interrupt of the fast path.
+ */
+static void I2CBus_FastError(void)
+{
+    I2C_TypeDef *i2c = I2CBUS_INSTANCE;
+    uint32_t sr1 = i2c->SR1;
+
+    CLEAR_BIT(i2c->SR1, I2CBUS_FAST_ERRORS);
+
+    if (sr1 & I2C_SR1_AF)
+    {
+        SET_BIT(i2c->CR1, I2C_CR1_STOP);
+    }
+
+    I2CBus_FastStop();
+
+    if (sr1 & (I2C_SR1_BERR | I2C_SR1_ARLO))
+    {
+        I2CBus_RecoverBus();
+        I2CBus_Complete(I2CBUS_STATUS_ERROR, I2CBUS_ERROR_BUS);
+    }
+    else if (sr1 & I2C_SR1_AF)
+    {
+        I2CBus_Complete(I2CBUS_STATUS_ERROR, I2CBUS_ERROR_NACK);
+    }
+    else
+    {
+        I2CBus_Complete(I2CBUS_STATUS_ERROR, I2CBUS_ERROR_OTHER);
+    }
+}
+
+/**
+ * Arm the DMA to receive the remaining data of the fast path transfer.
+ */
+static void I2CBus_FastStartDma(void)
+{
+    I2C_TypeDef *i2c = I2CBUS_INSTANCE;
+    DMA_Stream_TypeDef *dma = I2CBUS_DMA_RX_STREAM;
+
+    CLEAR_BIT(dma->CR, DMA_SxCR_EN);
+    DMA1->LIFCR = I2CBUS_DMA_RX_FLAGS;
+
+    dma->PAR = (uint32_t) &i2c->DR;
+    dma->M0AR = (uint32_t) fastData;
+    dma->NDTR = fastRemaining;
+    dma->FCR = 0;
+    dma->CR = I2CBUS_DMA_RX_CHANNEL | DMA_SxCR_MINC | DMA_SxCR_TCIE
+        | DMA_SxCR_TEIE | DMA_SxCR_EN;
+
+    SET_BIT(i2c->CR2, I2C_CR2_DMAEN | I2C_CR2_LAST);
+}
+
+/**
+ * Stop the fast path, leaving the peripheral ready for the HAL.
+ */
+static void I2CBus_FastStop(void)
+{
+    I2C_TypeDef *i2c = I2CBUS_INSTANCE;
+
+    CLEAR_BIT(I2CBUS_DMA_RX_STREAM->CR, DMA_SxCR_EN);
+    CLEAR_BIT(i2c->CR2, I2CBUS_FAST_IT | I2C_CR2_DMAEN | I2C_CR2_LAST);
+    CLEAR_BIT(i2c->CR1, I2C_CR1_POS);
+    fastState = I2CBUS_FAST_IDLE;
+    profile[I2CBUS_PATH_FAST].transfers++;
+}
+
+/**
+ * Complete the current transfer, start the next one and only then notify the
+ * owner of the completed transfer, so the bus is not kept idle while the
+ * callback runs.
+ *
+ * @param   status  Status of the completed transfer.
+ * @param   error   Error of the completed transfer.
+ */
+static void I2CBus_Complete(I2CBus_Status_t status, I2CBus_Error_t error)
+{
+    I2CBus_Transfer_t *xfer = currentXfer;
+
+    if (xfer == NULL)
+    {
+        return;
+    }
+
+    xfer->cycles = CYCLES_GET() - xfer->cycles;
+    xfer->error = error;
+    currentXfer = NULL;
+    I2CBus_StartNext();
+
+    xfer->status = status;
+
+    if (xfer->callbackFromISR)
+    {
+        uint32_t start = CYCLES_GET();
+
+        xfer->callbackFromISR(xfer);
+        callbackCycles += CYCLES_GET() - start;
+    }
+
+    /* Wake up any context waiting for the transfer */
+    __SEV();
+}
+
+/**
+ * Recover the I2C bus when a slave is holding the SDA line low (e.g. it has
+ * been reset in the middle of a transfer). The SCL line is clocked manually
+ * until the slave releases SDA, a STOP condition is issued and then the I2C
+ * peripheral is reset and initialized again.
+ *
+ * At 100KHz the whole sequence takes about 110us.
+ */
+static void I2CBus_RecoverBus(void)
+{
+    GPIO_InitTypeDef gpioInit;
+    uint8_t pulse;
+
+    recoveries++;
+    HAL_I2C_DeInit(&i2cHandle);
+
+    /* Take the control of the bus lines, both released (high) */
+    HAL_GPIO_WritePin(I2CBUS_SCL_GPIO_PORT, I2CBUS_SCL_PIN, GPIO_PIN_SET);
+    HAL_GPIO_WritePin(I2CBUS_SDA_GPIO_PORT, I2CBUS_SDA_PIN, GPIO_PIN_SET);
+
+    gpioInit.Pin = I2CBUS_SCL_PIN;
+    gpioInit.Mode = GPIO_MODE_OUTPUT_OD;
+    gpioInit.Pull = GPIO_PULLUP;
+    gpioInit.Speed = GPIO_SPEED_FAST;
+    gpioInit.Alternate = 0;
+
+    HAL_GPIO_Init(I2CBUS_SCL_GPIO_PORT, &gpioInit);
+
+    gpioInit.Pin = I2CBUS_SDA_PIN;
+
+    HAL_GPIO_Init(I2CBUS_SDA_GPIO_PORT, &gpioInit);
+
+    /* Clock SCL until the slave has shifted out the byte it was sending */
+    for (pulse = 0; pulse < I2CBUS_RECOVERY_PULSES; pulse++)
+    {
+        HAL_GPIO_WritePin(I2CBUS_SCL_GPIO_PORT, I2CBUS_SCL_PIN,
+            GPIO_PIN_RESET);
+        I2CBus_Delay();
+        HAL_GPIO_WritePin(I2CBUS_SCL_GPIO_PORT, I2CBUS_SCL_PIN, GPIO_PIN_SET);
+        I2CBus_Delay();
+
+        if (HAL_GPIO_ReadPin(I2CBUS_SDA_GPIO_PORT, I2CBUS_SDA_PIN)
+                == GPIO_PIN_SET)
+        {
+            break;
+        }
+    }
+
+    /* Issue a STOP condition (SDA rising while SCL is high) */
+    HAL_GPIO_WritePin(I2CBUS_SCL_GPIO_PORT, I2CBUS_SCL_PIN, GPIO_PIN_RESET);
+    I2CBus_Delay();
+    HAL_GPIO_WritePin(I2CBUS_SDA_GPIO_PORT, I2CBUS_SDA_PIN, GPIO_PIN_RESET);
+    I2CBus_Delay();
+    HAL_GPIO_WritePin(I2CBUS_SCL_GPIO_PORT, I2CBUS_SCL_PIN, GPIO_PIN_SET);
+    I2CBus_Delay();
+    HAL_GPIO_WritePin(I2CBUS_SDA_GPIO_PORT, I2CBUS_SDA_PIN, GPIO_PIN_SET);
+    I2CBus_Delay();
+
+    /* Reset the peripheral to clear its BUSY flag and initialize it again,
+     * which gives the pins back to the I2C peripheral */
+    SET_BIT(i2cHandle.Instance->CR1, I2C_CR1_SWRST);
+    CLEAR_BIT(i2cHandle.Instance->CR1, I2C_CR1_SWRST);
+
+    ASSERT(HAL_I2C_Init(&i2cHandle) == HAL_OK);
+}
+
+/**
+ * Wait for half of the I2C clock period.
+ */
+static void I2CBus_Delay(void)
+{
+    volatile uint32_t loops;
+
+    loops = SystemCoreClock / (2 * I2CBUS_CLK_HZ) / I2CBUS_DELAY_LOOP_CYCLES;
+
+    while (loops--)
+        ;
+}
+
+/**
+ * Initialize the I2C peripheral.
+ *
+ * @param   i2c     I2C to be initialized.
+ */
+void HAL_I2C_MspInit(I2C_HandleTypeDef *i2c)
+{
+    GPIO_InitTypeDef gpioInit;
+
+    /* Enable clocks */
+    I2CBUS_SDA_GPIO_CLK_ENABLE();
+    I2CBUS_SCL_GPIO_CLK_ENABLE();
+    I2CBUS_CLK_ENABLE();
+
+    /* I2C TX GPIO pin configuration  */
+    gpioInit.Pin = I2CBUS_SCL_PIN;
+    gpioInit.Mode = GPIO_MODE_AF_OD;
+    gpioInit.Pull = GPIO_PULLUP;
+    gpioInit.Speed = GPIO_SPEED_FAST;
+    gpioInit.Alternate = I2CBUS_SCL_AF;
+
+    HAL_GPIO_Init(I2CBUS_SCL_GPIO_PORT, &gpioInit);
+
+    /* I2C RX GPIO pin configuration  */
+    gpioInit.Pin = I2CBUS_SDA_PIN;
+    gpioInit.Alternate = I2CBUS_SDA_AF;
+
+    HAL_GPIO_Init(I2CBUS_SDA_GPIO_PORT, &gpioInit);
+
+    HAL_NVIC_SetPriority(I2CBUS_EV_IRQn, I2CBUS_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(I2CBUS_EV_IRQn);
+    HAL_NVIC_SetPriority(I2CBUS_ER_IRQn, I2CBUS_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(I2CBUS_ER_IRQn);
+
+    /* DMA used by the fast path */
+    I2CBUS_DMA_CLK_ENABLE();
+
+    HAL_NVIC_SetPriority(I2CBUS_DMA_RX_IRQn, I2CBUS_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(I2CBUS_DMA_RX_IRQn);
+}
+
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *i2c)
+{
+    profile[I2CBUS_PATH_HAL].transfers++;
+    I2CBus_Complete(I2CBUS_STATUS_DONE, I2CBUS_ERROR_NONE);
+}
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *i2c)
+{
+    profile[I2CBUS_PATH_HAL].transfers++;
+    I2CBus_Complete(I2CBUS_STATUS_DONE, I2CBUS_ERROR_NONE);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *i2c)
+{
+    uint32_t halError = HAL_I2C_GetError(i2c);
+    I2CBus_Error_t error = I2CBUS_ERROR_OTHER;
+
+    if (halError & I2CBUS_BUS_ERRORS)
+    {
+        I2CBus_RecoverBus();
+    }
+
+    if (halError & HAL_I2C_ERROR_AF)
+    {
+        /* The HAL only issues the STOP in the master mode, not in the
+         * memory mode, which would leave the bus busy */
+        if (i2c->Instance->SR2 & I2C_SR2_MSL)
+        {
+            SET_BIT(i2c->Instance->CR1, I2C_CR1_STOP);
+        }
+
+        error = I2CBUS_ERROR_NACK;
+    }
+    else if (halError & HAL_I2C_ERROR_TIMEOUT)
+    {
+        error = I2CBUS_ERROR_TIMEOUT;
+    }
+    else if (halError & (HAL_I2C_ERROR_BERR | HAL_I2C_ERROR_ARLO))
+    {
+        error = I2CBUS_ERROR_BUS;
+    }
+
+    profile[I2CBUS_PATH_HAL].transfers++;
+    I2CBus_Complete(I2CBUS_STATUS_ERROR, error);
+}
+
+void I2C1_EV_IRQHandler(void)
+{
+    uint32_t start = CYCLES_GET();
+    I2CBus_Path_t path = I2CBUS_PATH_HAL;
+
+    callbackCycles = 0;
+
+    if (fastState != I2CBUS_FAST_IDLE)
+    {
+        path = I2CBUS_PATH_FAST;
+        I2CBus_FastEvent();
+    }
+    else
+    {
+        HAL_I2C_EV_IRQHandler(&i2cHandle);
+    }
+
+    profile[path].cycles += CYCLES_GET() - start - callbackCycles;
+}
+
+void I2C1_ER_IRQHandler(void)
+{
+    uint32_t start = CYCLES_GET();
+    I2CBus_Path_t path = I2CBUS_PATH_HAL;
+
+    callbackCycles = 0;
+
+    if (fastState != I2CBUS_FAST_IDLE)
+    {
+        path = I2CBUS_PATH_FAST;
+        I2CBus_FastError();
+    }
+    else
+    {
+        HAL_I2C_ER_IRQHandler(&i2cHandle);
+    }
+
+    profile[path].cycles += CYCLES_GET() - start - callbackCycles;
+}
+
+void DMA1_Stream0_IRQHandler(void)
+{
+    uint32_t start = CYCLES_GET();
+    uint32_t flags = DMA1->LISR & I2CBUS_DMA_RX_FLAGS;
+
+    DMA1->LIFCR = flags;
+    callbackCycles = 0;
+
+    if (fastState == I2CBUS_FAST_DMA)
+    {
+        if (flags & DMA_LISR_TCIF0)
+        {
+            SET_BIT(I2CBUS_INSTANCE->CR1, I2C_CR1_STOP);
+            I2CBus_FastStop();
+            I2CBus_Complete(I2CBUS_STATUS_DONE, I2CBUS_ERROR_NONE);
+        }
+        else if (flags & DMA_LISR_TEIF0)
+        {
+            SET_BIT(I2CBUS_INSTANCE->CR1, I2C_CR1_STOP);
+            I2CBus_FastStop();
+            I2CBus_Complete(I2CBUS_STATUS_ERROR, I2CBUS_ERROR_OTHER);
+        }
+    }
+
+    profile[I2CBUS_PATH_FAST].cycles += CYCLES_GET() - start - callbackCycles;
+}
@@ -0,0 +1,169 @@
+/**
+ * @brief   Wake-up latency measurement, from a sensor event latched by the
+ *          RTC to the time its data is committed.
+ */
+
+#include "latency.h"
+#include "assert.h"
+#include "cycles.h"
+#include "stm32f4xx_hal.h"
+#include <string.h>
+
+static Latency_Histogram_t latencyHistogram;
+
+/** Timestamp of the last event, valid until it's committed. */
+static RTC_Timestamp_t eventTimestamp;
+static bool eventPending;
+
+/** Cycle counter, and the core clock it counts at, when the first handler
+ * of the last event ran. */
+static uint32_t markCycles;
+static uint32_t markClock;
+static bool markPending;
+
+/**
+ * Record a sensor event, timestamped by the RTC on its edge.
+ *
+ * @param   timestamp   Timestamp of the event.
+ *
+ * @note    This function shall be called within an ISR context.
+ */
+void Latency_EventFromISR(RTC_Timestamp_t timestamp)
+{
+    uint32_t primask;
+
+    /* The timestamp is written in two words, which a commit from a higher
+     * priority interrupt shall not see halfway */
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    eventTimestamp = timestamp;
+    eventPending = true;
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * Record that the first handler of a sensor event runs, on the cycle
+ * counter. It refines the latency below the RTC resolution (1 / 256s).
+ *
+ * @note    This function shall be called within an ISR context.
+ */
+void Latency_MarkFromISR(void)
+{
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    markCycles = CYCLES_GET();
+    markClock = SystemCoreClock;
+    markPending = true;
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * Record that the data of the last event has been committed, accounting its
+ * latency into the histogram.
+ *
+ * The latency is bounded from below twice: by the RTC, to within a tick, and
+ * by the cycle counter since the first handler, to within the wake-up time
+ * which the core doesn't count. The larger bound is accounted, in us.
+ *
+ * @note    This function shall be called within an ISR context.
+ */
+void Latency_CommitFromISR(void)
+{
+    RTC_Timestamp_t now;
+    RTC_Timestamp_t ticks;
+    uint32_t cycles;
+    uint32_t handled;
+    uint32_t latency;
+    uint32_t bin;
+    uint32_t primask;
+
+    now = RTC_GetTimestamp();
+    cycles = CYCLES_GET();
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (!eventPending)
+    {
+        latencyHistogram.missed++;
+        __set_PRIMASK(primask);
+        return;
+    }
+
+    eventPending = false;
+    ticks = (now > eventTimestamp) ? (now - eventTimestamp) : 0;
+    latency = (ticks > 1) ? (uint32_t) (((ticks - 1) * 1000000)
+        / RTC_GetTimestampFrequency()) : 0;
+
+    /* The cycles are not comparable if the clock has changed in between */
+    if (markPending && (markClock == SystemCoreClock))
+    {
+        handled = (cycles - markCycles) / (markClock / 1000000);
+
+        if (handled > latency)
+        {
+            latency = handled;
+        }
+    }
+
+    markPending = false;
+
+    bin = (latency > 0) ? (32 - __CLZ(latency)) : 0;
+
+    if (bin >= LATENCY_BINS)
+    {
+        bin = LATENCY_BINS - 1;
+    }
+
+    latencyHistogram.bins[bin]++;
+    latencyHistogram.events++;
+
+    if (latency > latencyHistogram.max)
+    {
+        latencyHistogram.max = latency;
+    }
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * Get a snapshot of the latency histogram.
+ *
+ * @param   histogram   Memory where the histogram shall be stored.
+ */
+void Latency_GetHistogram(Latency_Histogram_t *histogram)
+{
+    uint32_t primask;
+
+    ASSERT(histogram);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    *histogram = latencyHistogram;
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * Reset the latency histogram.
+ */
+void Latency_Reset(void)
+{
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    memset(&latencyHistogram, 0, sizeof(latencyHistogram));
+    eventPending = false;
+    markPending = false;
+
+    __set_PRIMASK(primask);
+}
@@ -4,47 +4,159 @@
 
 #include "lis2de12.h"
 #include "assert.h"
+#include "cycles.h"
+#include "i2cbus.h"
+#include "latency.h"
+#include "rtc.h"
 #include "stm32f4xx_hal.h"
 #include <stdbool.h>
+#include <string.h>
 
-#define LIS2DE12_I2C_CLK_HZ                     100000
+#define LIS2DE12_INT1_GPIO_CLK_ENABLE()         __HAL_RCC_GPIOB_CLK_ENABLE()
+#define LIS2DE12_INT1_PIN                       GPIO_PIN_4
+#define LIS2DE12_INT1_GPIO_PORT                 GPIOB
+#define LIS2DE12_INT1_IRQn                      EXTI4_IRQn
 
-#define LIS2DE12_I2C_CLK_ENABLE()               __HAL_RCC_I2C1_CLK_ENABLE()
-#define LIS2DE12_I2C_SDA_GPIO_CLK_ENABLE()      __HAL_RCC_GPIOB_CLK_ENABLE()
-#define LIS2DE12_I2C_SCL_GPIO_CLK_ENABLE()      __HAL_RCC_GPIOB_CLK_ENABLE()
+#define LIS2DE12_INT2_GPIO_CLK_ENABLE()         __HAL_RCC_GPIOB_CLK_ENABLE()
+#define LIS2DE12_INT2_PIN                       GPIO_PIN_5
+#define LIS2DE12_INT2_GPIO_PORT                 GPIOB
+#define LIS2DE12_INT2_IRQn                      EXTI9_5_IRQn
+#define LIS2DE12_INT_IRQ_PRIORITY               0x0E
 
-#define LIS2DE12_I2C_SCL_PIN                    GPIO_PIN_6
-#define LIS2DE12_I2C_SCL_GPIO_PORT              GPIOB
-#define LIS2DE12_I2C_SCL_AF                     GPIO_AF4_I2C1
+#define LIS2D12_DEV_REG_INC(reg, autoInc)       ((reg & 0x7F) | (autoInc << 7))
 
-#define LIS2DE12_I2C_SDA_PIN                    GPIO_PIN_9
-#define LIS2DE12_I2C_SDA_GPIO_PORT              GPIOB
-#define LIS2DE12_I2C_SDA_AF                     GPIO_AF4_I2C1
+/* Data rate used by the one-shot reads: the fastest one, so the device
+ * settles as soon as possible */
+#define LIS2DE12_ONESHOT_ODR                    LI2DE12_ODR_400HZ
 
-#define LIS2D12_SHIFTED_ADDR(addr)              (addr << 1)
-#define LIS2D12_DEV_REG_INC(reg, autoInc)       ((reg & 0x7F) | (autoInc << 7))
-#define LIS2D12_TIMEOUT_MS                      1000
+/* Turn-on time (1ms + 1/ODR) before checking for the first conversion, and
+ * the maximum time to wait for it */
+#define LIS2DE12_ONESHOT_SETTLE_MS              4
+#define LIS2DE12_ONESHOT_TIMEOUT_MS             20
+
+/* The interrupt-driven one-shot reads from STATUS_REG_AUX up to OUT_TEMP_H,
+ * across the reserved registers, so the conversion status and the
+ * temperature come in a single DMA burst */
+#define LIS2DE12_ONESHOT_BURST_SIZE                                     \
+    (LI2DE12_OUT_TEMP_H - LI2DE12_STATUS_REG_AUX + 1)
+#define LIS2DE12_ONESHOT_BURST_TEMP_L                                   \
+    (LI2DE12_OUT_TEMP_L - LI2DE12_STATUS_REG_AUX)
+#define LIS2DE12_ONESHOT_BURST_TEMP_H                                   \
+    (LI2DE12_OUT_TEMP_H - LI2DE12_STATUS_REG_AUX)
+
+/* INT2 is shared by the activity (IA1) and orientation (IA2) interrupts, so
+ * both sources are read in a single burst, from INT1_SRC up to INT2_SRC.
+ * While the pin stays high after the read, because the activity goes on,
+ * it's checked again after a while, as a latched orientation change would
+ * not raise a new edge */
+#define LIS2DE12_INT2_BURST_SIZE                                        \
+    (LI2DE12_INT2_SRC - LI2DE12_INT1_SRC + 1)
+#define LIS2DE12_INT2_BURST_INT1_SRC            0
+#define LIS2DE12_INT2_BURST_INT2_SRC                                    \
+    (LI2DE12_INT2_SRC - LI2DE12_INT1_SRC)
+#define LIS2DE12_INT2_RECHECK_MS                100
+
+/* Self-test data rate, settling time after changing the self-test mode and
+ * the maximum time to fill the FIFO */
+#define LIS2DE12_SELFTEST_ODR                   LI2DE12_ODR_100HZ
+#define LIS2DE12_SELFTEST_SETTLE_MS             90
+#define LIS2DE12_SELFTEST_FIFO_TIMEOUT_MS       400
+#define LIS2DE12_SELFTEST_FIFO_POLL_MS          10
+
+/* Self-test output change limits (8-bit, +-2g), from the datasheet */
+#define LIS2DE12_SELFTEST_MIN_LSB               17
+#define LIS2DE12_SELFTEST_MAX_LSB               360
+
+/* Flash OTP blocks where the temperature calibration may be stored */
+#define LIS2DE12_CALIB_OTP_BLOCK_SIZE           32
+#define LIS2DE12_CALIB_OTP_BLOCKS               16
+
+/* Default calibration: a zero reading is 25°C and 1 digit is 1°C */
+#define LIS2DE12_TEMP_DEFAULT_OFFSET            (25 << 8)
+
+/* Fractional bits of the temperature gain */
+#define LIS2DE12_TEMP_GAIN_SHIFT                14
+
+static uint8_t LIS2DE12_BusRead(uint8_t deviceAddress, uint8_t regAddress,
+        uint8_t *data, uint16_t size);
+static uint8_t LIS2DE12_BusWrite(uint8_t deviceAddress, uint8_t regAddress,
+        const uint8_t *data, uint16_t size);
+static uint8_t LIS2DE12_UpdateReg(uint8_t regAddress, uint8_t mask,
+        uint8_t value);
+static void LIS2DE12_InitIntPin(GPIO_TypeDef *port, uint16_t pin,
+        IRQn_Type irq);
+static void LIS2DE12_RecordStats(const I2CBus_Transfer_t *xfer);
+static void LIS2DE12_LoadTempCalib(void);
+static void LIS2DE12_Sleep(uint32_t msec);
+static uint8_t LIS2DE12_SelfTestAverage(uint8_t count,
+        int16_t average[LIS2DE12_AXES]);
+static void LIS2DE12_StreamReadFromISR(void);
+static void LIS2DE12_StreamCallbackFromISR(I2CBus_Transfer_t *xfer);
+static void LIS2DE12_InitInt2(void);
+static void LIS2DE12_Int2ReadFromISR(void);
+static void LIS2DE12_Int2CallbackFromISR(I2CBus_Transfer_t *xfer);
+static void LIS2DE12_OneShotSubmitFromISR(uint8_t odr);
+static void LIS2DE12_OneShotCallbackFromISR(I2CBus_Transfer_t *xfer);
+static void LIS2DE12_OneShotTimerFromISR(void);
+static void LIS2DE12_OneShotFinishFromISR(bool success);
+static uint32_t LIS2DE12_OneShotElapsed(void);
+
+/** Interrupt-driven one-shot read states. */
+typedef enum
+{
+    LIS2DE12_ONESHOT_IDLE,
+    LIS2DE12_ONESHOT_POWER_UP,      /**< Writing the one-shot data rate. */
+    LIS2DE12_ONESHOT_SETTLE,        /**< Waiting for the first conversion. */
+    LIS2DE12_ONESHOT_READ,          /**< Reading status and temperature. */
+    LIS2DE12_ONESHOT_POWER_DOWN     /**< Writing the power-down data rate. */
+
+} LIS2DE12_OneShotState_t;
+
+/** FIFO stream state. */
+static I2CBus_Transfer_t streamXfer;
+static LIS2DE12_Sample_t *streamBuffer;
+static uint16_t streamSize;
+static uint16_t streamHead;
+static volatile LIS2DE12_StreamCallback_t streamCallbackFromISR;
 
-static I2C_HandleTypeDef i2cHandle;
+/** Callback of the activity interrupt. */
+static volatile LIS2DE12_Callback_t activityCallbackFromISR;
+
+/** INT2 sources read, shared by the activity and orientation interrupts. */
+static I2CBus_Transfer_t int2Xfer;
+static uint8_t int2Sources[LIS2DE12_INT2_BURST_SIZE];
+static RTC_Timer_t int2Timer;
+
+/** Orientation detection state. */
+static CircularBuffer_t *orientEvents;
+static volatile bool orientEnabled;
+static LIS2DE12_Callback_t orientCallbackFromISR;
+
+/** Transfer statistics, and the sum of the latencies of the successful
+ * transfers, used to compute their average. */
+static LIS2DE12_Stats_t stats = { .minLatency = UINT32_MAX };
+static uint64_t statsTotalLatency;
+
+/** Temperature calibration in use. */
+static LIS2DE12_TempCalib_t tempCalib;
+
+/** Interrupt-driven one-shot read state. */
+static volatile LIS2DE12_OneShotState_t oneShotState;
+static I2CBus_Transfer_t oneShotXfer;
+static uint8_t oneShotData[LIS2DE12_ONESHOT_BURST_SIZE];
+static RTC_Timer_t oneShotTimer;
+static RTC_Timestamp_t oneShotSettleStart;
+static bool oneShotSuccess;
+static int16_t oneShotTemp;
+static LIS2DE12_TempCallback_t oneShotCallbackFromISR;
 
 /**
  * Initialize LIS2DE12 device using I2C interface.
  */
 void LIS2DE12_Init()
 {
-    i2cHandle.Instance = I2C1;
-
-    i2cHandle.Init.ClockSpeed = LIS2DE12_I2C_CLK_HZ;
-    i2cHandle.Init.DutyCycle = I2C_DUTYCYCLE_16_9;
-    i2cHandle.Init.OwnAddress1 = 0;
-    i2cHandle.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
-    i2cHandle.Init.DualAddressMode = I2C_DUALADDRESS_DISABLE;
-    i2cHandle.Init.OwnAddress2 = 0;
-    i2cHandle.Init.GeneralCallMode = I2C_GENERALCALL_DISABLE;
-    i2cHandle.Init.NoStretchMode = I2C_NOSTRETCH_DISABLE;
-    i2cHandle.State = HAL_I2C_STATE_RESET;
-
-    ASSERT(HAL_I2C_Init(&i2cHandle) == HAL_OK);
+    I2CBus_Init();
+    LIS2DE12_LoadTempCalib();
 }
 
 /**
@@ -60,15 +172,7 @@ void LIS2DE12_Init()
 uint8_t LIS2DE12_ReadReg(uint8_t deviceAddress, uint8_t regAddress,
         uint8_t *data)
 {
-    HAL_StatusTypeDef status;
-    uint8_t devReg;
-
-    devReg = LIS2D12_DEV_REG_INC(regAddress, false);
-
-    status = HAL_I2C_Mem_Read(&i2cHandle, LIS2D12_SHIFTED_ADDR(deviceAddress),
-        devReg, I2C_MEMADD_SIZE_8BIT, data, 1, LIS2D12_TIMEOUT_MS);
-
-    return (status == HAL_OK);
+    return LIS2DE12_BusRead(deviceAddress, regAddress, data, 1);
 }
 
 /**
@@ -84,15 +188,7 @@ uint8_t LIS2DE12_ReadReg(uint8_t deviceAddress, uint8_t regAddress,
 uint8_t LIS2DE12_WriteReg(uint8_t deviceAddress, uint8_t regAddress,
         uint8_t data)
 {
-    HAL_StatusTypeDef status;
-    uint8_t devReg;
-
-    devReg = LIS2D12_DEV_REG_INC(regAddress, false);
-
-    status = HAL_I2C_Mem_Write(&i2cHandle, LIS2D12_SHIFTED_ADDR(deviceAddress),
-        devReg, I2C_MEMADD_SIZE_8BIT, &data, 1, LIS2D12_TIMEOUT_MS);
-
-    return (status == HAL_OK);
+    return LIS2DE12_BusWrite(deviceAddress, regAddress, &data, 1);
 }
 
 /**
@@ -105,66 +201,1273 @@ uint8_t LIS2DE12_EnableTemp()
 {
     /* XXX: As the given interface does not specify the device address when
      * enabling the temperature feature, the default device address will be
-     * used */
+     * used.
+     *
+     * The temperature output is only updated with the block data update
+     * enabled */
     return LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_TEMP_CFG_REG,
-        LI2DE12_TEMP_ENABLED);
+            LI2DE12_TEMP_ENABLED)
+        && LIS2DE12_UpdateReg(LI2DE12_CTRL_REG4, LI2DE12_BDU, LI2DE12_BDU);
 }
 
 /**
- * Read temperature.
+ * Read the raw temperature. The value is left-justified, so its high byte is
+ * the temperature variation in °C (1 digit/°C) from an unknown,
+ * device-specific, reference.
  *
  * @param   val     Memory where the temperature read shall be stored.
  *
  * @returns It returns 1 if the temperature has been read with success.
  *          Otherwise, it returns 0.
  */
-uint8_t LIS2DE12_ReadTemp(int *val)
+uint8_t LIS2DE12_ReadTemp(int16_t *val)
 {
-    HAL_StatusTypeDef status;
-    uint8_t devReg;
+    uint8_t data[2];
 
-    devReg = LIS2D12_DEV_REG_INC(LI2DE12_OUT_TEMP_L, true);
+    ASSERT(val);
 
     /* XXX: As the given interface does not specify the device address when
      * enabling the temperature feature, the default device address will be
-     * used.
-     *
-     * As the datasheet doesn't say the conversion factor, it's assumed that
-     * the conversion is value/°C (25 -> 25°C) */
-    status = HAL_I2C_Mem_Read(&i2cHandle,
-        LIS2D12_SHIFTED_ADDR(LI2DE12_I2C_DEFAULT_ADDR), devReg,
-        I2C_MEMADD_SIZE_8BIT, (uint8_t *) val, 2, LIS2D12_TIMEOUT_MS);
+     * used */
+    if (!LIS2DE12_BusRead(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_OUT_TEMP_L, data,
+            sizeof(data)))
+    {
+        return false;
+    }
+
+    *val = (int16_t) ((data[1] << 8) | data[0]);
+
+    return true;
+}
+
+/**
+ * Read the calibrated temperature.
+ *
+ * @param   temp    Memory where the temperature (Q8.8 °C) shall be stored.
+ *
+ * @returns It returns 1 if the temperature has been read with success.
+ *          Otherwise, it returns 0.
+ */
+uint8_t LIS2DE12_ReadTempQ8(int16_t *temp)
+{
+    int16_t raw;
+
+    ASSERT(temp);
+
+    if (!LIS2DE12_ReadTemp(&raw))
+    {
+        return false;
+    }
+
+    *temp = LIS2DE12_ConvertTemp(raw, &tempCalib);
+
+    return true;
+}
+
+/**
+ * Convert a raw temperature into °C using integer math only. As the raw value
+ * is left-justified with 1 digit/°C in its high byte, it's already the
+ * temperature variation in Q8.8, which only needs the gain and offset to be
+ * applied.
+ *
+ * @param   raw     Raw temperature read from the device.
+ * @param   calib   Calibration to be applied.
+ *
+ * @returns It returns the temperature in Q8.8 °C.
+ */
+int16_t LIS2DE12_ConvertTemp(int16_t raw, const LIS2DE12_TempCalib_t *calib)
+{
+    int32_t delta;
+
+    ASSERT(calib);
+
+    delta = ((int32_t) raw * calib->gain
+        + (1 << (LIS2DE12_TEMP_GAIN_SHIFT - 1))) >> LIS2DE12_TEMP_GAIN_SHIFT;
+
+    return (int16_t) (calib->offset + delta);
+}
+
+/**
+ * Read a burst of acceleration samples from the FIFO.
+ *
+ * @param   samples     Memory where the samples shall be stored.
+ * @param   count       Number of samples to be read.
+ *
+ * @returns It returns 1 if the samples have been read with success.
+ *          Otherwise, it returns 0.
+ */
+uint8_t LIS2DE12_ReadFifo(LIS2DE12_Sample_t *samples, uint8_t count)
+{
+    ASSERT(samples);
+    ASSERT((count > 0) && (count <= LIS2DE12_FIFO_SIZE));
+
+    /* The register address wraps around to the FIFO read start after the Z
+     * axis, so the whole burst is a single transfer */
+    return LIS2DE12_BusRead(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_READ_START,
+        (uint8_t *) samples, count * sizeof(LIS2DE12_Sample_t));
+}
+
+/**
+ * Start streaming acceleration samples into a circular buffer. The sensor
+ * samples by itself at the given data rate and stores the samples in its
+ * FIFO. Each FIFO watermark interrupt starts a burst transfer which goes
+ * straight into the buffer through DMA, without any thread involvement. The
+ * callback is only called when half of the buffer has been filled.
+ *
+ * @param   odr                 Output data rate (LI2DE12_ODR_*).
+ * @param   buffer              Circular buffer to store the samples.
+ * @param   size                Number of samples the buffer can hold. It
+ *                              shall be a multiple of twice the
+ *                              LIS2DE12_STREAM_WATERMARK.
+ * @param   callbackFromISR     Callback which shall be called whenever a
+ *                              half of the buffer has been filled. Note
+ *                              that this callback will be called within an
+ *                              Interrupt Service Routine (ISR).
+ *
+ * @returns It returns 1 if the stream has been started with success.
+ *          Otherwise, it returns 0.
+ */
+uint8_t LIS2DE12_StartStream(uint8_t odr, LIS2DE12_Sample_t *buffer,
+        uint16_t size, LIS2DE12_StreamCallback_t callbackFromISR)
+{
+    ASSERT(buffer);
+    ASSERT(callbackFromISR);
+    ASSERT((size > 0) && ((size % (2 * LIS2DE12_STREAM_WATERMARK)) == 0));
+
+    streamBuffer = buffer;
+    streamSize = size;
+    streamHead = 0;
+    streamCallbackFromISR = callbackFromISR;
+
+    streamXfer.deviceAddress = LI2DE12_I2C_DEFAULT_ADDR;
+    streamXfer.regAddress = LIS2D12_DEV_REG_INC(LI2DE12_FIFO_READ_START, true);
+    streamXfer.data = (uint8_t *) streamBuffer;
+    streamXfer.size = LIS2DE12_STREAM_WATERMARK * sizeof(LIS2DE12_Sample_t);
+    streamXfer.direction = I2CBUS_DIR_READ;
+    streamXfer.priority = I2CBUS_PRIORITY_HIGHEST;
+    streamXfer.flags = I2CBUS_FLAG_FAST;
+    streamXfer.callbackFromISR = LIS2DE12_StreamCallbackFromISR;
+
+    /* INT1 pin raises an interrupt whenever the FIFO watermark is reached */
+    LIS2DE12_INT1_GPIO_CLK_ENABLE();
+    LIS2DE12_InitIntPin(LIS2DE12_INT1_GPIO_PORT, LIS2DE12_INT1_PIN,
+        LIS2DE12_INT1_IRQn);
+
+    /* Going through bypass mode empties the FIFO */
+    return LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_CTRL_REG,
+            LI2DE12_FIFO_MODE_BYPASS)
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_CTRL_REG,
+            LI2DE12_FIFO_MODE_STREAM | LIS2DE12_STREAM_WATERMARK)
+        && LIS2DE12_UpdateReg(LI2DE12_CTRL_REG5, LI2DE12_FIFO_EN,
+            LI2DE12_FIFO_EN)
+        && LIS2DE12_UpdateReg(LI2DE12_CTRL_REG3, LI2DE12_I1_WTM,
+            LI2DE12_I1_WTM)
+        && LIS2DE12_SetOdr(odr);
+}
+
+/**
+ * Stop streaming acceleration samples. The sensor keeps sampling at the
+ * current data rate, but the FIFO and its interrupt are disabled.
+ *
+ * @returns It returns 1 if the stream has been stopped with success.
+ *          Otherwise, it returns 0.
+ */
+uint8_t LIS2DE12_StopStream(void)
+{
+    HAL_NVIC_DisableIRQ(LIS2DE12_INT1_IRQn);
+    streamCallbackFromISR = NULL;
+
+    return LIS2DE12_UpdateReg(LI2DE12_CTRL_REG3, LI2DE12_I1_WTM, 0)
+        && LIS2DE12_UpdateReg(LI2DE12_CTRL_REG5, LI2DE12_FIFO_EN, 0)
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_CTRL_REG,
+            LI2DE12_FIFO_MODE_BYPASS);
+}
+
+/**
+ * Load the temperature calibration from the last valid flash OTP block. If
+ * the device has not been calibrated, the default calibration is used.
+ */
+static void LIS2DE12_LoadTempCalib(void)
+{
+    const LIS2DE12_TempCalib_t *calib;
+    uint8_t block;
+
+    tempCalib.magic = LIS2DE12_TEMP_CALIB_MAGIC;
+    tempCalib.offset = LIS2DE12_TEMP_DEFAULT_OFFSET;
+    tempCalib.gain = LIS2DE12_TEMP_GAIN_UNITY;
+
+    for (block = 0; block < LIS2DE12_CALIB_OTP_BLOCKS; block++)
+    {
+        calib = (const LIS2DE12_TempCalib_t *) (FLASH_OTP_BASE
+            + (block * LIS2DE12_CALIB_OTP_BLOCK_SIZE));
+
+        if (calib->magic == LIS2DE12_TEMP_CALIB_MAGIC)
+        {
+            tempCalib = *calib;
+        }
+    }
+}
+
+/**
+ * Set the output data rate, enabling all axes in low power (8-bit) mode.
+ *
+ * @param   odr     Output data rate (LI2DE12_ODR_*).
+ *
+ * @returns It returns 1 if the data rate has been set with success.
+ *          Otherwise, it returns 0.
+ */
+uint8_t LIS2DE12_SetOdr(uint8_t odr)
+{
+    return LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG1,
+        (odr & LI2DE12_ODR_MASK) | LI2DE12_LP_EN | LI2DE12_XYZ_EN);
+}
+
+/**
+ * Read the calibrated temperature in a single conversion, keeping the device
+ * powered down between reads. It powers the device up, waits for the first
+ * conversion while sleeping, reads it and powers the device down again. It's
+ * meant to be called from each periodic alarm.
+ *
+ * @param   temp        Memory where the temperature (Q8.8 °C) shall be
+ *                      stored.
+ * @param   timing      Memory where the duration of each phase shall be
+ *                      stored. It may be NULL.
+ *
+ * @returns It returns 1 if the temperature has been read with success.
+ *          Otherwise, it returns 0.
+ */
+uint8_t LIS2DE12_ReadTempOneShot(int16_t *temp,
+        LIS2DE12_OneShotTiming_t *timing)
+{
+    LIS2DE12_OneShotTiming_t phases = { 0 };
+    uint32_t start;
+    uint32_t settleStart;
+    uint8_t status = 0;
+    uint8_t result;
+
+    ASSERT(temp);
+
+    /* Power up */
+    start = CYCLES_GET();
+    result = LIS2DE12_SetOdr(LIS2DE12_ONESHOT_ODR);
+    phases.powerUp = CYCLES_GET() - start;
+
+    /* Settle, until the first temperature conversion is available */
+    start = CYCLES_GET();
+
+    if (result)
+    {
+        settleStart = HAL_GetTick();
+        LIS2DE12_Sleep(LIS2DE12_ONESHOT_SETTLE_MS);
+
+        /* The timeout is counted in elapsed time, not in polls, as each
+         * poll takes a transfer on top of its sleep */
+        while ((result = LIS2DE12_ReadReg(LI2DE12_I2C_DEFAULT_ADDR,
+                    LI2DE12_STATUS_REG_AUX, &status))
+                && !(status & LI2DE12_TDA)
+                && ((HAL_GetTick() - settleStart)
+                    < LIS2DE12_ONESHOT_TIMEOUT_MS))
+        {
+            LIS2DE12_Sleep(1);
+        }
+
+        result = result && (status & LI2DE12_TDA);
+    }
+
+    phases.settle = CYCLES_GET() - start;
+
+    /* Read */
+    start = CYCLES_GET();
+    result = result && LIS2DE12_ReadTempQ8(temp);
+    phases.read = CYCLES_GET() - start;
+
+    /* Power down, even if anything above has failed */
+    start = CYCLES_GET();
+    result = LIS2DE12_SetOdr(LI2DE12_ODR_POWER_DOWN) && result;
+    phases.powerDown = CYCLES_GET() - start;
+
+    if (timing)
+    {
+        *timing = phases;
+    }
+
+    return result;
+}
+
+/**
+ * Start a one-shot temperature read driven by interrupts only, which is the
+ * same sequence as LIS2DE12_ReadTempOneShot: the power-up write, the settle
+ * time on an RTC timer, the status and temperature burst through DMA and
+ * the power-down write. The core doesn't have to run anything in between.
+ *
+ * @param   callbackFromISR     Callback which shall be called once the
+ *                              device has been powered down again, with the
+ *                              calibrated temperature (Q8.8 °C). Note that
+ *                              this callback will be called within an
+ *                              Interrupt Service Routine (ISR).
+ *
+ * @returns It returns 1 if the read has been started. Otherwise, it returns
+ *          0 (a read is still in progress).
+ */
+uint8_t LIS2DE12_StartTempOneShot(LIS2DE12_TempCallback_t callbackFromISR)
+{
+    uint32_t primask;
+
+    ASSERT(callbackFromISR);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (oneShotState != LIS2DE12_ONESHOT_IDLE)
+    {
+        __set_PRIMASK(primask);
+        return false;
+    }
+
+    oneShotState = LIS2DE12_ONESHOT_POWER_UP;
+
+    __set_PRIMASK(primask);
+
+    oneShotCallbackFromISR = callbackFromISR;
+    oneShotSuccess = false;
+
+    oneShotXfer.deviceAddress = LI2DE12_I2C_DEFAULT_ADDR;
+    oneShotXfer.priority = I2CBUS_PRIORITY_HIGHEST;
+    oneShotXfer.callbackFromISR = LIS2DE12_OneShotCallbackFromISR;
+
+    LIS2DE12_OneShotSubmitFromISR(LIS2DE12_ONESHOT_ODR);
+
+    return true;
+}
+
+/**
+ * Enable the activity interrupt. The interrupt generator 1 detects any axis
+ * above the threshold and it's routed to the INT2 pin. It works on the
+ * high-pass filtered acceleration, so gravity doesn't keep it triggered.
+ * It's not latched, so the pin goes low once the activity is over and the
+ * next one raises a new edge.
+ *
+ * @param   threshold           Threshold (16mg/digit at +-2g).
+ * @param   duration            Minimum duration of the event (1/ODR digit).
+ * @param   callbackFromISR     Callback which shall be called whenever an
+ *                              activity is detected. Note that this callback
+ *                              will be called within an Interrupt Service
+ *                              Routine (ISR).
+ *
+ * @returns It returns 1 if the interrupt has been enabled with success.
+ *          Otherwise, it returns 0.
+ */
+uint8_t LIS2DE12_EnableActivityInt(uint8_t threshold, uint8_t duration,
+        LIS2DE12_Callback_t callbackFromISR)
+{
+    ASSERT(callbackFromISR);
+
+    activityCallbackFromISR = callbackFromISR;
+
+    LIS2DE12_InitInt2();
+
+    /* The filter is reset once on the interrupt path, so it starts from the
+     * current acceleration */
+    return LIS2DE12_UpdateReg(LI2DE12_CTRL_REG2, LI2DE12_HP_IA1,
+            LI2DE12_HP_IA1)
+        && LIS2DE12_ResetHpFilter()
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_INT1_THS,
+            threshold & 0x7F)
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_INT1_DURATION,
+            duration & 0x7F)
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_INT1_CFG,
+            LI2DE12_INT_XHIE | LI2DE12_INT_YHIE | LI2DE12_INT_ZHIE)
+        && LIS2DE12_UpdateReg(LI2DE12_CTRL_REG6, LI2DE12_I2_IA1,
+            LI2DE12_I2_IA1);
+}
+
+/**
+ * Disable the activity interrupt.
+ *
+ * @returns It returns 1 if the interrupt has been disabled with success.
+ *          Otherwise, it returns 0.
+ */
+uint8_t LIS2DE12_DisableActivityInt(void)
+{
+    activityCallbackFromISR = NULL;
+
+    return LIS2DE12_UpdateReg(LI2DE12_CTRL_REG6, LI2DE12_I2_IA1, 0)
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_INT1_CFG, 0)
+        && LIS2DE12_UpdateReg(LI2DE12_CTRL_REG2, LI2DE12_HP_IA1, 0);
+}
 
-    return (status == HAL_OK);
+/**
+ * Enable the orientation detection. The interrupt generator 2 is configured
+ * for 6D (or 4D) movement recognition and routed to the INT2 pin, so the core
+ * only wakes up when the device is re-oriented. The position recognition
+ * would raise the latched interrupt again on every sample while the device
+ * keeps still. Each change is decoded and
+ * written into the events buffer as a LIS2DE12_OrientEvent_t.
+ *
+ * @note    The events buffer is written within an ISR context, so the
+ *          interrupts shall be disabled while it's read.
+ *
+ * @param   mode4D              'true' to ignore the Z axis (4D detection).
+ * @param   threshold           Threshold (16mg/digit at +-2g).
+ * @param   duration            Minimum duration of the position (1/ODR
+ *                              digit).
+ * @param   events              Buffer where the events shall be written.
+ * @param   callbackFromISR     Optional callback which shall be called
+ *                              whenever an event has been written. Note that
+ *                              this callback will be called within an
+ *                              Interrupt Service Routine (ISR).
+ *
+ * @returns It returns 1 if the detection has been enabled with success.
+ *          Otherwise, it returns 0.
+ */
+uint8_t LIS2DE12_EnableOrientation(bool mode4D, uint8_t threshold,
+        uint8_t duration, CircularBuffer_t *events,
+        LIS2DE12_Callback_t callbackFromISR)
+{
+    uint8_t cfg;
+
+    ASSERT(events);
+
+    orientEvents = events;
+    orientCallbackFromISR = callbackFromISR;
+
+    cfg = LI2DE12_INT_6D | LI2DE12_INT_XLIE
+        | LI2DE12_INT_XHIE | LI2DE12_INT_YLIE | LI2DE12_INT_YHIE;
+
+    if (!mode4D)
+    {
+        cfg |= LI2DE12_INT_ZLIE | LI2DE12_INT_ZHIE;
+    }
+
+    LIS2DE12_InitInt2();
+
+    orientEnabled = LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR,
+            LI2DE12_INT2_THS, threshold & 0x7F)
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_INT2_DURATION,
+            duration & 0x7F)
+        && LIS2DE12_UpdateReg(LI2DE12_CTRL_REG5,
+            LI2DE12_LIR_INT2 | LI2DE12_D4D_INT2,
+            LI2DE12_LIR_INT2 | (mode4D ? LI2DE12_D4D_INT2 : 0))
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_INT2_CFG, cfg)
+        && LIS2DE12_UpdateReg(LI2DE12_CTRL_REG6, LI2DE12_I2_IA2,
+            LI2DE12_I2_IA2)
+        && LIS2DE12_ReadReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_INT2_SRC,
+            &int2Sources[LIS2DE12_INT2_BURST_INT2_SRC]);
+
+    return orientEnabled;
 }
 
 /**
- * Initialize the I2C peripheral.
+ * Disable the orientation detection.
  *
- * @param   i2c     I2C to be initialized.
+ * @returns It returns 1 if the detection has been disabled with success.
+ *          Otherwise, it returns 0.
  */
-void HAL_I2C_MspInit(I2C_HandleTypeDef *i2c)
+uint8_t LIS2DE12_DisableOrientation(void)
+{
+    orientEnabled = false;
+
+    return LIS2DE12_UpdateReg(LI2DE12_CTRL_REG6, LI2DE12_I2_IA2, 0)
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_INT2_CFG, 0)
+        && LIS2DE12_UpdateReg(LI2DE12_CTRL_REG5,
+            LI2DE12_LIR_INT2 | LI2DE12_D4D_INT2, 0);
+}
+
+/**
+ * Decode the orientation from the interrupt generator source register. In 6D
+ * recognition, the high (low) bit of an axis is set when that axis points up
+ * (down).
+ *
+ * @param   source      INT1_SRC or INT2_SRC register.
+ *
+ * @returns It returns the device orientation.
+ */
+LIS2DE12_Orientation_t LIS2DE12_DecodeOrientation(uint8_t source)
+{
+    LIS2DE12_Orientation_t orientation = LIS2DE12_ORIENT_UNKNOWN;
+
+    if (source & LI2DE12_SRC_IA)
+    {
+        if (source & LI2DE12_SRC_ZH)
+        {
+            orientation = LIS2DE12_ORIENT_Z_UP;
+        }
+        else if (source & LI2DE12_SRC_ZL)
+        {
+            orientation = LIS2DE12_ORIENT_Z_DOWN;
+        }
+        else if (source & LI2DE12_SRC_YH)
+        {
+            orientation = LIS2DE12_ORIENT_Y_UP;
+        }
+        else if (source & LI2DE12_SRC_YL)
+        {
+            orientation = LIS2DE12_ORIENT_Y_DOWN;
+        }
+        else if (source & LI2DE12_SRC_XH)
+        {
+            orientation = LIS2DE12_ORIENT_X_UP;
+        }
+        else if (source & LI2DE12_SRC_XL)
+        {
+            orientation = LIS2DE12_ORIENT_X_DOWN;
+        }
+    }
+
+    return orientation;
+}
+
+/**
+ * Configure the high-pass filter, so the event thresholds are not affected
+ * by gravity or slow tilt. The filter is reset once configured.
+ *
+ * @param   mode        Filter mode (LI2DE12_HPM_*).
+ * @param   cutoff      Filter cutoff (LI2DE12_HPCF()).
+ * @param   paths       Paths which the filter applies to (LI2DE12_HP_*):
+ *                      data output, click and interrupt generators.
+ *
+ * @returns It returns 1 if the filter has been configured with success.
+ *          Otherwise, it returns 0.
+ */
+uint8_t LIS2DE12_ConfigHpFilter(uint8_t mode, uint8_t cutoff, uint8_t paths)
+{
+    uint8_t cfg;
+
+    cfg = (mode & LI2DE12_HPM_MASK) | (cutoff & LI2DE12_HPCF_MASK)
+        | (paths & LI2DE12_HP_PATHS_MASK);
+
+    return LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG2, cfg)
+        && LIS2DE12_ResetHpFilter();
+}
+
+/**
+ * Reset the high-pass filter, making the current acceleration its new
+ * reference. The reset is done by a single read of the REFERENCE register,
+ * so no sample is filtered against a partially updated reference.
+ *
+ * @returns It returns 1 if the filter has been reset with success.
+ *          Otherwise, it returns 0.
+ */
+uint8_t LIS2DE12_ResetHpFilter(void)
+{
+    uint8_t reference;
+
+    return LIS2DE12_ReadReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_REFERENCE,
+        &reference);
+}
+
+/**
+ * Run the built-in self-test. The device outputs are averaged with the
+ * self-test off and on, using FIFO bursts, and the change of each axis is
+ * checked against the datasheet limits. The device configuration is restored
+ * at the end. With 16 samples it takes about 500ms.
+ *
+ * @param   samples     Number of samples to be averaged (up to the FIFO
+ *                      size).
+ * @param   result      Memory where the result shall be stored.
+ *
+ * @returns It returns 1 if the self-test has been run, regardless of its
+ *          result. Otherwise, it returns 0 (communication failure).
+ */
+uint8_t LIS2DE12_SelfTest(uint8_t samples, LIS2DE12_SelfTestResult_t *result)
+{
+    uint8_t ctrlReg1;
+    uint8_t ctrlReg4;
+    uint8_t ctrlReg5;
+    uint8_t fifoCtrl;
+    uint8_t axis;
+    uint8_t ok;
+
+    ASSERT(result);
+    ASSERT((samples > 0) && (samples <= LIS2DE12_FIFO_SIZE));
+
+    /* Save the configuration which will be changed */
+    if (!LIS2DE12_ReadReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG1,
+            &ctrlReg1)
+        || !LIS2DE12_ReadReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG4,
+            &ctrlReg4)
+        || !LIS2DE12_ReadReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG5,
+            &ctrlReg5)
+        || !LIS2DE12_ReadReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_CTRL_REG,
+            &fifoCtrl))
+    {
+        return false;
+    }
+
+    /* Self-test off, +-2g */
+    ok = LIS2DE12_SetOdr(LIS2DE12_SELFTEST_ODR)
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG4,
+            LI2DE12_BDU | LI2DE12_ST_OFF)
+        && LIS2DE12_UpdateReg(LI2DE12_CTRL_REG5, LI2DE12_FIFO_EN,
+            LI2DE12_FIFO_EN);
+
+    if (ok)
+    {
+        LIS2DE12_Sleep(LIS2DE12_SELFTEST_SETTLE_MS);
+        ok = LIS2DE12_SelfTestAverage(samples, result->averageOff);
+    }
+
+    /* Self-test on */
+    ok = ok && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG4,
+        LI2DE12_BDU | LI2DE12_ST_0);
+
+    if (ok)
+    {
+        LIS2DE12_Sleep(LIS2DE12_SELFTEST_SETTLE_MS);
+        ok = LIS2DE12_SelfTestAverage(samples, result->averageOn);
+    }
+
+    /* Restore the configuration, even if anything above has failed */
+    ok = LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG4,
+            ctrlReg4)
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_CTRL_REG,
+            LI2DE12_FIFO_MODE_BYPASS)
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_CTRL_REG,
+            fifoCtrl)
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG5,
+            ctrlReg5)
+        && LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG1,
+            ctrlReg1)
+        && ok;
+
+    if (!ok)
+    {
+        return false;
+    }
+
+    result->failedAxes = 0;
+
+    for (axis = 0; axis < LIS2DE12_AXES; axis++)
+    {
+        result->delta[axis] = result->averageOn[axis]
+            - result->averageOff[axis];
+
+        if (result->delta[axis] < 0)
+        {
+            result->delta[axis] = -result->delta[axis];
+        }
+
+        if ((result->delta[axis] < LIS2DE12_SELFTEST_MIN_LSB)
+                || (result->delta[axis] > LIS2DE12_SELFTEST_MAX_LSB))
+        {
+            result->failedAxes |= (1 << axis);
+        }
+    }
+
+    result->passed = (result->failedAxes == 0);
+
+    return true;
+}
+
+/**
+ * Get a snapshot of the transfer statistics.
+ *
+ * @param   snapshot    Memory where the statistics shall be stored.
+ */
+void LIS2DE12_GetStats(LIS2DE12_Stats_t *snapshot)
+{
+    uint32_t primask;
+    uint32_t succeeded;
+
+    ASSERT(snapshot);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    *snapshot = stats;
+    succeeded = stats.transactions - stats.nacks - stats.timeouts
+        - stats.errors;
+    snapshot->avgLatency = succeeded ? (statsTotalLatency / succeeded) : 0;
+
+    __set_PRIMASK(primask);
+
+    snapshot->recoveries = I2CBus_GetRecoveries();
+
+    if (snapshot->minLatency == UINT32_MAX)
+    {
+        snapshot->minLatency = 0;
+    }
+}
+
+/**
+ * Write a snapshot of the transfer statistics into the telemetry stream.
+ *
+ * @param   telemetry   Buffer where the snapshot shall be written.
+ *
+ * @returns It returns 1 if the snapshot has been written with success.
+ *          Otherwise, it returns 0 (not enough space).
+ */
+uint8_t LIS2DE12_SnapshotStats(CircularBuffer_t *telemetry)
+{
+    LIS2DE12_Stats_t snapshot;
+
+    ASSERT(telemetry);
+
+    LIS2DE12_GetStats(&snapshot);
+
+    return CircBuf_Write(telemetry, &snapshot, sizeof(snapshot));
+}
+
+/**
+ * Reset the transfer statistics.
+ */
+void LIS2DE12_ResetStats(void)
+{
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    memset(&stats, 0, sizeof(stats));
+    stats.minLatency = UINT32_MAX;
+    statsTotalLatency = 0;
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * Configure a MCU pin connected to one of the device interrupt pins, which
+ * are active high.
+ *
+ * @param   port    GPIO port of the pin.
+ * @param   pin     GPIO pin.
+ * @param   irq     EXTI interrupt of the pin.
+ */
+static void LIS2DE12_InitIntPin(GPIO_TypeDef *port, uint16_t pin,
+        IRQn_Type irq)
 {
     GPIO_InitTypeDef gpioInit;
 
-    /* Enable clocks */
-    LIS2DE12_I2C_SDA_GPIO_CLK_ENABLE();
-    LIS2DE12_I2C_SCL_GPIO_CLK_ENABLE();
-    LIS2DE12_I2C_CLK_ENABLE();
+    gpioInit.Pin = pin;
+    gpioInit.Mode = GPIO_MODE_IT_RISING;
+    gpioInit.Pull = GPIO_NOPULL;
+    gpioInit.Speed = GPIO_SPEED_LOW;
+    gpioInit.Alternate = 0;
+
+    HAL_GPIO_Init(port, &gpioInit);
+
+    HAL_NVIC_SetPriority(irq, LIS2DE12_INT_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(irq);
+}
+
+/**
+ * Read registers from the device. This and LIS2DE12_BusWrite are the only
+ * synchronous accesses to the bus, so the driver can be exercised against a
+ * different bus implementation. Multiple registers are read with address
+ * auto-increment through the bus fast path, as they are the hot transfers.
+ *
+ * @param   deviceAddress       I2C device address.
+ * @param   regAddress          First register address to be read.
+ * @param   data                Memory to store the read data.
+ * @param   size                Number of bytes to be read.
+ *
+ * @returns It returns 1 if registers have been read with success. Otherwise,
+ *          it returns 0.
+ */
+static uint8_t LIS2DE12_BusRead(uint8_t deviceAddress, uint8_t regAddress,
+        uint8_t *data, uint16_t size)
+{
+    I2CBus_Transfer_t xfer = { 0 };
+    uint8_t result;
+
+    xfer.deviceAddress = deviceAddress;
+    xfer.regAddress = LIS2D12_DEV_REG_INC(regAddress, (size > 1));
+    xfer.data = data;
+    xfer.size = size;
+    xfer.direction = I2CBUS_DIR_READ;
+    xfer.priority = I2CBUS_PRIORITY_HIGHEST;
+    xfer.flags = (size > 1) ? I2CBUS_FLAG_FAST : 0;
+
+    result = I2CBus_Execute(&xfer);
+    LIS2DE12_RecordStats(&xfer);
+
+    return result;
+}
+
+/**
+ * Write registers of the device.
+ *
+ * @param   deviceAddress       I2C device address.
+ * @param   regAddress          First register address to be written.
+ * @param   data                Data to be written.
+ * @param   size                Number of bytes to be written.
+ *
+ * @returns It returns 1 if registers have been written with success.
+ *          Otherwise, it returns 0.
+ */
+static uint8_t LIS2DE12_BusWrite(uint8_t deviceAddress, uint8_t regAddress,
+        const uint8_t *data, uint16_t size)
+{
+    I2CBus_Transfer_t xfer = { 0 };
+    uint8_t result;
+
+    xfer.deviceAddress = deviceAddress;
+    xfer.regAddress = LIS2D12_DEV_REG_INC(regAddress, (size > 1));
+    xfer.data = (uint8_t *) data;
+    xfer.size = size;
+    xfer.direction = I2CBUS_DIR_WRITE;
+    xfer.priority = I2CBUS_PRIORITY_HIGHEST;
+
+    result = I2CBus_Execute(&xfer);
+    LIS2DE12_RecordStats(&xfer);
+
+    return result;
+}
+
+/**
+ * Account a completed transfer in the statistics. It's a handful of
+ * instructions, negligible next to the transfer itself.
+ *
+ * @param   xfer    Completed transfer.
+ */
+static void LIS2DE12_RecordStats(const I2CBus_Transfer_t *xfer)
+{
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    stats.transactions++;
+
+    if (xfer->status == I2CBUS_STATUS_DONE)
+    {
+        stats.bytes += xfer->size;
+        statsTotalLatency += xfer->cycles;
+
+        if (xfer->cycles < stats.minLatency)
+        {
+            stats.minLatency = xfer->cycles;
+        }
+
+        if (xfer->cycles > stats.maxLatency)
+        {
+            stats.maxLatency = xfer->cycles;
+        }
+    }
+    else if (xfer->error == I2CBUS_ERROR_NACK)
+    {
+        stats.nacks++;
+    }
+    else if (xfer->error == I2CBUS_ERROR_TIMEOUT)
+    {
+        stats.timeouts++;
+    }
+    else
+    {
+        stats.errors++;
+    }
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * Sleep for at least a given time, waking up on every tick. The current tick
+ * has partially elapsed already, so it doesn't count.
+ *
+ * @param   msec    Time in milliseconds to sleep.
+ */
+static void LIS2DE12_Sleep(uint32_t msec)
+{
+    uint32_t start = HAL_GetTick();
+
+    while ((HAL_GetTick() - start) <= msec)
+    {
+        __WFI();
+    }
+}
+
+/**
+ * Collect a number of samples in the FIFO and average them.
+ *
+ * @param   count       Number of samples to be averaged.
+ * @param   average     Memory where the average of each axis shall be
+ *                      stored.
+ *
+ * @returns It returns 1 if the samples have been averaged with success.
+ *          Otherwise, it returns 0.
+ */
+static uint8_t LIS2DE12_SelfTestAverage(uint8_t count,
+        int16_t average[LIS2DE12_AXES])
+{
+    LIS2DE12_Sample_t samples[LIS2DE12_FIFO_SIZE];
+    int32_t sum[LIS2DE12_AXES] = { 0 };
+    uint32_t waited = 0;
+    uint8_t fifoSrc = 0;
+    uint8_t stored = 0;
+    uint8_t index;
+
+    /* Restart the FIFO, so it only holds samples of the current mode */
+    if (!LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_CTRL_REG,
+            LI2DE12_FIFO_MODE_BYPASS)
+        || !LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_CTRL_REG,
+            LI2DE12_FIFO_MODE_FIFO))
+    {
+        return false;
+    }
+
+    while (stored < count)
+    {
+        if ((waited >= LIS2DE12_SELFTEST_FIFO_TIMEOUT_MS)
+                || !LIS2DE12_ReadReg(LI2DE12_I2C_DEFAULT_ADDR,
+                    LI2DE12_FIFO_SRC_REG, &fifoSrc))
+        {
+            return false;
+        }
+
+        stored = (fifoSrc & LI2DE12_FIFO_OVRN) ? LIS2DE12_FIFO_SIZE
+            : (fifoSrc & LI2DE12_FIFO_FSS_MASK);
+
+        if (stored < count)
+        {
+            LIS2DE12_Sleep(LIS2DE12_SELFTEST_FIFO_POLL_MS);
+            waited += LIS2DE12_SELFTEST_FIFO_POLL_MS;
+        }
+    }
 
-    /* I2C TX GPIO pin configuration  */
-    gpioInit.Pin = LIS2DE12_I2C_SCL_PIN;
-    gpioInit.Mode = GPIO_MODE_AF_OD;
-    gpioInit.Pull = GPIO_PULLUP;
-    gpioInit.Speed = GPIO_SPEED_FAST;
-    gpioInit.Alternate = LIS2DE12_I2C_SCL_AF;
+    if (!LIS2DE12_ReadFifo(samples, count))
+    {
+        return false;
+    }
 
-    HAL_GPIO_Init(LIS2DE12_I2C_SCL_GPIO_PORT, &gpioInit);
+    for (index = 0; index < count; index++)
+    {
+        sum[LIS2DE12_AXIS_X] += samples[index].x;
+        sum[LIS2DE12_AXIS_Y] += samples[index].y;
+        sum[LIS2DE12_AXIS_Z] += samples[index].z;
+    }
 
-    /* I2C RX GPIO pin configuration  */
-    gpioInit.Pin = LIS2DE12_I2C_SDA_PIN;
-    gpioInit.Alternate = LIS2DE12_I2C_SDA_AF;
+    for (index = 0; index < LIS2DE12_AXES; index++)
+    {
+        average[index] = sum[index] / count;
+    }
 
-    HAL_GPIO_Init(LIS2DE12_I2C_SDA_GPIO_PORT, &gpioInit);
+    return true;
 }
 
+/**
+ * Update some bits of a register of the default device.
+ *
+ * @param   regAddress          Register address to be updated.
+ * @param   mask                Bits to be updated.
+ * @param   value               New value of the bits.
+ *
+ * @returns It returns 1 if register has been updated with success. Otherwise,
+ *          it returns 0.
+ */
+static uint8_t LIS2DE12_UpdateReg(uint8_t regAddress, uint8_t mask,
+        uint8_t value)
+{
+    uint8_t data;
+
+    if (!LIS2DE12_ReadReg(LI2DE12_I2C_DEFAULT_ADDR, regAddress, &data))
+    {
+        return false;
+    }
+
+    data = (data & ~mask) | (value & mask);
+
+    return LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, regAddress, data);
+}
+
+/**
+ * Start reading the next FIFO burst into the stream buffer.
+ *
+ * @note    This function is called within an ISR context.
+ */
+static void LIS2DE12_StreamReadFromISR(void)
+{
+    if (streamCallbackFromISR && (streamXfer.status != I2CBUS_STATUS_PENDING))
+    {
+        streamXfer.data = (uint8_t *) &streamBuffer[streamHead];
+        I2CBus_Submit(&streamXfer);
+    }
+}
+
+/**
+ * Callback which is called when a FIFO burst has been read.
+ *
+ * @note    This callback is called within an ISR context.
+ */
+static void LIS2DE12_StreamCallbackFromISR(I2CBus_Transfer_t *xfer)
+{
+    LIS2DE12_StreamCallback_t callbackFromISR = streamCallbackFromISR;
+    uint16_t half = streamSize / 2;
+
+    LIS2DE12_RecordStats(xfer);
+
+    if (callbackFromISR == NULL)
+    {
+        return;
+    }
+
+    if (xfer->status == I2CBUS_STATUS_DONE)
+    {
+        /* The burst of the watermark event is in the ring now */
+        Latency_CommitFromISR();
+
+        streamHead += LIS2DE12_STREAM_WATERMARK;
+
+        if (streamHead == half)
+        {
+            callbackFromISR(streamBuffer, half);
+        }
+        else if (streamHead == streamSize)
+        {
+            streamHead = 0;
+            callbackFromISR(&streamBuffer[half], half);
+        }
+    }
+
+    /* INT1 is level triggered on the sensor side, so no new edge comes while
+     * the FIFO is still above the watermark */
+    if (HAL_GPIO_ReadPin(LIS2DE12_INT1_GPIO_PORT, LIS2DE12_INT1_PIN)
+            == GPIO_PIN_SET)
+    {
+        LIS2DE12_StreamReadFromISR();
+    }
+}
+
+/**
+ * Submit the write of the data rate of the one-shot read.
+ *
+ * @param   odr     Output data rate (LI2DE12_ODR_*).
+ */
+static void LIS2DE12_OneShotSubmitFromISR(uint8_t odr)
+{
+    oneShotData[0] = (odr & LI2DE12_ODR_MASK) | LI2DE12_LP_EN
+        | LI2DE12_XYZ_EN;
+
+    oneShotXfer.regAddress = LI2DE12_CTRL_REG1;
+    oneShotXfer.data = oneShotData;
+    oneShotXfer.size = 1;
+    oneShotXfer.direction = I2CBUS_DIR_WRITE;
+    oneShotXfer.flags = 0;
+
+    if (!I2CBus_Submit(&oneShotXfer))
+    {
+        LIS2DE12_OneShotFinishFromISR(false);
+    }
+}
+
+/**
+ * Callback which is called when each transfer of the one-shot read has been
+ * completed, which moves it to its next step.
+ *
+ * @note    This callback is called within an ISR context.
+ */
+static void LIS2DE12_OneShotCallbackFromISR(I2CBus_Transfer_t *xfer)
+{
+    bool done = (xfer->status == I2CBUS_STATUS_DONE);
+    int16_t raw;
+
+    LIS2DE12_RecordStats(xfer);
+
+    switch (oneShotState)
+    {
+        case LIS2DE12_ONESHOT_POWER_UP:
+            if (!done)
+            {
+                LIS2DE12_OneShotFinishFromISR(false);
+                break;
+            }
+
+            oneShotState = LIS2DE12_ONESHOT_SETTLE;
+            oneShotSettleStart = RTC_GetTimestamp();
+            RTC_StartTimer(&oneShotTimer, LIS2DE12_ONESHOT_SETTLE_MS, 0,
+                LIS2DE12_OneShotTimerFromISR);
+            break;
+
+        case LIS2DE12_ONESHOT_READ:
+            if (done && !(oneShotData[0] & LI2DE12_TDA)
+                    && (LIS2DE12_OneShotElapsed()
+                        < LIS2DE12_ONESHOT_TIMEOUT_MS))
+            {
+                /* No conversion yet, check again later */
+                oneShotState = LIS2DE12_ONESHOT_SETTLE;
+                RTC_StartTimer(&oneShotTimer, 1, 0,
+                    LIS2DE12_OneShotTimerFromISR);
+                break;
+            }
+
+            if (done && (oneShotData[0] & LI2DE12_TDA))
+            {
+                raw = (int16_t) ((oneShotData[LIS2DE12_ONESHOT_BURST_TEMP_H]
+                    << 8) | oneShotData[LIS2DE12_ONESHOT_BURST_TEMP_L]);
+                oneShotTemp = LIS2DE12_ConvertTemp(raw, &tempCalib);
+                oneShotSuccess = true;
+            }
+
+            /* Power down, even if the read has failed */
+            oneShotState = LIS2DE12_ONESHOT_POWER_DOWN;
+            LIS2DE12_OneShotSubmitFromISR(LI2DE12_ODR_POWER_DOWN);
+            break;
+
+        case LIS2DE12_ONESHOT_POWER_DOWN:
+            LIS2DE12_OneShotFinishFromISR(oneShotSuccess && done);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * Callback which is called when the one-shot settle time has elapsed, which
+ * starts the status and temperature burst.
+ *
+ * @note    This callback is called within an ISR context.
+ */
+static void LIS2DE12_OneShotTimerFromISR(void)
+{
+    oneShotState = LIS2DE12_ONESHOT_READ;
+
+    oneShotXfer.regAddress = LIS2D12_DEV_REG_INC(LI2DE12_STATUS_REG_AUX,
+        true);
+    oneShotXfer.data = oneShotData;
+    oneShotXfer.size = sizeof(oneShotData);
+    oneShotXfer.direction = I2CBUS_DIR_READ;
+    oneShotXfer.flags = I2CBUS_FLAG_FAST;
+
+    if (!I2CBus_Submit(&oneShotXfer))
+    {
+        LIS2DE12_OneShotFinishFromISR(false);
+    }
+}
+
+/**
+ * Complete the one-shot read and hand its result over.
+ *
+ * @param   success     Whether the temperature has been read.
+ *
+ * @note    This function is called within an ISR context.
+ */
+static void LIS2DE12_OneShotFinishFromISR(bool success)
+{
+    LIS2DE12_TempCallback_t callbackFromISR = oneShotCallbackFromISR;
+
+    oneShotState = LIS2DE12_ONESHOT_IDLE;
+    callbackFromISR(success, oneShotTemp);
+}
+
+/**
+ * Get the time elapsed since the one-shot read started to settle, measured
+ * on the RTC.
+ *
+ * @returns It returns the elapsed time in milliseconds.
+ */
+static uint32_t LIS2DE12_OneShotElapsed(void)
+{
+    return ((RTC_GetTimestamp() - oneShotSettleStart) * 1000)
+        / RTC_GetTimestampFrequency();
+}
+
+/**
+ * Set up the INT2 pin and the read of its sources.
+ */
+static void LIS2DE12_InitInt2(void)
+{
+    int2Xfer.deviceAddress = LI2DE12_I2C_DEFAULT_ADDR;
+    int2Xfer.regAddress = LIS2D12_DEV_REG_INC(LI2DE12_INT1_SRC, true);
+    int2Xfer.data = int2Sources;
+    int2Xfer.size = sizeof(int2Sources);
+    int2Xfer.direction = I2CBUS_DIR_READ;
+    int2Xfer.priority = I2CBUS_PRIORITY_HIGHEST;
+    int2Xfer.flags = 0;
+    int2Xfer.callbackFromISR = LIS2DE12_Int2CallbackFromISR;
+
+    LIS2DE12_INT2_GPIO_CLK_ENABLE();
+    LIS2DE12_InitIntPin(LIS2DE12_INT2_GPIO_PORT, LIS2DE12_INT2_PIN,
+        LIS2DE12_INT2_IRQn);
+}
+
+/**
+ * Start reading the INT2 sources, unless a read is already in progress. It's
+ * called from the EXTI and from the RTC timer, which may preempt each other:
+ * the bus refuses a transfer still pending, atomically.
+ *
+ * @note    This function is called within an ISR context.
+ */
+static void LIS2DE12_Int2ReadFromISR(void)
+{
+    I2CBus_Submit(&int2Xfer);
+}
+
+/**
+ * Callback which is called when the INT2 sources have been read, which also
+ * clears the latched orientation interrupt. Each source which is active is
+ * dispatched, and the pin level is checked again afterwards, since another
+ * event may have kept it high.
+ *
+ * @note    This callback is called within an ISR context.
+ */
+static void LIS2DE12_Int2CallbackFromISR(I2CBus_Transfer_t *xfer)
+{
+    LIS2DE12_Callback_t callbackFromISR = activityCallbackFromISR;
+    uint8_t activitySource = int2Sources[LIS2DE12_INT2_BURST_INT1_SRC];
+    uint8_t orientSource = int2Sources[LIS2DE12_INT2_BURST_INT2_SRC];
+    LIS2DE12_OrientEvent_t event;
+
+    LIS2DE12_RecordStats(xfer);
+
+    if (xfer->status != I2CBUS_STATUS_DONE)
+    {
+        return;
+    }
+
+    if ((activitySource & LI2DE12_SRC_IA) && callbackFromISR)
+    {
+        callbackFromISR();
+    }
+
+    if (orientEnabled && (orientSource & LI2DE12_SRC_IA))
+    {
+        event.orientation = LIS2DE12_DecodeOrientation(orientSource);
+        event.source = orientSource;
+
+        if ((event.orientation != LIS2DE12_ORIENT_UNKNOWN)
+                && CircBuf_Write(orientEvents, &event, sizeof(event))
+                && orientCallbackFromISR)
+        {
+            orientCallbackFromISR();
+        }
+    }
+
+    if (HAL_GPIO_ReadPin(LIS2DE12_INT2_GPIO_PORT, LIS2DE12_INT2_PIN)
+            == GPIO_PIN_SET)
+    {
+        if (activitySource & LI2DE12_SRC_IA)
+        {
+            /* The activity goes on, check again once it may be over */
+            RTC_StartTimer(&int2Timer, LIS2DE12_INT2_RECHECK_MS, 0,
+                LIS2DE12_Int2ReadFromISR);
+        }
+        else
+        {
+            /* The orientation has changed again since it was read */
+            LIS2DE12_Int2ReadFromISR();
+        }
+    }
+}
+
+void HAL_GPIO_EXTI_Callback(uint16_t pin)
+{
+    if (pin == LIS2DE12_INT1_PIN)
+    {
+        Latency_MarkFromISR();
+        LIS2DE12_StreamReadFromISR();
+    }
+    else if (pin == LIS2DE12_INT2_PIN)
+    {
+        LIS2DE12_Int2ReadFromISR();
+    }
+}
+
+void EXTI4_IRQHandler(void)
+{
+    HAL_GPIO_EXTI_IRQHandler(LIS2DE12_INT1_PIN);
+}
+
+void EXTI9_5_IRQHandler(void)
+{
+    HAL_GPIO_EXTI_IRQHandler(LIS2DE12_INT2_PIN);
+}
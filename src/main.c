@@ -1,83 +1,462 @@
-/**
- * @brief   STM32 test project.
- */
-
-#include "stm32f4xx_hal.h"
-#include "rtc.h"
-#include "lis2de12.h"
-#include "circbuf.h"
-
-/** Periodicity which the core will wake up to read the sensor */
-#define DEFAULT_ALARM_PERIODICITY_MS            1000
-
-/** Number maximum of temperature the buffer can hold */
-#define DEFAULT_TEMPERATURE_BUFFER_SIZE         50
-
-typedef enum
-{
-    FSM_STATE_A,
-    FSM_STATE_B,
-    FSM_STATE_C,
-    FSM_STATE_D
-
-} FSM_STATE_t;
-
-static void AlarmCallbackFromISR(void);
-
-static volatile FSM_STATE_t state = FSM_STATE_A;
-static int16_t temperatureBuffer[DEFAULT_TEMPERATURE_BUFFER_SIZE];
-
-int main(void)
-{
-    int16_t temp;
-    CircularBuffer_t buffer;
-
-    while (1)
-    {
-        switch (state)
-        {
-            default:
-            case FSM_STATE_A: /* Initialize MCU peripherals */
-                HAL_Init();
-                RTC_Init();
-                RTC_SetPeriodicAlarm(DEFAULT_ALARM_PERIODICITY_MS,
-                    AlarmCallbackFromISR);
-
-                state = FSM_STATE_B;
-                break;
-
-            case FSM_STATE_B: /* Initialize LIS2DE12TR */
-                LIS2DE12_Init();
-                LIS2DE12_EnableTemp();
-                CircBuf_Init(&buffer, temperatureBuffer,
-                        sizeof(temperatureBuffer));
-
-                state = FSM_STATE_C;
-                break;
-
-            case FSM_STATE_C: /* Read temperature sensor */
-                LIS2DE12_ReadTemp((int *) &temp);
-                CircBuf_Write(&buffer, &temp, sizeof(temp));
-
-                state = FSM_STATE_D;
-                break;
-
-            case FSM_STATE_D: /* Sleep wait for next cycle */
-                HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON,
-                    PWR_SLEEPENTRY_WFE);
-                break;
-        }
-    }
-
-    return 0;
-}
-
-/**
- * Callback which is called by the periodic alarm.
- *
- * @note    This callback is called within an ISR context.
- */
-static void AlarmCallbackFromISR(void)
-{
-    state = FSM_STATE_C;
-}
+/**
+ * @brief   STM32 test project.
+ */
+
+#include "stm32f4xx_hal.h"
+#include "rtc.h"
+#include "lis2de12.h"
+#include "circbuf.h"
+#include "cycles.h"
+#include "latency.h"
+#include "power.h"
+#include "clock.h"
+#include "sched.h"
+#include "i2cbus.h"
+#include "odrctl.h"
+
+/** Periodicity which the core will wake up to read the sensor */
+#define DEFAULT_ALARM_PERIODICITY_MS            1000
+
+/** Number maximum of temperature samples the buffer can hold */
+#define DEFAULT_TEMPERATURE_BUFFER_SIZE         50
+
+/** Periodicity which the core will wake up from the STANDBY mode to read
+ * the sensor, when built with STANDBY_LOGGING */
+#define DEFAULT_STANDBY_PERIODICITY_S           60
+
+/** Number maximum of temperature samples the backup SRAM log can hold */
+#define DEFAULT_STANDBY_BUFFER_SIZE             200
+
+/** Tells a valid log apart from the random content of the backup SRAM */
+#define STANDBY_LOG_MAGIC                       0x4C4F4731
+
+/** Number of acceleration samples the stream buffer can hold, when built
+ * with ACTIVITY_STREAMING: two FIFO bursts, one per half */
+#define DEFAULT_STREAM_BUFFER_SIZE              (2 * LIS2DE12_STREAM_WATERMARK)
+
+/** Temperature sample record. */
+typedef struct
+{
+    RTC_Timestamp_t timestamp;  /**< Time of the read. */
+    int16_t temperature;        /**< Temperature (Q8.8 °C). */
+
+} TempSample_t;
+
+/** Temperature log kept in the backup SRAM through the STANDBY mode. */
+typedef struct
+{
+    uint32_t magic;             /**< STANDBY_LOG_MAGIC once initialized. */
+    uint32_t bootToSample;      /**< Last boot to sample time (us). */
+    uint32_t maxBootToSample;   /**< Maximum boot to sample time (us). */
+    CircularBuffer_t buffer;    /**< Buffer of the samples below. */
+    TempSample_t samples[DEFAULT_STANDBY_BUFFER_SIZE];
+
+} StandbyLog_t;
+
+/** Events handled by the scheduler. */
+typedef enum
+{
+    EVENT_READ_TEMPERATURE,
+    EVENT_CALIBRATE,
+    EVENT_SAMPLES
+
+} Event_t;
+
+/** Priority of the events (0 is the highest). The samples are handled
+ * first, before the stream overwrites them */
+#define EVENT_READ_TEMPERATURE_PRIORITY         1
+#define EVENT_CALIBRATE_PRIORITY                2
+#define EVENT_SAMPLES_PRIORITY                  0
+
+static void AlarmCallbackFromISR(void);
+static void ReadTemperature(uint32_t param);
+static void CalibrationRequestFromISR(void);
+static void Calibrate(uint32_t param);
+static void Idle(void);
+static void CountSampleCycles(void);
+#if defined(INTERRUPT_LOGGING)
+static void InterruptLogging(void);
+static void SampleCallbackFromISR(void);
+static void TempCallbackFromISR(bool success, int16_t temp);
+static void PendCalibrationFromISR(void);
+#endif
+#if defined(STANDBY_LOGGING)
+static void StandbyLogging(void);
+#endif
+#if defined(ACTIVITY_STREAMING)
+static void ActivityStreaming(void);
+static void StreamCallbackFromISR(const LIS2DE12_Sample_t *samples,
+        uint16_t count);
+static void ProcessSamples(uint32_t param);
+#endif
+
+static TempSample_t temperatureBuffer[DEFAULT_TEMPERATURE_BUFFER_SIZE];
+static CircularBuffer_t temperatureLog;
+
+/** Duration of each phase of the last temperature read, used to tune the
+ * energy budget */
+static LIS2DE12_OneShotTiming_t temperatureTiming;
+
+/** Cycles the core has run over the last sample period. The cycle counter
+ * doesn't count while the core sleeps or stops, so comparing it between the
+ * scheduler and the INTERRUPT_LOGGING builds gives the cycles saved per
+ * sample */
+static volatile uint32_t sampleCycles;
+static uint32_t sampleCyclesStart;
+
+#if defined(ACTIVITY_STREAMING)
+/** Acceleration samples streamed from the sensor FIFO. */
+static LIS2DE12_Sample_t streamBuffer[DEFAULT_STREAM_BUFFER_SIZE];
+
+/** Adaptive data rate: 10Hz while quiet, 100Hz for 5s after the last
+ * activity, detected by the sensor (64mg) or by the sample variance */
+static const OdrCtl_Config_t odrConfig =
+{
+    .lowOdr = LI2DE12_ODR_10HZ,
+    .highOdr = LI2DE12_ODR_100HZ,
+    .activityThreshold = 4,
+    .varianceThreshold = 16,
+    .holdTime = 5000
+};
+#endif
+
+int main(void)
+{
+#if defined(STANDBY_LOGGING)
+    StandbyLogging();
+#endif
+
+    /* Initialize MCU peripherals */
+    HAL_Init();
+    Clock_Init();
+    Cycles_Init();
+    RTC_Init();
+
+    /* Initialize LIS2DE12TR */
+    LIS2DE12_Init();
+    LIS2DE12_EnableTemp();
+    LIS2DE12_SetOdr(LI2DE12_ODR_POWER_DOWN);
+    CircBuf_Init(&temperatureLog, temperatureBuffer,
+            sizeof(temperatureBuffer));
+
+#if defined(INTERRUPT_LOGGING)
+    InterruptLogging();
+#endif
+
+    /* Events are subscribed before any interrupt can post them */
+    Sched_Init();
+    Sched_Subscribe(EVENT_READ_TEMPERATURE, EVENT_READ_TEMPERATURE_PRIORITY,
+            ReadTemperature);
+    Sched_Subscribe(EVENT_CALIBRATE, EVENT_CALIBRATE_PRIORITY, Calibrate);
+
+    RTC_SetCalibrationRequest(CalibrationRequestFromISR);
+
+#if defined(ACTIVITY_STREAMING)
+    ActivityStreaming();
+#endif
+
+    RTC_SetPeriodicAlarm(DEFAULT_ALARM_PERIODICITY_MS, AlarmCallbackFromISR);
+
+    /* First read straight away, then on every alarm */
+    Sched_Post(EVENT_READ_TEMPERATURE, 0);
+
+    Sched_Run(Idle);
+
+    return 0;
+}
+
+/**
+ * Callback which is called by the periodic alarm.
+ *
+ * @note    This callback is called within an ISR context.
+ */
+static void AlarmCallbackFromISR(void)
+{
+    CountSampleCycles();
+    Sched_Post(EVENT_READ_TEMPERATURE, 0);
+}
+
+/**
+ * Read the temperature sensor and log the sample.
+ *
+ * @param   param   Event parameter (unused).
+ */
+static void ReadTemperature(uint32_t param)
+{
+    TempSample_t sample;
+    uint8_t result;
+
+#if defined(ACTIVITY_STREAMING)
+    /* The sensor keeps sampling for the stream, so there's no power up to
+     * wait for. The hold time of the high data rate is also checked here,
+     * in case the stream stalls */
+    result = LIS2DE12_ReadTempQ8(&sample.temperature);
+    OdrCtl_Update();
+#else
+    result = LIS2DE12_ReadTempOneShot(&sample.temperature,
+        &temperatureTiming);
+#endif
+
+    if (result)
+    {
+        sample.timestamp = RTC_GetTimestamp();
+        CircBuf_Write(&temperatureLog, &sample, sizeof(sample));
+    }
+}
+
+/**
+ * Callback which is called when the LSI shall be measured again.
+ *
+ * @note    This callback is called within an ISR context.
+ */
+static void CalibrationRequestFromISR(void)
+{
+    Sched_Post(EVENT_CALIBRATE, 0);
+}
+
+/**
+ * Measure the LSI again, out of the RTC interrupt as it takes about 8ms. It's
+ * measured against the timer clock, so it's done on the burst clock, which
+ * resolves it about ten times finer, and the clock is lowered again right
+ * after.
+ *
+ * @param   param   Event parameter (unused).
+ */
+static void Calibrate(uint32_t param)
+{
+    /* A transfer in progress keeps the idle clock, which still works */
+    bool burst = Clock_SetMode(CLOCK_MODE_BURST);
+
+    RTC_Calibrate();
+
+    if (burst)
+    {
+        Clock_SetMode(CLOCK_MODE_IDLE);
+    }
+}
+
+/**
+ * Stop until the next interrupt, as no event is pending. The burst clock is
+ * left first, in case a transfer kept a handler from lowering it. The core
+ * only sleeps while a transfer started by an interrupt (e.g. a FIFO burst)
+ * is in progress, as the bus clock shall keep running.
+ */
+static void Idle(void)
+{
+    Clock_SetMode(CLOCK_MODE_IDLE);
+
+    if (I2CBus_IsIdle())
+    {
+        Power_Stop(true);
+    }
+    else
+    {
+        Power_Sleep();
+    }
+}
+
+/**
+ * Account the cycles run since the previous sample.
+ *
+ * @note    This function is called within an ISR context.
+ */
+static void CountSampleCycles(void)
+{
+    uint32_t now = CYCLES_GET();
+
+    sampleCycles = now - sampleCyclesStart;
+    sampleCyclesStart = now;
+}
+
+#if defined(INTERRUPT_LOGGING)
+/**
+ * Log the temperature from interrupts only: the periodic alarm starts the
+ * one-shot read, whose transfers and settle time chain from interrupt to
+ * interrupt, and its completion logs the sample. The core never returns to
+ * the thread mode, it sleeps on each interrupt exit while the read is in
+ * progress and stops once it's done.
+ */
+static void InterruptLogging(void)
+{
+    RTC_SetPeriodicAlarm(DEFAULT_ALARM_PERIODICITY_MS, SampleCallbackFromISR);
+
+    /* There's no thread mode to measure the LSI again from, so it's done
+     * from the PendSV, on the lowest priority */
+    HAL_NVIC_SetPriority(PendSV_IRQn, 0x0F, 0);
+    RTC_SetCalibrationRequest(PendCalibrationFromISR);
+
+    /* First read straight away, then on every alarm */
+    LIS2DE12_StartTempOneShot(TempCallbackFromISR);
+
+    Power_RunFromInterrupts();
+}
+
+/**
+ * Callback which is called by the periodic alarm, which starts a read.
+ *
+ * @note    This callback is called within an ISR context.
+ */
+static void SampleCallbackFromISR(void)
+{
+    CountSampleCycles();
+
+    /* The bus clock shall keep running until the read is done */
+    Power_SetDeepSleep(false);
+
+    LIS2DE12_StartTempOneShot(TempCallbackFromISR);
+}
+
+/**
+ * Callback which is called once a read is done, which logs the sample.
+ *
+ * @param   success     Whether the temperature has been read.
+ * @param   temp        Temperature (Q8.8 °C).
+ *
+ * @note    This callback is called within an ISR context.
+ */
+static void TempCallbackFromISR(bool success, int16_t temp)
+{
+    TempSample_t sample;
+
+    if (success)
+    {
+        sample.temperature = temp;
+        sample.timestamp = RTC_GetTimestamp();
+        CircBuf_Write(&temperatureLog, &sample, sizeof(sample));
+    }
+
+    Power_SetDeepSleep(true);
+}
+
+/**
+ * Callback which is called when the LSI shall be measured again, which
+ * defers the measure to the PendSV.
+ *
+ * @note    This callback is called within an ISR context.
+ */
+static void PendCalibrationFromISR(void)
+{
+    SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+/**
+ * Measure the LSI again, once the interrupts of higher priority are done.
+ */
+void PendSV_Handler(void)
+{
+    RTC_Calibrate();
+}
+#endif
+
+#if defined(STANDBY_LOGGING)
+/**
+ * Log the temperature from the STANDBY mode: each RTC wake-up boots the
+ * core, which reads one sample into the backup SRAM and goes back to the
+ * STANDBY mode. On a warm boot, the RTC and the sensor already hold their
+ * configuration, so only the bus is brought up before the read. The time
+ * from the start of main to the stored sample is kept in the log.
+ */
+static void StandbyLogging(void)
+{
+    StandbyLog_t *log;
+    TempSample_t sample;
+    uint32_t elapsed;
+    bool warm;
+
+    /* Started first, so the boot to sample time counts the HAL too */
+    Cycles_Init();
+    HAL_Init();
+
+    log = Power_EnableBackupRam();
+    warm = Power_WokeFromStandby() && (log->magic == STANDBY_LOG_MAGIC)
+        && RTC_Resume();
+
+    LIS2DE12_Init();
+
+    if (!warm)
+    {
+        RTC_Init();
+        RTC_SetStandbyWakeUp(DEFAULT_STANDBY_PERIODICITY_S);
+
+        LIS2DE12_EnableTemp();
+        LIS2DE12_SetOdr(LI2DE12_ODR_POWER_DOWN);
+
+        CircBuf_Init(&log->buffer, log->samples, sizeof(log->samples));
+        log->bootToSample = 0;
+        log->maxBootToSample = 0;
+        log->magic = STANDBY_LOG_MAGIC;
+    }
+
+    if (LIS2DE12_ReadTempOneShot(&sample.temperature, NULL))
+    {
+        sample.timestamp = RTC_GetTimestamp();
+        CircBuf_Write(&log->buffer, &sample, sizeof(sample));
+    }
+
+    /* The clock isn't changed from the reset one, which the cycles are
+     * counted at */
+    elapsed = CYCLES_GET() / (SystemCoreClock / 1000000);
+
+    if (warm)
+    {
+        log->bootToSample = elapsed;
+
+        if (elapsed > log->maxBootToSample)
+        {
+            log->maxBootToSample = elapsed;
+        }
+    }
+
+    Power_Standby();
+}
+#endif
+
+#if defined(ACTIVITY_STREAMING)
+/**
+ * Stream the acceleration at an adaptive data rate, next to the temperature
+ * logging. The sensor samples into its FIFO at the low data rate, and each
+ * half of the stream buffer is checked for activity from the main loop.
+ * Activity, from the samples or from the sensor activity interrupt, switches
+ * it to the high data rate until it's quiet for the hold time.
+ */
+static void ActivityStreaming(void)
+{
+    Sched_Subscribe(EVENT_SAMPLES, EVENT_SAMPLES_PRIORITY, ProcessSamples);
+
+    /* LIS2DE12 INT1 is also wired to the RTC timestamp pin, so the latency
+     * of each FIFO watermark event is measured */
+    RTC_EnableEventCapture(Latency_EventFromISR);
+
+    LIS2DE12_StartStream(odrConfig.lowOdr, streamBuffer,
+            DEFAULT_STREAM_BUFFER_SIZE, StreamCallbackFromISR);
+    OdrCtl_Init(&odrConfig);
+}
+
+/**
+ * Callback which is called when a half of the stream buffer has been
+ * filled, which hands it to the main loop.
+ *
+ * @param   samples     Filled half of the buffer.
+ * @param   count       Number of samples.
+ *
+ * @note    This callback is called within an ISR context.
+ */
+static void StreamCallbackFromISR(const LIS2DE12_Sample_t *samples,
+        uint16_t count)
+{
+    Sched_Post(EVENT_SAMPLES, (samples == streamBuffer) ? 0 : 1);
+}
+
+/**
+ * Check a half of the stream buffer for activity and apply the data rate.
+ *
+ * @param   param   Half of the stream buffer (0 or 1).
+ */
+static void ProcessSamples(uint32_t param)
+{
+    uint16_t half = DEFAULT_STREAM_BUFFER_SIZE / 2;
+
+    OdrCtl_ProcessSamples(&streamBuffer[param * half], half);
+    OdrCtl_Update();
+}
+#endif
@@ -0,0 +1,162 @@
+/**
+ * @brief   Adaptive output data rate control of the accelerometer. The
+ *          sensor runs at a low data rate while the signal is quiet and
+ *          switches to a high data rate while there is activity.
+ */
+
+#include "odrctl.h"
+#include "assert.h"
+#include "stm32f4xx_hal.h"
+
+static void OdrCtl_ActivityCallbackFromISR(void);
+static uint32_t OdrCtl_Variance(int32_t sum, uint32_t sumSquares,
+        uint16_t count);
+
+static OdrCtl_Config_t odrConfig;
+
+/** Whether the sensor is running at the high data rate. */
+static bool active;
+
+/** Activity has been detected and not yet handled. */
+static volatile bool activityPending;
+
+/** Time (HAL tick) of the last detected activity. */
+static volatile uint32_t lastActivity;
+
+/**
+ * Initialize the adaptive data rate control, starting at the low data rate
+ * with the activity interrupt enabled.
+ *
+ * @param   config      Adaptive data rate configuration.
+ *
+ * @returns It returns 'true' if the sensor has been configured with success.
+ *          Otherwise, it returns 'false'.
+ */
+bool OdrCtl_Init(const OdrCtl_Config_t *config)
+{
+    ASSERT(config);
+    ASSERT(config->lowOdr != config->highOdr);
+
+    odrConfig = *config;
+    active = false;
+    activityPending = false;
+
+    return LIS2DE12_SetOdr(odrConfig.lowOdr)
+        && LIS2DE12_EnableActivityInt(odrConfig.activityThreshold, 0,
+            OdrCtl_ActivityCallbackFromISR);
+}
+
+/**
+ * Process a block of samples, flagging activity if the variance of any axis
+ * crosses the threshold. Only integer math is used.
+ *
+ * @param   samples     Samples to be processed.
+ * @param   count       Number of samples.
+ */
+void OdrCtl_ProcessSamples(const LIS2DE12_Sample_t *samples, uint16_t count)
+{
+    int32_t sumX = 0;
+    int32_t sumY = 0;
+    int32_t sumZ = 0;
+    uint32_t sqX = 0;
+    uint32_t sqY = 0;
+    uint32_t sqZ = 0;
+    uint16_t index;
+
+    if ((samples == NULL) || (count < 2))
+    {
+        return;
+    }
+
+    for (index = 0; index < count; index++)
+    {
+        sumX += samples[index].x;
+        sumY += samples[index].y;
+        sumZ += samples[index].z;
+        sqX += samples[index].x * samples[index].x;
+        sqY += samples[index].y * samples[index].y;
+        sqZ += samples[index].z * samples[index].z;
+    }
+
+    if ((OdrCtl_Variance(sumX, sqX, count) > odrConfig.varianceThreshold)
+            || (OdrCtl_Variance(sumY, sqY, count)
+                > odrConfig.varianceThreshold)
+            || (OdrCtl_Variance(sumZ, sqZ, count)
+                > odrConfig.varianceThreshold))
+    {
+        lastActivity = HAL_GetTick();
+        activityPending = true;
+    }
+}
+
+/**
+ * Apply the data rate changes. It switches to the high data rate as soon as
+ * activity has been detected and back to the low data rate when the hold
+ * time has elapsed since the last activity. It shall be called from the
+ * thread context whenever the core wakes up.
+ *
+ * @returns It returns 'true' if the data rate is the expected one. Otherwise,
+ *          it returns 'false' (failed to change it).
+ */
+bool OdrCtl_Update(void)
+{
+    bool result = true;
+
+    if (activityPending)
+    {
+        activityPending = false;
+
+        if (!active)
+        {
+            result = LIS2DE12_SetOdr(odrConfig.highOdr);
+            active = result;
+        }
+    }
+    else if (active
+            && ((HAL_GetTick() - lastActivity) >= odrConfig.holdTime))
+    {
+        result = LIS2DE12_SetOdr(odrConfig.lowOdr);
+        active = !result;
+    }
+
+    return result;
+}
+
+/**
+ * Check whether the sensor is running at the high data rate.
+ *
+ * @returns It returns 'true' if the sensor is at the high data rate.
+ *          Otherwise, it returns 'false'.
+ */
+bool OdrCtl_IsActive(void)
+{
+    return active;
+}
+
+/**
+ * Compute the variance of a block of samples from its sums.
+ *
+ * @param   sum             Sum of the samples.
+ * @param   sumSquares      Sum of the squares of the samples.
+ * @param   count           Number of samples.
+ *
+ * @returns It returns the variance (digit^2).
+ */
+static uint32_t OdrCtl_Variance(int32_t sum, uint32_t sumSquares,
+        uint16_t count)
+{
+    int32_t mean = sum / count;
+
+    return (sumSquares / count) - (uint32_t) (mean * mean);
+}
+
+/**
+ * Callback which is called by the activity interrupt.
+ *
+ * @note    This callback is called within an ISR context.
+ */
+static void OdrCtl_ActivityCallbackFromISR(void)
+{
+    lastActivity = HAL_GetTick();
+    activityPending = true;
+}
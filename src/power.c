@@ -0,0 +1,386 @@
+/**
+ * @brief   Module which manages the HAL time base and the low power modes
+ *          the core idles in.
+ *
+ * The SysTick is suspended while the core sleeps, so it isn't woken up every
+ * millisecond just to count the HAL tick. The sleep time is measured on the
+ * RTC instead and added to the HAL tick on wake-up.
+ */
+
+#include "power.h"
+#include "rtc.h"
+#include "assert.h"
+#include "cycles.h"
+#include "stm32f4xx_hal.h"
+
+static void Power_SuspendTick(void);
+static void Power_ResumeTick(void);
+static uint32_t Power_ElapsedMsec(RTC_Timestamp_t since, bool carry);
+static void Power_RestoreClock(uint32_t cr, uint32_t cfgr, uint32_t pwrCr);
+static bool Power_WaitBits(__IO uint32_t *reg, uint32_t mask, uint32_t value);
+
+/* Longest wait for an oscillator, the over-drive or the clock switch while
+ * the clock is restored, counted in loops at the HSI which the core wakes up
+ * on (longer if the AHB prescaler divides it). The HSE takes the longest,
+ * about 2ms */
+#define POWER_READY_TIMEOUT_US          5000
+#define POWER_READY_LOOP_CYCLES         8
+#define POWER_READY_LOOPS                                               \
+    (POWER_READY_TIMEOUT_US * (HSI_VALUE / 1000000) / POWER_READY_LOOP_CYCLES)
+
+/** HAL tick counter, owned by the HAL. */
+extern __IO uint32_t uwTick;
+
+/** Whether the SysTick is suspended, and since when. */
+static volatile bool tickSuspended;
+static RTC_Timestamp_t suspendTimestamp;
+
+/** Fraction of millisecond left over by the last compensation, in
+ * 1 / (timestamp frequency) ms. */
+static uint32_t msecFraction;
+
+/** STOP mode statistics. */
+static Power_StopStats_t stopStats;
+
+/**
+ * Sleep until the next interrupt, with the SysTick suspended. The HAL tick
+ * is compensated on wake-up with the time elapsed on the RTC. It may be
+ * called with the interrupts disabled, as WFI wakes up on a pending one
+ * even while they are masked.
+ */
+void Power_Sleep(void)
+{
+    Power_SuspendTick();
+
+    HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+
+    /* Interrupts which woke the core up might have read the tick already, but
+     * only to compare it, so it's fine to move it forward now */
+    Power_ResumeTick();
+}
+
+/**
+ * Stop until the next interrupt (RTC wake-up timer, EXTI), with the
+ * low-power regulator. All clocks but the LSE/LSI are stopped, so no bus
+ * transfer shall be in progress.
+ *
+ * Interrupts are masked while stopped, so the one which wakes the core up
+ * is only taken once the system clock is restored. The time from the wake-up
+ * to the restored clock is accounted as the STOP exit latency.
+ *
+ * @param   flashPowerDown  Whether the flash shall also be powered down,
+ *                          which saves more but takes longer to wake up.
+ */
+void Power_Stop(bool flashPowerDown)
+{
+    uint32_t cr = RCC->CR;
+    uint32_t cfgr = RCC->CFGR;
+    uint32_t pwrCr = PWR->CR;
+    uint32_t primask;
+    uint32_t start;
+    uint32_t wakeMhz;
+    uint32_t latency;
+
+    if (flashPowerDown)
+    {
+        HAL_PWREx_EnableFlashPowerDown();
+    }
+    else
+    {
+        HAL_PWREx_DisableFlashPowerDown();
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    Power_SuspendTick();
+
+    /* WFI wakes up on a pending interrupt even while they are masked */
+    HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+
+    /* The core wakes up on the HSI, through the AHB prescaler in use (the
+     * idle clock halves it), which the cycles are counted at until the
+     * system clock is switched back */
+    start = CYCLES_GET();
+    Power_RestoreClock(cr, cfgr, pwrCr);
+    wakeMhz = (HSI_VALUE >> AHBPrescTable[(cfgr & RCC_CFGR_HPRE)
+        >> RCC_CFGR_HPRE_Pos]) / 1000000;
+    latency = (CYCLES_GET() - start) / wakeMhz;
+
+    stopStats.count++;
+    stopStats.lastExit = latency;
+
+    if (latency > stopStats.maxExit)
+    {
+        stopStats.maxExit = latency;
+    }
+
+    Power_ResumeTick();
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * Hand the execution over to the interrupts for good. The core sleeps, with
+ * the SysTick suspended, and goes back to sleep straight from each interrupt
+ * return, without ever resuming the thread mode. This function doesn't
+ * return.
+ */
+void Power_RunFromInterrupts(void)
+{
+    __disable_irq();
+
+    Power_SuspendTick();
+    HAL_PWR_EnableSleepOnExit();
+
+    __enable_irq();
+
+    /* Only the first sleep is entered from here */
+    while (1)
+    {
+        __WFI();
+    }
+}
+
+/**
+ * Choose whether the core stops, rather than sleeps, on the interrupt
+ * returns. It shall only stop while no bus transfer is in progress, and the
+ * system clock shall be the HSI, which the core wakes up on.
+ *
+ * @param   deep    Whether the core shall stop, with the low-power
+ *                  regulator.
+ */
+void Power_SetDeepSleep(bool deep)
+{
+    if (deep)
+    {
+        ASSERT(__HAL_RCC_GET_SYSCLK_SOURCE() == RCC_SYSCLKSOURCE_STATUS_HSI);
+
+        MODIFY_REG(PWR->CR, (PWR_CR_PDDS | PWR_CR_LPDS),
+            PWR_LOWPOWERREGULATOR_ON);
+        SET_BIT(SCB->SCR, SCB_SCR_SLEEPDEEP_Msk);
+    }
+    else
+    {
+        CLEAR_BIT(SCB->SCR, SCB_SCR_SLEEPDEEP_Msk);
+    }
+}
+
+/**
+ * Enter the STANDBY mode, until the RTC wake-up timer (or the WKUP pin)
+ * resets the core. Only the backup domain is kept: the RTC, its backup
+ * registers and the backup SRAM, if enabled. This function doesn't return.
+ */
+void Power_Standby(void)
+{
+    /* A wake-up flag left set would wake the core up straight away */
+    __HAL_PWR_CLEAR_FLAG(PWR_FLAG_WU);
+
+    HAL_PWR_EnterSTANDBYMode();
+
+    /* The STANDBY mode is only left through a reset. Should a pending event
+     * keep it from being entered, it's entered again */
+    while (1)
+    {
+        __WFI();
+    }
+}
+
+/**
+ * Check whether the core has booted on a wake-up from the STANDBY mode, and
+ * clear the flags which tell it, for the next boot.
+ *
+ * @returns It returns true if the core has been woken up from the STANDBY
+ *          mode. Otherwise, it returns false.
+ */
+bool Power_WokeFromStandby(void)
+{
+    bool standby;
+
+    __HAL_RCC_PWR_CLK_ENABLE();
+
+    standby = (__HAL_PWR_GET_FLAG(PWR_FLAG_SB) != 0);
+
+    __HAL_PWR_CLEAR_FLAG(PWR_FLAG_SB);
+    __HAL_PWR_CLEAR_FLAG(PWR_FLAG_WU);
+
+    return standby;
+}
+
+/**
+ * Enable the backup SRAM and its regulator, so it retains its content in
+ * the STANDBY mode (and on VBAT).
+ *
+ * @returns It returns the address of the backup SRAM.
+ */
+void *Power_EnableBackupRam(void)
+{
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+    __HAL_RCC_BKPSRAM_CLK_ENABLE();
+
+    ASSERT(HAL_PWREx_EnableBkUpReg() == HAL_OK);
+
+    return (void *) BKPSRAM_BASE;
+}
+
+/**
+ * Get a snapshot of the STOP mode statistics.
+ *
+ * @param   stats   Memory where the statistics shall be stored.
+ */
+void Power_GetStopStats(Power_StopStats_t *stats)
+{
+    ASSERT(stats);
+
+    *stats = stopStats;
+}
+
+/**
+ * Get the HAL tick. While the SysTick is suspended, the time elapsed on the
+ * RTC is added, so timeouts checked within interrupts still expire.
+ *
+ * @returns It returns the HAL tick in milliseconds.
+ */
+uint32_t HAL_GetTick(void)
+{
+    if (tickSuspended)
+    {
+        return uwTick + Power_ElapsedMsec(suspendTimestamp, false);
+    }
+
+    return uwTick;
+}
+
+/**
+ * Interrupt Service Routine (ISR) of the SysTick, the HAL time base.
+ */
+void SysTick_Handler(void)
+{
+    HAL_IncTick();
+}
+
+/**
+ * Suspend the SysTick, keeping the time it happened.
+ */
+static void Power_SuspendTick(void)
+{
+    suspendTimestamp = RTC_GetTimestamp();
+    HAL_SuspendTick();
+    tickSuspended = true;
+}
+
+/**
+ * Compensate the HAL tick with the time elapsed on the RTC since it was
+ * suspended, and resume the SysTick.
+ */
+static void Power_ResumeTick(void)
+{
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    uwTick += Power_ElapsedMsec(suspendTimestamp, true);
+    tickSuspended = false;
+
+    __set_PRIMASK(primask);
+
+    HAL_ResumeTick();
+}
+
+/**
+ * Get the milliseconds elapsed on the RTC since a given time.
+ *
+ * @param   since   Timestamp to measure from.
+ * @param   carry   Whether the fraction of millisecond left over shall be
+ *                  carried to the next compensation.
+ *
+ * @returns It returns the whole number of milliseconds elapsed.
+ */
+static uint32_t Power_ElapsedMsec(RTC_Timestamp_t since, bool carry)
+{
+    uint32_t frequency = RTC_GetTimestampFrequency();
+    uint64_t scaled;
+
+    scaled = (RTC_GetTimestamp() - since) * 1000 + msecFraction;
+
+    if (carry)
+    {
+        msecFraction = scaled % frequency;
+    }
+
+    return scaled / frequency;
+}
+
+/**
+ * Restore the system clock which was running before the STOP mode, which
+ * left the core on the HSI. The flash latency and the voltage scale are
+ * retained in STOP mode.
+ *
+ * It runs with the interrupts disabled and the HAL tick suspended, so every
+ * wait polls the ready flags for a bounded number of loops instead of going
+ * through the HAL and its tick timeouts.
+ *
+ * @param   cr      RCC clock control register before the STOP mode.
+ * @param   cfgr    RCC clock configuration register before the STOP mode.
+ * @param   pwrCr   PWR control register before the STOP mode.
+ */
+static void Power_RestoreClock(uint32_t cr, uint32_t cfgr, uint32_t pwrCr)
+{
+    if (cr & RCC_CR_HSEON)
+    {
+        SET_BIT(RCC->CR, RCC_CR_HSEON);
+        ASSERT(Power_WaitBits(&RCC->CR, RCC_CR_HSERDY, RCC_CR_HSERDY));
+    }
+
+    if (cr & RCC_CR_PLLON)
+    {
+        SET_BIT(RCC->CR, RCC_CR_PLLON);
+        ASSERT(Power_WaitBits(&RCC->CR, RCC_CR_PLLRDY, RCC_CR_PLLRDY));
+    }
+
+    /* The over-drive doesn't survive the STOP mode. It's enabled as by
+     * HAL_PWREx_EnableOverDrive, then switched to */
+    if ((pwrCr & PWR_CR_ODEN) && !READ_BIT(PWR->CR, PWR_CR_ODEN))
+    {
+        SET_BIT(PWR->CR, PWR_CR_ODEN);
+        ASSERT(Power_WaitBits(&PWR->CSR, PWR_CSR_ODRDY, PWR_CSR_ODRDY));
+
+        SET_BIT(PWR->CR, PWR_CR_ODSWEN);
+        ASSERT(Power_WaitBits(&PWR->CSR, PWR_CSR_ODSWRDY, PWR_CSR_ODSWRDY));
+    }
+
+    if ((cfgr & RCC_CFGR_SW) != RCC_CFGR_SW_HSI)
+    {
+        MODIFY_REG(RCC->CFGR, RCC_CFGR_SW, cfgr & RCC_CFGR_SW);
+        ASSERT(Power_WaitBits(&RCC->CFGR, RCC_CFGR_SWS,
+                    (cfgr & RCC_CFGR_SW) << RCC_CFGR_SWS_Pos));
+    }
+}
+
+/**
+ * Wait for some bits of a register to take a value, for a bounded number of
+ * loops.
+ *
+ * @param   reg     Register to be polled.
+ * @param   mask    Bits to be checked.
+ * @param   value   Value expected for the bits.
+ *
+ * @returns It returns true if the bits have taken the value. Otherwise
+ *          (timeout), it returns false.
+ */
+static bool Power_WaitBits(__IO uint32_t *reg, uint32_t mask, uint32_t value)
+{
+    uint32_t loops = POWER_READY_LOOPS;
+
+    while ((*reg & mask) != value)
+    {
+        if (loops-- == 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
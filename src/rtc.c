@@ -1,44 +1,539 @@
 /**
- * @brief   Module which manages the Real Time Counter (RTC) and the
- *          periodic alarm.
+ * @brief   Module which manages the Real Time Counter (RTC) and the software
+ *          timers multiplexed on its wake-up timer.
+ *
+ * The timers are kept in a hierarchical timer wheel, ticking at the timestamp
+ * frequency. Each level has 32 slots, each slot of a level spanning a whole
+ * turn of the level below. The wake-up timer is always programmed to the
+ * next event of the wheel: an expiry on the first level, or a slot of an
+ * upper level to be cascaded down. So insert and expire are O(1), and all
+ * timers share one hardware wake-up.
  */
 
 #include "rtc.h"
 #include "assert.h"
 #include "stm32f4xx_hal.h"
 
-/* RTC prescale settings to get a 1Hz clock (32KHz / (124 + 1) / (255 + 1)) */
+/* Default RTC prescale settings to get a 1Hz clock (32KHz / (124 + 1) /
+ * (255 + 1)), until the LSI is measured. The synchronous prescaler also sets
+ * the sub-second resolution */
 #define RTC_ASYNCH_PREDIV               0x7C
 #define RTC_SYNCH_PREDIV                0x00FF
 
-/* Wake-up prescaled clock (32KHz / 16) */
-#define RTC_WUT_PRESC_CLOCK_HZ          2000
-#define RTC_SPRE_CLOCK_HZ               1
+/* RTC prescale settings for the LSE (32768Hz / (127 + 1) / (255 + 1)) */
+#define RTC_LSE_ASYNCH_PREDIV           0x7F
+#define RTC_LSE_SYNCH_PREDIV            0x00FF
+#define RTC_LSE_HZ                      32768
+
+/* Crystal tolerance, recorded as the LSE accuracy */
+#define RTC_LSE_ACCURACY_PPM            20
+
+/* Time the LSE is given to start, before falling back to the LSI */
+#define RTC_LSE_STARTUP_TIMEOUT_MS      2000
+
+/* Backup registers recording the clock source and its accuracy in ppm, and
+ * the last measured LSI frequency */
+#define RTC_BKP_CLOCK                   RTC_BKP_DR0
+#define RTC_BKP_LSI_FREQUENCY           RTC_BKP_DR1
+#define RTC_CLOCK_RECORD_MAGIC          0xC5
+#define RTC_CLOCK_RECORD(source, ppm)                                   \
+    ((RTC_CLOCK_RECORD_MAGIC << 24) | ((source) << 16) | ((ppm) & 0xFFFF))
+#define RTC_CLOCK_RECORD_VALID(record)                                  \
+    (((record) >> 24) == RTC_CLOCK_RECORD_MAGIC)
+#define RTC_CLOCK_RECORD_SOURCE(record) (((record) >> 16) & 0xFF)
+#define RTC_CLOCK_RECORD_PPM(record)    ((record) & 0xFFFF)
+
+/* Accuracy recorded when it's unknown */
+#define RTC_ACCURACY_UNKNOWN            0xFFFF
+
+/* Range of the asynchronous prescaler searched for a calibrated 1Hz clock.
+ * The highest values are tried first, as they draw the least power */
+#define RTC_ASYNCH_PREDIV_MAX           0x7F
+#define RTC_ASYNCH_PREDIV_MIN           0x3F
+
+/* Wake-up timer clock divider (RTCCLK / 16) */
+#define RTC_WUT_DIVIDER                 16
+
+/* Longest wake-up timer count, which is about 32s at 2KHz. Later events
+ * take more than one wake-up */
+#define RTC_WUT_MAX_COUNT               0x10000
+
+/* Nominal LSI frequency, until a measured one is given */
+#define RTC_LSI_NOMINAL_HZ              32000
+
+/* LSI measurement: TIM5 channel 4 captures every 8th LSI rising edge, 32
+ * times (about 8ms), against the timer clock */
+#define RTC_LSI_CAPTURE_PRESCALER       8
+#define RTC_LSI_CAPTURES                32
+#define RTC_LSI_CAPTURE_TIMEOUT_MS      2
+
+/* Time the LSI is given to start (40us typical) */
+#define RTC_LSI_STARTUP_TIMEOUT_MS      2
+
+/* Period of the LSI re-measure, which tracks its temperature drift */
+#define RTC_CALIB_PERIOD_MS             (10 * 60 * 1000)
+
+/* Smooth calibration: pulses masked (or added, 512 at once) over a 2^20
+ * cycles window */
+#define RTC_SMOOTH_CALIB_WINDOW         (1UL << 20)
+#define RTC_SMOOTH_CALIB_PLUS_PULSES    512
+#define RTC_SMOOTH_CALIB_MAX_MINUS      511
+
+/* Timer wheel geometry: 5 levels of 32 slots, about 36h at 256Hz */
+#define RTC_WHEEL_LEVELS                5
+#define RTC_WHEEL_SLOT_BITS             5
+#define RTC_WHEEL_SLOTS                 (1 << RTC_WHEEL_SLOT_BITS)
+#define RTC_WHEEL_SLOT_MASK             (RTC_WHEEL_SLOTS - 1)
+
+/* Longest delta the wheel can hold. Later expiries are parked on the last
+ * level and cascaded until they fit */
+#define RTC_WHEEL_MAX_DELTA                                             \
+    ((1ULL << (RTC_WHEEL_LEVELS * RTC_WHEEL_SLOT_BITS)) - 1)
+
+/* Timers expired by a wake-up whose callbacks are called at once, out of
+ * the critical section. More are expired in further rounds */
+#define RTC_EXPIRED_MAX                 8
 
-/* Maximum periodicity which the 2KHz shall be used. Any periodicity above this
- * shall use the 1Hz clock */
-#define RTC_MAX_PERIORICITY_PRSC_CLK    10000
+#define RTC_SECONDS_PER_DAY             86400
 
-#define RTC_MSEC_TO_TICK(msec, clock)   ((msec * clock) / 1000)
+/* Decode a BCD field of a calendar register */
+#define RTC_BCD_FIELD(reg, tens, units)                                 \
+    ((((reg) & tens) >> tens##_Pos) * 10 + (((reg) & units) >> units##_Pos))
+
+static void RTC_TimerInsert(RTC_Timer_t *timer);
+static void RTC_TimerRemove(RTC_Timer_t *timer);
+static bool RTC_TimerLevelEvent(uint8_t level, RTC_Timestamp_t *time);
+static RTC_Timestamp_t RTC_TimerSlotExpiry(uint8_t level,
+        RTC_Timestamp_t time);
+static uint32_t RTC_TimerAdvance(RTC_Timestamp_t now,
+        RTC_Callback_t expired[RTC_EXPIRED_MAX]);
+static void RTC_TimerArm(void);
+static uint32_t RTC_RotateRight(uint32_t value, uint32_t shift);
+static uint64_t RTC_MsecToTicks(uint32_t msec, uint32_t *fraction);
+static void RTC_TimerSetPeriod(RTC_Timer_t *timer, uint32_t period);
+static bool RTC_StartLse(void);
+static bool RTC_StartLsi(void);
+static void RTC_RecordClock(uint32_t lsi, uint32_t frequency);
+static uint32_t RTC_MeasureLsi(void);
+static void RTC_SelectPrescalers(uint32_t lsi);
+static uint32_t RTC_SetSmoothCalib(uint32_t lsi);
+static void RTC_CalibrateCallbackFromISR(void);
+static RTC_Timestamp_t RTC_ToTimestamp(uint32_t ssr, uint32_t tr,
+        uint32_t dr);
+static uint32_t RTC_DaysSince2000(uint32_t dr);
 
 static RTC_HandleTypeDef rtcHandle;
-static RTC_Callback_t rtcCallbackFromISR;
+
+/** Timer wheel: timers of each slot, bit mask of the slots holding timers
+ * on each level, number of running timers and time it has advanced to */
+static RTC_Timer_t *wheel[RTC_WHEEL_LEVELS][RTC_WHEEL_SLOTS];
+static uint32_t wheelOccupied[RTC_WHEEL_LEVELS];
+static uint32_t wheelCount;
+static RTC_Timestamp_t wheelTime;
+
+/** Prescalers in use. A timestamp tick lasts (asynchPrediv + 1) LSI cycles
+ * and a second (synchPrediv + 1) ticks */
+static uint32_t asynchPrediv = RTC_ASYNCH_PREDIV;
+static uint32_t synchPrediv = RTC_SYNCH_PREDIV;
+
+/** RTC clock frequency seen by the prescalers, after the LSI smooth
+ * calibration. The timer periods are converted with it */
+static uint32_t lsiFrequency = RTC_LSI_NOMINAL_HZ;
+
+/** RTC clock source in use. */
+static RTC_ClockSource_t clockSource = RTC_CLOCK_LSI;
+
+/** Callbacks of the batch windows. */
+static RTC_Callback_t windowCallbackFromISR[RTC_WINDOW_NUM];
+
+/** Callback of the captured events. */
+static RTC_EventCallback_t eventCallbackFromISR;
+
+/** Timer of the LSI re-measure, and callback which requests it. */
+static RTC_Timer_t calibrationTimer;
+static RTC_Callback_t calibrationCallbackFromISR;
+
+/** Timer of the periodic alarm. */
+static RTC_Timer_t periodicAlarm;
 
 /**
- * Initialize the Real Time Counter and clean the periodic alarm.
+ * Initialize the Real Time Counter and clean the periodic alarm. The LSE is
+ * used if it starts, otherwise the LSI is measured and the prescalers and
+ * the smooth calibration are set to get a 1Hz calendar out of it.
  */
 void RTC_Init(void)
 {
+    uint32_t lsi = 0;
+
     rtcHandle.Instance = RTC;
+
+    if (RTC_StartLse())
+    {
+        clockSource = RTC_CLOCK_LSE;
+        asynchPrediv = RTC_LSE_ASYNCH_PREDIV;
+        synchPrediv = RTC_LSE_SYNCH_PREDIV;
+    }
+    else
+    {
+        clockSource = RTC_CLOCK_LSI;
+        lsi = RTC_MeasureLsi();
+
+        if (lsi > 0)
+        {
+            RTC_SelectPrescalers(lsi);
+        }
+    }
+
     rtcHandle.Init.HourFormat = RTC_HOURFORMAT_24;
-    rtcHandle.Init.AsynchPrediv = RTC_ASYNCH_PREDIV;
-    rtcHandle.Init.SynchPrediv = RTC_SYNCH_PREDIV;
+    rtcHandle.Init.AsynchPrediv = asynchPrediv;
+    rtcHandle.Init.SynchPrediv = synchPrediv;
     rtcHandle.Init.OutPut = RTC_OUTPUT_DISABLE;
     rtcHandle.Init.OutPutPolarity = RTC_OUTPUT_POLARITY_HIGH;
     rtcHandle.Init.OutPutType = RTC_OUTPUT_TYPE_OPENDRAIN;
     rtcHandle.State = HAL_RTC_STATE_RESET;
 
     ASSERT(HAL_RTC_Init(&rtcHandle) == HAL_OK);
+
+    /* Read the calendar straight from the counters, so timestamps don't have
+     * to wait for the shadow registers to resynchronize after a wake-up */
+    ASSERT(HAL_RTCEx_EnableBypassShadow(&rtcHandle) == HAL_OK);
+
+    if (clockSource == RTC_CLOCK_LSE)
+    {
+        RTC_SetLsiFrequency(RTC_LSE_HZ);
+        HAL_RTCEx_BKUPWrite(&rtcHandle, RTC_BKP_CLOCK,
+            RTC_CLOCK_RECORD(RTC_CLOCK_LSE, RTC_LSE_ACCURACY_PPM));
+        return;
+    }
+
+    if (lsi > 0)
+    {
+        RTC_SetLsiFrequency(RTC_SetSmoothCalib(lsi));
+    }
+
+    RTC_RecordClock(lsi, lsiFrequency);
+
+    RTC_StartTimer(&calibrationTimer, RTC_CALIB_PERIOD_MS, RTC_CALIB_PERIOD_MS,
+        RTC_CalibrateCallbackFromISR);
+}
+
+/**
+ * Attach to the RTC after a wake-up from the STANDBY mode, without
+ * initializing it again. The backup domain kept it running, so the
+ * prescalers and the clock source are read back from it, and the calendar
+ * isn't disturbed. The wake-up which caused the boot is acknowledged.
+ *
+ * @returns It returns true if the RTC had been initialized before the
+ *          STANDBY mode. Otherwise (or if its LSI doesn't start), it
+ *          returns false and RTC_Init shall be called.
+ */
+bool RTC_Resume(void)
+{
+    uint32_t record;
+
+    rtcHandle.Instance = RTC;
+
+    /* The backup domain write protection is set again by the reset */
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+
+    record = HAL_RTCEx_BKUPRead(&rtcHandle, RTC_BKP_CLOCK);
+
+    if (!RTC_CLOCK_RECORD_VALID(record))
+    {
+        return false;
+    }
+
+    clockSource = RTC_CLOCK_RECORD_SOURCE(record);
+
+    /* The LSI is turned off by the reset, unlike the LSE. If it doesn't
+     * start, the RTC is initialized from scratch */
+    if ((clockSource == RTC_CLOCK_LSI) && !RTC_StartLsi())
+    {
+        return false;
+    }
+
+    asynchPrediv = (RTC->PRER & RTC_PRER_PREDIV_A) >> RTC_PRER_PREDIV_A_Pos;
+    synchPrediv = (RTC->PRER & RTC_PRER_PREDIV_S) >> RTC_PRER_PREDIV_S_Pos;
+
+    /* The prescalers were selected for a calibrated 1Hz calendar */
+    RTC_SetLsiFrequency((asynchPrediv + 1) * (synchPrediv + 1));
+
+    rtcHandle.Lock = HAL_UNLOCKED;
+    rtcHandle.State = HAL_RTC_STATE_READY;
+
+    __HAL_RTC_WAKEUPTIMER_CLEAR_FLAG(&rtcHandle, RTC_FLAG_WUTF);
+    __HAL_RTC_WAKEUPTIMER_EXTI_CLEAR_FLAG();
+
+    return true;
+}
+
+/**
+ * Program the wake-up timer to wake the core up from the STANDBY mode
+ * periodically. It runs on the 1Hz calendar clock and reloads itself, so
+ * the wake-ups don't drift with the time spent awake, and it doesn't have to
+ * be programmed again after each boot. It takes the wake-up timer over from
+ * the software timers, which are all stopped.
+ *
+ * @param   period  Period of the wake-ups in seconds, from 1 to 65536.
+ */
+void RTC_SetStandbyWakeUp(uint32_t period)
+{
+    RTC_Timer_t *timer;
+    uint32_t primask;
+    uint8_t level;
+    uint8_t slot;
+
+    ASSERT((period > 0) && (period <= RTC_WUT_MAX_COUNT));
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    for (level = 0; level < RTC_WHEEL_LEVELS; level++)
+    {
+        for (slot = 0; slot < RTC_WHEEL_SLOTS; slot++)
+        {
+            while ((timer = wheel[level][slot]) != NULL)
+            {
+                RTC_TimerRemove(timer);
+            }
+        }
+    }
+
+    /* The wake-up timer expires after the reload value plus one */
+    ASSERT(HAL_RTCEx_SetWakeUpTimer_IT(&rtcHandle, period - 1,
+                RTC_WAKEUPCLOCK_CK_SPRE_16BITS) == HAL_OK);
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * Set the callback which requests the LSI to be measured again, every
+ * RTC_CALIB_PERIOD_MS. The measure takes about 8ms, so it's not run from the
+ * timer interrupt: the callback shall get RTC_Calibrate called out of it
+ * (e.g. posting an event to the main loop). Without callback, the LSI is
+ * not measured again.
+ *
+ * @param   callbackFromISR     Callback which shall be called whenever the
+ *                              LSI shall be measured again, or NULL. Note
+ *                              that this callback will be called within an
+ *                              Interrupt Service Routine (ISR).
+ */
+void RTC_SetCalibrationRequest(RTC_Callback_t callbackFromISR)
+{
+    calibrationCallbackFromISR = callbackFromISR;
+}
+
+/**
+ * Measure the LSI again and update the smooth calibration, to track the LSI
+ * drift. The prescalers are kept, so timestamps stay monotonic. Nothing is
+ * done when the RTC runs on the LSE. It takes about 8ms, so it shall not be
+ * called from an interrupt.
+ *
+ * @returns It returns true if the LSI has been measured with success.
+ *          Otherwise, it returns false.
+ */
+bool RTC_Calibrate(void)
+{
+    uint32_t lsi;
+
+    if (clockSource == RTC_CLOCK_LSE)
+    {
+        return true;
+    }
+
+    lsi = RTC_MeasureLsi();
+
+    if (lsi == 0)
+    {
+        return false;
+    }
+
+    RTC_SetLsiFrequency(RTC_SetSmoothCalib(lsi));
+    RTC_RecordClock(lsi, lsiFrequency);
+
+    return true;
+}
+
+/**
+ * Get the RTC clock source in use and its accuracy.
+ *
+ * @param   accuracy    Memory where the accuracy in ppm shall be stored, or
+ *                      NULL. For the LSI, it's the error left after the
+ *                      calibration, relative to the measurement reference.
+ *
+ * @returns It returns the RTC clock source.
+ */
+RTC_ClockSource_t RTC_GetClockSource(uint32_t *accuracy)
+{
+    uint32_t record;
+
+    if (accuracy != NULL)
+    {
+        record = HAL_RTCEx_BKUPRead(&rtcHandle, RTC_BKP_CLOCK);
+        *accuracy = RTC_CLOCK_RECORD_PPM(record);
+    }
+
+    return clockSource;
+}
+
+/**
+ * Get a monotonic timestamp from the calendar and its sub-seconds. It reads
+ * the counters directly, which takes a few tens of cycles instead of the
+ * HAL_RTC_GetTime / HAL_RTC_GetDate conversions.
+ *
+ * @returns It returns the number of ticks elapsed since 2000-01-01 00:00:00.
+ */
+RTC_Timestamp_t RTC_GetTimestamp(void)
+{
+    uint32_t ssr;
+    uint32_t tr;
+    uint32_t dr;
+
+    /* With the shadow registers bypassed, the counters might roll over
+     * between reads, in which case they are read again */
+    do
+    {
+        ssr = RTC->SSR;
+        tr = RTC->TR;
+        dr = RTC->DR;
+    }
+    while ((ssr != RTC->SSR) || (tr != RTC->TR));
+
+    return RTC_ToTimestamp(ssr, tr, dr);
+}
+
+/**
+ * Get the frequency of the timestamp ticks.
+ *
+ * @returns It returns the number of ticks per second.
+ */
+uint32_t RTC_GetTimestampFrequency(void)
+{
+    return synchPrediv + 1;
+}
+
+/**
+ * Open a batch window at a calendar time, repeated every hour or every day,
+ * on one of the RTC alarms. Heavy housekeeping (flash compaction, statistics
+ * rollup, ...) can then run in one burst at a known time, instead of being
+ * spread over the periodic wake-ups.
+ *
+ * @param   window              Window to be set.
+ * @param   repeat              Window repetition.
+ * @param   hour                Hour of the window (0-23), ignored if hourly.
+ * @param   minute              Minute of the window (0-59).
+ * @param   callbackFromISR     Callback which shall be called whenever the
+ *                              window opens. Note that this callback will
+ *                              be called within an Interrupt Service
+ *                              Routine (ISR), so the work itself should be
+ *                              deferred.
+ */
+void RTC_SetBatchWindow(RTC_Window_t window, RTC_Repeat_t repeat,
+        uint8_t hour, uint8_t minute, RTC_Callback_t callbackFromISR)
+{
+    RTC_AlarmTypeDef alarm = { 0 };
+    uint32_t primask;
+
+    ASSERT(window < RTC_WINDOW_NUM);
+    ASSERT(hour < 24);
+    ASSERT(minute < 60);
+    ASSERT(callbackFromISR);
+
+    alarm.Alarm = (window == RTC_WINDOW_A) ? RTC_ALARM_A : RTC_ALARM_B;
+    alarm.AlarmTime.Hours = (repeat == RTC_REPEAT_DAILY) ? hour : 0;
+    alarm.AlarmTime.Minutes = minute;
+    alarm.AlarmTime.Seconds = 0;
+    alarm.AlarmSubSecondMask = RTC_ALARMSUBSECONDMASK_ALL;
+    alarm.AlarmDateWeekDaySel = RTC_ALARMDATEWEEKDAYSEL_DATE;
+    alarm.AlarmDateWeekDay = 1;
+    alarm.AlarmMask = RTC_ALARMMASK_DATEWEEKDAY;
+
+    if (repeat == RTC_REPEAT_HOURLY)
+    {
+        alarm.AlarmMask |= RTC_ALARMMASK_HOURS;
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    windowCallbackFromISR[window] = callbackFromISR;
+
+    ASSERT(HAL_RTC_SetAlarm_IT(&rtcHandle, &alarm, RTC_FORMAT_BIN) == HAL_OK);
+
+    __set_PRIMASK(primask);
+
+    HAL_NVIC_SetPriority(RTC_Alarm_IRQn, 0x0F, 0);
+    HAL_NVIC_EnableIRQ(RTC_Alarm_IRQn);
+}
+
+/**
+ * Close a batch window.
+ *
+ * @param   window  Window to be cleared.
+ */
+void RTC_ClearBatchWindow(RTC_Window_t window)
+{
+    uint32_t primask;
+
+    ASSERT(window < RTC_WINDOW_NUM);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    ASSERT(HAL_RTC_DeactivateAlarm(&rtcHandle, (window == RTC_WINDOW_A)
+                ? RTC_ALARM_A : RTC_ALARM_B) == HAL_OK);
+    windowCallbackFromISR[window] = NULL;
+
+    __set_PRIMASK(primask);
+}
+
+/**
+ * Enable the hardware capture of events on the RTC timestamp pin (PC13,
+ * rising edge). The calendar and sub-seconds are latched by the RTC on the
+ * edge itself, so the timestamp doesn't include any interrupt latency.
+ *
+ * @param   callbackFromISR     Callback which shall be called with the
+ *                              timestamp of each event. Note that this
+ *                              callback will be called within an Interrupt
+ *                              Service Routine (ISR).
+ */
+void RTC_EnableEventCapture(RTC_EventCallback_t callbackFromISR)
+{
+    uint32_t primask;
+
+    ASSERT(callbackFromISR);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    eventCallbackFromISR = callbackFromISR;
+
+    ASSERT(HAL_RTCEx_SetTimeStamp_IT(&rtcHandle, RTC_TIMESTAMPEDGE_RISING,
+                RTC_TIMESTAMPPIN_DEFAULT) == HAL_OK);
+
+    __set_PRIMASK(primask);
+
+    HAL_NVIC_SetPriority(TAMP_STAMP_IRQn, 0x0F, 0);
+    HAL_NVIC_EnableIRQ(TAMP_STAMP_IRQn);
+}
+
+/**
+ * Disable the capture of events on the RTC timestamp pin.
+ */
+void RTC_DisableEventCapture(void)
+{
+    uint32_t primask;
+
+    HAL_NVIC_DisableIRQ(TAMP_STAMP_IRQn);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    ASSERT(HAL_RTCEx_DeactivateTimeStamp(&rtcHandle) == HAL_OK);
+    eventCallbackFromISR = NULL;
+
+    __set_PRIMASK(primask);
 }
 
 /**
@@ -55,54 +550,964 @@ void RTC_Init(void)
  */
 void RTC_SetPeriodicAlarm(uint32_t periodicity, RTC_Callback_t callbackFromISR)
 {
-    uint32_t reloadValue;
-    uint32_t clock;
+    RTC_StartTimer(&periodicAlarm, periodicity, periodicity, callbackFromISR);
+}
+
+/**
+ * Start a software timer, or restart it if it's already running.
+ *
+ * @param   timer               Timer to be started.
+ * @param   delay               Minimum delay in milliseconds until the
+ *                              first expiry. It's rounded up to the next
+ *                              timestamp tick, plus one for the current
+ *                              tick.
+ * @param   period              Period in milliseconds of the following
+ *                              expiries, or 0 for a one-shot timer.
+ * @param   callbackFromISR     Callback which shall be called whenever the
+ *                              timer expires. Note that this callback will
+ *                              be called within an Interrupt Service
+ *                              Routine (ISR).
+ */
+void RTC_StartTimer(RTC_Timer_t *timer, uint32_t delay, uint32_t period,
+        RTC_Callback_t callbackFromISR)
+{
+    RTC_Timestamp_t now;
+    uint32_t primask;
 
+    ASSERT(timer);
     ASSERT(callbackFromISR);
-    rtcCallbackFromISR = callbackFromISR;
 
-    if (periodicity > RTC_MAX_PERIORICITY_PRSC_CLK)
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (timer->active)
     {
-        reloadValue = RTC_MSEC_TO_TICK(periodicity, RTC_SPRE_CLOCK_HZ);
-        clock = RTC_WAKEUPCLOCK_CK_SPRE_16BITS;
+        RTC_TimerRemove(timer);
     }
-    else
+
+    now = RTC_GetTimestamp();
+
+    /* An empty wheel can jump to the current time */
+    if (wheelCount == 0)
+    {
+        wheelTime = now;
+    }
+
+    /* The delay is rounded up to whole ticks, and the current tick, which
+     * has partially elapsed already, doesn't count. So the timer never
+     * expires before the delay, and the periods count from the expiry */
+    timer->expiry = now + RTC_MsecToTicks(delay, &timer->fraction);
+
+    if (delay > 0)
     {
-        reloadValue = RTC_MSEC_TO_TICK(periodicity, RTC_WUT_PRESC_CLOCK_HZ);
-        clock = RTC_WAKEUPCLOCK_RTCCLK_DIV16;
+        timer->expiry += (timer->fraction > 0) ? 2 : 1;
     }
 
-    ASSERT(HAL_RTCEx_SetWakeUpTimer_IT(&rtcHandle, reloadValue, clock)
-                == HAL_OK);
+    timer->fraction = 0;
+    timer->callbackFromISR = callbackFromISR;
+    RTC_TimerSetPeriod(timer, period);
+
+    RTC_TimerInsert(timer);
+    RTC_TimerArm();
+
+    __set_PRIMASK(primask);
 }
 
 /**
- * Initialize the RTC clock and oscillator.
+ * Stop a software timer. Nothing happens if it isn't running.
+ *
+ * @param   timer   Timer to be stopped.
  */
-void HAL_RTC_MspInit(RTC_HandleTypeDef *rtc)
+void RTC_StopTimer(RTC_Timer_t *timer)
 {
-    RCC_OscInitTypeDef oscInit;
-    RCC_PeriphCLKInitTypeDef clkInit;
+    uint32_t primask;
 
-    oscInit.OscillatorType = RCC_OSCILLATORTYPE_LSI;
-    oscInit.PLL.PLLState = RCC_PLL_NONE;
-    oscInit.LSEState = RCC_LSE_OFF;
-    oscInit.LSIState = RCC_LSI_ON;
+    ASSERT(timer);
 
-    ASSERT(HAL_RCC_OscConfig(&oscInit) == HAL_OK);
+    primask = __get_PRIMASK();
+    __disable_irq();
 
-    clkInit.PeriphClockSelection = RCC_PERIPHCLK_RTC;
-    clkInit.RTCClockSelection = RCC_RTCCLKSOURCE_LSI;
+    if (timer->active)
+    {
+        RTC_TimerRemove(timer);
+        RTC_TimerArm();
+    }
 
-    ASSERT(HAL_RCCEx_PeriphCLKConfig(&clkInit) == HAL_OK);
+    __set_PRIMASK(primask);
+}
 
-    __HAL_RCC_RTC_ENABLE();
+/**
+ * Set the measured LSI frequency, which the timer periods are converted
+ * with. Running timers take the new frequency from their next period on.
+ *
+ * @param   frequency   LSI frequency in Hertz.
+ */
+void RTC_SetLsiFrequency(uint32_t frequency)
+{
+    RTC_Timer_t *timer;
+    uint32_t primask;
+    uint8_t level;
+    uint8_t slot;
 
-    HAL_NVIC_SetPriority(RTC_WKUP_IRQn, 0x0F, 0);
-    HAL_NVIC_EnableIRQ(RTC_WKUP_IRQn);
+    ASSERT(frequency > 0);
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    lsiFrequency = frequency;
+
+    for (level = 0; level < RTC_WHEEL_LEVELS; level++)
+    {
+        for (slot = 0; slot < RTC_WHEEL_SLOTS; slot++)
+        {
+            for (timer = wheel[level][slot]; timer; timer = timer->next)
+            {
+                RTC_TimerSetPeriod(timer, timer->period);
+            }
+        }
+    }
+
+    __set_PRIMASK(primask);
 }
 
-void HAL_RTCEx_WakeUpTimerEventCallback(RTC_HandleTypeDef *hrtc)
+/**
+ * Insert a timer into the wheel, on the level which its distance from the
+ * wheel time falls into.
+ *
+ * @param   timer   Timer to be inserted.
+ */
+static void RTC_TimerInsert(RTC_Timer_t *timer)
+{
+    RTC_Timestamp_t delta = 0;
+    uint8_t level = 0;
+    uint8_t slot;
+
+    if (timer->expiry > wheelTime)
+    {
+        delta = timer->expiry - wheelTime;
+    }
+
+    if (delta > RTC_WHEEL_MAX_DELTA)
+    {
+        delta = RTC_WHEEL_MAX_DELTA;
+    }
+
+    while ((delta >> ((level + 1) * RTC_WHEEL_SLOT_BITS)) != 0)
+    {
+        level++;
+    }
+
+    slot = ((wheelTime + delta) >> (level * RTC_WHEEL_SLOT_BITS))
+        & RTC_WHEEL_SLOT_MASK;
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = wheel[level][slot];
+
+    if (timer->next != NULL)
+    {
+        timer->next->prev = timer;
+    }
+
+    wheel[level][slot] = timer;
+    wheelOccupied[level] |= (1UL << slot);
+    wheelCount++;
+    timer->active = true;
+}
+
+/**
+ * Remove a timer from the wheel.
+ *
+ * @param   timer   Timer to be removed.
+ */
+static void RTC_TimerRemove(RTC_Timer_t *timer)
+{
+    if (timer->prev != NULL)
+    {
+        timer->prev->next = timer->next;
+    }
+    else
+    {
+        wheel[timer->level][timer->slot] = timer->next;
+
+        if (timer->next == NULL)
+        {
+            wheelOccupied[timer->level] &= ~(1UL << timer->slot);
+        }
+    }
+
+    if (timer->next != NULL)
+    {
+        timer->next->prev = timer->prev;
+    }
+
+    wheelCount--;
+    timer->active = false;
+}
+
+/**
+ * Get the next event of a wheel level.
+ *
+ * @param   level   Wheel level.
+ * @param   time    Memory where the time of the next event shall be stored.
+ *
+ * @returns It returns true if the level holds any timer. Otherwise, it
+ *          returns false.
+ */
+static bool RTC_TimerLevelEvent(uint8_t level, RTC_Timestamp_t *time)
+{
+    uint8_t shift = level * RTC_WHEEL_SLOT_BITS;
+    uint32_t pending;
+    uint32_t distance;
+
+    if (wheelOccupied[level] == 0)
+    {
+        return false;
+    }
+
+    /* Rotate the slots so that the current one is the bit 0 */
+    pending = RTC_RotateRight(wheelOccupied[level],
+        (wheelTime >> shift) & RTC_WHEEL_SLOT_MASK);
+
+    if (level == 0)
+    {
+        /* First level slots expire exactly, the current one right now */
+        *time = wheelTime + __CLZ(__RBIT(pending));
+    }
+    else
+    {
+        /* Upper level slots are cascaded as the level below wraps into them,
+         * so the current one only after a whole turn */
+        pending >>= 1;
+        distance = pending ? (__CLZ(__RBIT(pending)) + 1) : RTC_WHEEL_SLOTS;
+        *time = ((wheelTime >> shift) + distance) << shift;
+    }
+
+    return true;
+}
+
+/**
+ * Advance the wheel up to a given time, expiring the timers and cascading
+ * the upper level slots on the way. The callbacks of the expired timers are
+ * handed back rather than called, as the wheel shall only be changed with
+ * the interrupts disabled, and the callbacks shall not run that way. The
+ * wheel stops short of the time once RTC_EXPIRED_MAX timers have expired.
+ *
+ * @param   now         Time to advance the wheel to.
+ * @param   expired     Memory where the callbacks of the expired timers
+ *                      shall be stored, in expiry order.
+ *
+ * @returns It returns the number of expired timers. If it's
+ *          RTC_EXPIRED_MAX, more timers might be due.
+ */
+static uint32_t RTC_TimerAdvance(RTC_Timestamp_t now,
+        RTC_Callback_t expired[RTC_EXPIRED_MAX])
+{
+    RTC_Timestamp_t times[RTC_WHEEL_LEVELS];
+    bool pending[RTC_WHEEL_LEVELS];
+    RTC_Timestamp_t next;
+    uint32_t tickDivider = (asynchPrediv + 1) * 1000;
+    uint32_t count = 0;
+    RTC_Timer_t *timer;
+    uint8_t slot;
+    int8_t level;
+
+    while (wheelCount > 0)
+    {
+        next = UINT64_MAX;
+
+        for (level = 0; level < RTC_WHEEL_LEVELS; level++)
+        {
+            pending[level] = RTC_TimerLevelEvent(level, &times[level]);
+
+            if (pending[level] && (times[level] < next))
+            {
+                next = times[level];
+            }
+        }
+
+        if (next > now)
+        {
+            break;
+        }
+
+        /* The wheel moves in one step to the next event, as no slot is
+         * crossed in between. Upper levels are handled first, as their
+         * timers might cascade into the first level slot due now */
+        wheelTime = next;
+
+        for (level = RTC_WHEEL_LEVELS - 1; level >= 0; level--)
+        {
+            if (!pending[level] || (times[level] != next))
+            {
+                continue;
+            }
+
+            slot = (next >> (level * RTC_WHEEL_SLOT_BITS))
+                & RTC_WHEEL_SLOT_MASK;
+
+            while ((timer = wheel[level][slot]) != NULL)
+            {
+                /* The rest of the slot stays due, for the next round */
+                if ((level == 0) && (count == RTC_EXPIRED_MAX))
+                {
+                    return count;
+                }
+
+                RTC_TimerRemove(timer);
+
+                if (level > 0)
+                {
+                    RTC_TimerInsert(timer);
+                    continue;
+                }
+
+                /* Carry the fractions of tick over, so the average period
+                 * is exact however it's truncated to ticks */
+                if (timer->period > 0)
+                {
+                    timer->expiry += timer->step;
+                    timer->fraction += timer->stepFraction;
+
+                    if (timer->fraction >= tickDivider)
+                    {
+                        timer->fraction -= tickDivider;
+                        timer->expiry++;
+                    }
+
+                    RTC_TimerInsert(timer);
+                }
+
+                expired[count++] = timer->callbackFromISR;
+            }
+        }
+    }
+
+    if (now > wheelTime)
+    {
+        wheelTime = now;
+    }
+
+    return count;
+}
+
+/**
+ * Get the first expiry of the timers of an upper level slot.
+ *
+ * @param   level   Wheel level.
+ * @param   time    Time the slot is cascaded at.
+ *
+ * @returns It returns the first expiry, or the cascade time if it's
+ *          already due.
+ */
+static RTC_Timestamp_t RTC_TimerSlotExpiry(uint8_t level,
+        RTC_Timestamp_t time)
+{
+    RTC_Timestamp_t expiry = UINT64_MAX;
+    const RTC_Timer_t *timer;
+
+    timer = wheel[level][(time >> (level * RTC_WHEEL_SLOT_BITS))
+        & RTC_WHEEL_SLOT_MASK];
+
+    while (timer != NULL)
+    {
+        if (timer->expiry < expiry)
+        {
+            expiry = timer->expiry;
+        }
+
+        timer = timer->next;
+    }
+
+    return (expiry > time) ? expiry : time;
+}
+
+/**
+ * Program the wake-up timer to the next event of the wheel, or stop it if
+ * there's no timer running.
+ */
+static void RTC_TimerArm(void)
+{
+    RTC_Timestamp_t next = UINT64_MAX;
+    RTC_Timestamp_t time;
+    RTC_Timestamp_t now;
+    uint64_t count = 1;
+    uint8_t level;
+
+    if (wheelCount == 0)
+    {
+        ASSERT(HAL_RTCEx_DeactivateWakeUpTimer(&rtcHandle) == HAL_OK);
+        return;
+    }
+
+    for (level = 0; level < RTC_WHEEL_LEVELS; level++)
+    {
+        if (!RTC_TimerLevelEvent(level, &time))
+        {
+            continue;
+        }
+
+        /* Cascading an upper level slot is not worth a wake-up of its own,
+         * it's done on the way to the first of its timers */
+        if (level > 0)
+        {
+            time = RTC_TimerSlotExpiry(level, time);
+        }
+
+        if (time < next)
+        {
+            next = time;
+        }
+    }
+
+    /* A tick lasts (asynchPrediv + 1) / 16 wake-up timer counts. Round up,
+     * so the wake-up doesn't come before the event */
+    now = RTC_GetTimestamp();
+
+    if (next > now)
+    {
+        count = ((next - now) * (asynchPrediv + 1) + RTC_WUT_DIVIDER - 1)
+            / RTC_WUT_DIVIDER;
+    }
+
+    if (count > RTC_WUT_MAX_COUNT)
+    {
+        count = RTC_WUT_MAX_COUNT;
+    }
+
+    /* The wake-up timer expires after the reload value plus one */
+    ASSERT(HAL_RTCEx_SetWakeUpTimer_IT(&rtcHandle, count - 1,
+                RTC_WAKEUPCLOCK_RTCCLK_DIV16) == HAL_OK);
+}
+
+/**
+ * Rotate a value to the right.
+ *
+ * @param   value   Value to be rotated.
+ * @param   shift   Number of bits to rotate, from 0 to 31.
+ *
+ * @returns It returns the rotated value.
+ */
+static uint32_t RTC_RotateRight(uint32_t value, uint32_t shift)
+{
+    if (shift == 0)
+    {
+        return value;
+    }
+
+    return (value >> shift) | (value << (32 - shift));
+}
+
+/**
+ * Convert milliseconds into timestamp ticks at the LSI frequency. A
+ * millisecond lasts LSI / ((asynchPrediv + 1) * 1000) ticks.
+ *
+ * @param   msec        Milliseconds to be converted.
+ * @param   fraction    Memory where the remaining fraction of tick shall be
+ *                      stored, in 1 / ((asynchPrediv + 1) * 1000).
+ *
+ * @returns It returns the whole number of ticks.
+ */
+static uint64_t RTC_MsecToTicks(uint32_t msec, uint32_t *fraction)
+{
+    uint64_t scaled = (uint64_t) msec * lsiFrequency;
+    uint32_t tickDivider = (asynchPrediv + 1) * 1000;
+
+    *fraction = scaled % tickDivider;
+
+    return scaled / tickDivider;
+}
+
+/**
+ * Start the LSE in low drive mode, within a bounded time. If an earlier boot
+ * recorded that the LSE didn't start, it's not tried again until the backup
+ * domain is reset, so boards without crystal boot quickly.
+ *
+ * @returns It returns true if the LSE is running. Otherwise, it returns
+ *          false.
+ */
+static bool RTC_StartLse(void)
+{
+    uint32_t record;
+    uint32_t tickstart;
+
+    record = HAL_RTCEx_BKUPRead(&rtcHandle, RTC_BKP_CLOCK);
+
+    if (RTC_CLOCK_RECORD_VALID(record)
+            && (RTC_CLOCK_RECORD_SOURCE(record) == RTC_CLOCK_LSI))
+    {
+        return false;
+    }
+
+    __HAL_RCC_PWR_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+
+    if (__HAL_RCC_GET_FLAG(RCC_FLAG_LSERDY) != RESET)
+    {
+        return true;
+    }
+
+    HAL_RCCEx_SelectLSEMode(RCC_LSE_LOWPOWER_MODE);
+    __HAL_RCC_LSE_CONFIG(RCC_LSE_ON);
+
+    tickstart = HAL_GetTick();
+
+    while (__HAL_RCC_GET_FLAG(RCC_FLAG_LSERDY) == RESET)
+    {
+        if ((HAL_GetTick() - tickstart) > RTC_LSE_STARTUP_TIMEOUT_MS)
+        {
+            __HAL_RCC_LSE_CONFIG(RCC_LSE_OFF);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Start the LSI, within a bounded time. The wait is counted in loops, as it
+ * may happen before the HAL tick runs.
+ *
+ * @returns It returns true if the LSI is running. Otherwise, it returns
+ *          false.
+ */
+static bool RTC_StartLsi(void)
+{
+    uint32_t count;
+
+    __HAL_RCC_LSI_ENABLE();
+
+    count = RTC_LSI_STARTUP_TIMEOUT_MS * (SystemCoreClock / 32U / 1000U);
+
+    while (__HAL_RCC_GET_FLAG(RCC_FLAG_LSIRDY) == RESET)
+    {
+        if (count-- == 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Record the LSI as the clock source in the backup registers, with its
+ * accuracy and measured frequency.
+ *
+ * @param   lsi         Measured LSI frequency in Hertz, or 0 if unknown.
+ * @param   frequency   LSI frequency seen by the prescalers, after the smooth
+ *                      calibration.
+ */
+static void RTC_RecordClock(uint32_t lsi, uint32_t frequency)
+{
+    uint32_t target = (asynchPrediv + 1) * (synchPrediv + 1);
+    uint32_t error;
+    uint32_t ppm = RTC_ACCURACY_UNKNOWN;
+
+    if (lsi > 0)
+    {
+        error = (frequency > target) ? (frequency - target)
+            : (target - frequency);
+        ppm = ((uint64_t) error * 1000000 + target / 2) / target;
+
+        if (ppm > RTC_ACCURACY_UNKNOWN)
+        {
+            ppm = RTC_ACCURACY_UNKNOWN;
+        }
+    }
+
+    HAL_RTCEx_BKUPWrite(&rtcHandle, RTC_BKP_CLOCK,
+        RTC_CLOCK_RECORD(RTC_CLOCK_LSI, ppm));
+    HAL_RTCEx_BKUPWrite(&rtcHandle, RTC_BKP_LSI_FREQUENCY, lsi);
+}
+
+/**
+ * Measure the LSI frequency against the timer clock, which derives from the
+ * HSI or HSE, through the TIM5 channel 4 input capture.
+ *
+ * @returns It returns the LSI frequency in Hertz, or 0 if the LSI couldn't
+ *          be captured.
+ */
+static uint32_t RTC_MeasureLsi(void)
+{
+    uint32_t timerClock;
+    uint32_t first = 0;
+    uint32_t last = 0;
+    uint32_t capture;
+    uint32_t count;
+
+    if (!RTC_StartLsi())
+    {
+        return 0;
+    }
+
+    /* Timers run at twice the APB1 clock when it's prescaled */
+    timerClock = HAL_RCC_GetPCLK1Freq();
+
+    if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1)
+    {
+        timerClock *= 2;
+    }
+
+    /* Free running 32-bit counter, LSI remapped onto TI4 */
+    __HAL_RCC_TIM5_CLK_ENABLE();
+    TIM5->CR1 = 0;
+    TIM5->PSC = 0;
+    TIM5->ARR = 0xFFFFFFFF;
+    TIM5->OR = TIM_OR_TI4_RMP_0;
+    TIM5->CCMR2 = TIM_CCMR2_CC4S_0 | TIM_CCMR2_IC4PSC;
+    TIM5->CCER = TIM_CCER_CC4E;
+    TIM5->EGR = TIM_EGR_UG;
+    TIM5->SR = 0;
+    TIM5->CR1 = TIM_CR1_CEN;
+
+    for (capture = 0; capture <= RTC_LSI_CAPTURES; capture++)
+    {
+        count = RTC_LSI_CAPTURE_TIMEOUT_MS * (SystemCoreClock / 32U / 1000U);
+
+        while (((TIM5->SR & TIM_SR_CC4IF) == 0) && (count > 0))
+        {
+            count--;
+        }
+
+        if (count == 0)
+        {
+            break;
+        }
+
+        /* Reading the capture also clears its flag */
+        last = TIM5->CCR4;
+
+        if (capture == 0)
+        {
+            first = last;
+        }
+    }
+
+    TIM5->CR1 = 0;
+    TIM5->CCER = 0;
+    __HAL_RCC_TIM5_CLK_DISABLE();
+
+    if ((count == 0) || (last == first))
+    {
+        return 0;
+    }
+
+    return ((uint64_t) timerClock * RTC_LSI_CAPTURE_PRESCALER
+                * RTC_LSI_CAPTURES + (last - first) / 2) / (last - first);
+}
+
+/**
+ * Select the prescalers which divide the LSI the closest to 1Hz. The smooth
+ * calibration takes care of the rest.
+ *
+ * @param   lsi     LSI frequency in Hertz.
+ */
+static void RTC_SelectPrescalers(uint32_t lsi)
+{
+    uint32_t bestError = UINT32_MAX;
+    uint32_t asynch;
+    uint32_t synch;
+    uint32_t error;
+
+    for (asynch = RTC_ASYNCH_PREDIV_MAX + 1; asynch > RTC_ASYNCH_PREDIV_MIN;
+            asynch--)
+    {
+        synch = (lsi + asynch / 2) / asynch;
+        error = (asynch * synch > lsi) ? (asynch * synch - lsi)
+            : (lsi - asynch * synch);
+
+        if (error < bestError)
+        {
+            bestError = error;
+            asynchPrediv = asynch - 1;
+            synchPrediv = synch - 1;
+        }
+
+        if (error == 0)
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * Set the smooth calibration which brings the LSI to the frequency the
+ * prescalers divide down to 1Hz, within the calibration range (about
+ * -487ppm to +488ppm).
+ *
+ * @param   lsi     LSI frequency in Hertz.
+ *
+ * @returns It returns the LSI frequency seen by the prescalers, after the
+ *          calibration.
+ */
+static uint32_t RTC_SetSmoothCalib(uint32_t lsi)
+{
+    int64_t target = (int64_t) (asynchPrediv + 1) * (synchPrediv + 1);
+    int32_t pulses;
+    uint32_t plusPulses = RTC_SMOOTHCALIB_PLUSPULSES_RESET;
+    uint32_t minusPulses;
+    uint32_t primask;
+
+    /* Pulses to add over the calibration window, which are 512 added at once
+     * less the ones masked */
+    pulses = ((target - lsi) * (int64_t) RTC_SMOOTH_CALIB_WINDOW)
+        / (int64_t) lsi;
+
+    if (pulses > RTC_SMOOTH_CALIB_PLUS_PULSES)
+    {
+        pulses = RTC_SMOOTH_CALIB_PLUS_PULSES;
+    }
+    else if (pulses < -RTC_SMOOTH_CALIB_MAX_MINUS)
+    {
+        pulses = -RTC_SMOOTH_CALIB_MAX_MINUS;
+    }
+
+    if (pulses > 0)
+    {
+        plusPulses = RTC_SMOOTHCALIB_PLUSPULSES_SET;
+        minusPulses = RTC_SMOOTH_CALIB_PLUS_PULSES - pulses;
+    }
+    else
+    {
+        minusPulses = -pulses;
+    }
+
+    /* The handle is locked by the HAL, so the wake-up timer interrupt
+     * shall not use it in between */
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    ASSERT(HAL_RTCEx_SetSmoothCalib(&rtcHandle, RTC_SMOOTHCALIB_PERIOD_32SEC,
+                plusPulses, minusPulses) == HAL_OK);
+
+    __set_PRIMASK(primask);
+
+    return lsi + ((int64_t) lsi * pulses) / (int64_t) RTC_SMOOTH_CALIB_WINDOW;
+}
+
+/**
+ * Callback which is called by the LSI re-measure timer, which only requests
+ * the measure.
+ *
+ * @note    This callback is called within an ISR context.
+ */
+static void RTC_CalibrateCallbackFromISR(void)
+{
+    RTC_Callback_t callbackFromISR = calibrationCallbackFromISR;
+
+    if (callbackFromISR != NULL)
+    {
+        callbackFromISR();
+    }
+}
+
+/**
+ * Set the period of a timer, as a whole number of ticks and a fraction.
+ *
+ * @param   timer   Timer to be set.
+ * @param   period  Period in milliseconds, or 0 for a one-shot timer.
+ */
+static void RTC_TimerSetPeriod(RTC_Timer_t *timer, uint32_t period)
+{
+    timer->period = period;
+    timer->step = RTC_MsecToTicks(period, &timer->stepFraction);
+
+    /* Periods shorter than a tick would never leave the current slot */
+    if ((period > 0) && (timer->step == 0))
+    {
+        timer->step = 1;
+        timer->stepFraction = 0;
+    }
+}
+
+/**
+ * Convert calendar register values into a timestamp.
+ *
+ * @param   ssr     Sub-second register value.
+ * @param   tr      Time register value.
+ * @param   dr      Date register value.
+ *
+ * @returns It returns the number of ticks elapsed since 2000-01-01 00:00:00.
+ */
+static RTC_Timestamp_t RTC_ToTimestamp(uint32_t ssr, uint32_t tr, uint32_t dr)
+{
+    uint32_t seconds;
+
+    seconds = RTC_BCD_FIELD(tr, RTC_TR_HT, RTC_TR_HU) * 3600
+        + RTC_BCD_FIELD(tr, RTC_TR_MNT, RTC_TR_MNU) * 60
+        + RTC_BCD_FIELD(tr, RTC_TR_ST, RTC_TR_SU);
+
+    /* The sub-second counter counts down from the synchronous prescaler */
+    return ((RTC_Timestamp_t) RTC_DaysSince2000(dr) * RTC_SECONDS_PER_DAY
+                + seconds) * (synchPrediv + 1)
+        + (synchPrediv - (ssr & RTC_SSR_SS));
+}
+
+/**
+ * Convert the calendar date into the number of days since 2000-01-01.
+ *
+ * @param   dr      Date register value.
+ *
+ * @returns It returns the number of days.
+ */
+static uint32_t RTC_DaysSince2000(uint32_t dr)
+{
+    static const uint16_t daysBeforeMonth[] =
+        { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+    uint32_t year = RTC_BCD_FIELD(dr, RTC_DR_YT, RTC_DR_YU);
+    uint32_t month = RTC_BCD_FIELD(dr, RTC_DR_MT, RTC_DR_MU);
+    uint32_t day = RTC_BCD_FIELD(dr, RTC_DR_DT, RTC_DR_DU);
+    uint32_t days;
+
+    /* Every fourth year is a leap year within 2000..2099 */
+    days = year * 365 + (year + 3) / 4 + daysBeforeMonth[month - 1] + day - 1;
+
+    if (((year % 4) == 0) && (month > 2))
+    {
+        days++;
+    }
+
+    return days;
+}
+
+/**
+ * Initialize the RTC clock and oscillator. The LSE has already been started
+ * if it's the clock source, in which case the LSI is turned off.
+ */
+void HAL_RTC_MspInit(RTC_HandleTypeDef *rtc)
+{
+    RCC_OscInitTypeDef oscInit;
+    RCC_PeriphCLKInitTypeDef clkInit;
+
+    oscInit.OscillatorType = RCC_OSCILLATORTYPE_LSI;
+    oscInit.PLL.PLLState = RCC_PLL_NONE;
+    oscInit.LSIState = (clockSource == RTC_CLOCK_LSI) ? RCC_LSI_ON
+        : RCC_LSI_OFF;
+
+    ASSERT(HAL_RCC_OscConfig(&oscInit) == HAL_OK);
+
+    clkInit.PeriphClockSelection = RCC_PERIPHCLK_RTC;
+    clkInit.RTCClockSelection = (clockSource == RTC_CLOCK_LSE)
+        ? RCC_RTCCLKSOURCE_LSE : RCC_RTCCLKSOURCE_LSI;
+
+    ASSERT(HAL_RCCEx_PeriphCLKConfig(&clkInit) == HAL_OK);
+
+    __HAL_RCC_RTC_ENABLE();
+
+    HAL_NVIC_SetPriority(RTC_WKUP_IRQn, 0x0F, 0);
+    HAL_NVIC_EnableIRQ(RTC_WKUP_IRQn);
+}
+
+/**
+ * Expire the timers due and program the wake-up timer to the next event.
+ * Higher priority interrupts start and stop timers, so the wheel is only
+ * changed with the interrupts disabled, and the callbacks are called once
+ * they are enabled again.
+ */
+void HAL_RTCEx_WakeUpTimerEventCallback(RTC_HandleTypeDef *hrtc)
+{
+    RTC_Callback_t expired[RTC_EXPIRED_MAX];
+    uint32_t primask;
+    uint32_t count;
+    uint32_t index;
+
+    do
+    {
+        primask = __get_PRIMASK();
+        __disable_irq();
+
+        count = RTC_TimerAdvance(RTC_GetTimestamp(), expired);
+        RTC_TimerArm();
+
+        __set_PRIMASK(primask);
+
+        for (index = 0; index < count; index++)
+        {
+            expired[index]();
+        }
+    }
+    while (count == RTC_EXPIRED_MAX);
+}
+
+/**
+ * Open the batch window of the Alarm A.
+ */
+void HAL_RTC_AlarmAEventCallback(RTC_HandleTypeDef *hrtc)
+{
+    RTC_Callback_t callbackFromISR = windowCallbackFromISR[RTC_WINDOW_A];
+
+    if (callbackFromISR != NULL)
+    {
+        callbackFromISR();
+    }
+}
+
+/**
+ * Open the batch window of the Alarm B.
+ */
+void HAL_RTCEx_AlarmBEventCallback(RTC_HandleTypeDef *hrtc)
+{
+    RTC_Callback_t callbackFromISR = windowCallbackFromISR[RTC_WINDOW_B];
+
+    if (callbackFromISR != NULL)
+    {
+        callbackFromISR();
+    }
+}
+
+/**
+ * Interrupt Service Routine (ISR) of the RTC alarms.
+ */
+void RTC_Alarm_IRQHandler(void)
+{
+    HAL_RTC_AlarmIRQHandler(&rtcHandle);
+}
+
+/**
+ * Convert the captured event into a timestamp and pass it on.
+ */
+void HAL_RTCEx_TimeStampEventCallback(RTC_HandleTypeDef *hrtc)
+{
+    RTC_EventCallback_t callbackFromISR = eventCallbackFromISR;
+    uint32_t tsdr = RTC->TSDR;
+    uint32_t dr = RTC->DR;
+    uint32_t year;
+
+    /* The timestamp date has no year, so it's taken from the calendar. An
+     * event latched last year shows a later month than the calendar */
+    year = RTC_BCD_FIELD(dr, RTC_DR_YT, RTC_DR_YU);
+
+    if (RTC_BCD_FIELD(tsdr, RTC_DR_MT, RTC_DR_MU)
+            > RTC_BCD_FIELD(dr, RTC_DR_MT, RTC_DR_MU))
+    {
+        year = (year + 99) % 100;
+    }
+
+    tsdr |= ((year / 10) << RTC_DR_YT_Pos) | ((year % 10) << RTC_DR_YU_Pos);
+
+    /* Events on top of a pending one are lost, only the first is kept */
+    __HAL_RTC_TIMESTAMP_CLEAR_FLAG(hrtc, RTC_FLAG_TSOVF);
+
+    if (callbackFromISR != NULL)
+    {
+        callbackFromISR(RTC_ToTimestamp(RTC->TSSSR, RTC->TSTR, tsdr));
+    }
+}
+
+/**
+ * Interrupt Service Routine (ISR) of the RTC timestamp and tamper events.
+ */
+void TAMP_STAMP_IRQHandler(void)
+{
+    HAL_RTCEx_TamperTimeStampIRQHandler(&rtcHandle);
+}
+
+/**
+ * Interrupt Service Routine (ISR) of the RTC wake-up timer.
+ */
+void RTC_WKUP_IRQHandler(void)
 {
-    rtcCallbackFromISR();
+    HAL_RTCEx_WakeUpTimerIRQHandler(&rtcHandle);
 }
@@ -0,0 +1,237 @@
+/**
+ * @brief   Run-to-completion scheduler. Interrupts post events, which are
+ *          dispatched to their handlers from the main loop by priority.
+ *
+ * Each priority level has its own queue. Posting reserves a slot with an
+ * exclusive access (LDREX/STREX), so interrupts of any priority can post
+ * without disabling the others, and marks it ready once it's written. Only
+ * the main loop takes events out, one at a time, always from the highest
+ * priority queue holding any. Each handler runs to completion before the
+ * next event is taken, and the core only idles with all queues empty.
+ */
+
+#include "sched.h"
+#include "assert.h"
+#include "stm32f4xx_hal.h"
+#include <string.h>
+
+#define SCHED_QUEUE_MASK                (SCHED_QUEUE_SIZE - 1)
+
+/** Queued event. */
+typedef struct
+{
+    volatile bool ready;        /**< Whether the event has been written. */
+    uint8_t event;              /**< Event type. */
+    uint32_t param;             /**< Event parameter. */
+
+} Sched_Entry_t;
+
+/** Event queue of a priority level. Indexes are free running. */
+typedef struct
+{
+    Sched_Entry_t entries[SCHED_QUEUE_SIZE];
+    volatile uint32_t head;     /**< Next entry to be taken. */
+    volatile uint32_t tail;     /**< Next entry to be reserved. */
+
+} Sched_Queue_t;
+
+static bool Sched_Take(Sched_Entry_t *entry);
+static void Sched_CountDropped(void);
+
+/** Handler and priority of each event type. */
+static Sched_Handler_t handlers[SCHED_EVENTS];
+static uint8_t priorities[SCHED_EVENTS];
+
+static Sched_Queue_t queues[SCHED_PRIORITIES];
+
+/** Events dropped because their queue was full. */
+static volatile uint32_t dropped;
+
+/**
+ * Initialize the scheduler, with no subscribed event.
+ */
+void Sched_Init(void)
+{
+    memset(handlers, 0, sizeof(handlers));
+    memset(priorities, 0, sizeof(priorities));
+    memset(queues, 0, sizeof(queues));
+    dropped = 0;
+}
+
+/**
+ * Subscribe a handler to an event type. Each type has a single handler.
+ *
+ * @param   event       Event type, from 0 to SCHED_EVENTS - 1.
+ * @param   priority    Priority of the event, from 0 (highest) to
+ *                      SCHED_PRIORITIES - 1.
+ * @param   handler     Handler which shall be called with the parameter of
+ *                      each event posted, from the main loop.
+ */
+void Sched_Subscribe(uint8_t event, uint8_t priority, Sched_Handler_t handler)
+{
+    ASSERT(event < SCHED_EVENTS);
+    ASSERT(priority < SCHED_PRIORITIES);
+    ASSERT(handler);
+
+    priorities[event] = priority;
+    handlers[event] = handler;
+}
+
+/**
+ * Post an event, to be handled after the events of the same or higher
+ * priority already posted. This function may be called from any context.
+ *
+ * @param   event   Event type.
+ * @param   param   Parameter handed to the event handler.
+ *
+ * @returns It returns 'true' if the event has been queued. Otherwise, it
+ *          returns 'false' (the queue of its priority is full).
+ */
+bool Sched_Post(uint8_t event, uint32_t param)
+{
+    Sched_Queue_t *queue;
+    Sched_Entry_t *entry;
+    uint32_t tail;
+
+    ASSERT(event < SCHED_EVENTS);
+    ASSERT(handlers[event]);
+
+    queue = &queues[priorities[event]];
+
+    /* Reserve a slot. An interrupt which posts in between makes the store
+     * fail, so the tail is read again */
+    do
+    {
+        tail = __LDREXW(&queue->tail);
+
+        if ((tail - queue->head) >= SCHED_QUEUE_SIZE)
+        {
+            __CLREX();
+            Sched_CountDropped();
+            return false;
+        }
+    }
+    while (__STREXW(tail + 1, &queue->tail) != 0);
+
+    entry = &queue->entries[tail & SCHED_QUEUE_MASK];
+    entry->event = event;
+    entry->param = param;
+
+    /* The event shall be written before it's seen as ready */
+    __DMB();
+    entry->ready = true;
+
+    return true;
+}
+
+/**
+ * Run the main loop, which never returns. Pending events are handled one by
+ * one, the highest priority first. When none is pending, the idle hook is
+ * called with the interrupts disabled, so an event posted right after the
+ * check isn't slept over.
+ *
+ * @param   idle    Idle hook, or NULL to wait for interrupts.
+ */
+void Sched_Run(Sched_Idle_t idle)
+{
+    Sched_Entry_t entry;
+    bool taken;
+
+    while (1)
+    {
+        __disable_irq();
+
+        taken = Sched_Take(&entry);
+
+        if (!taken)
+        {
+            /* WFI wakes up on a pending interrupt even while they are
+             * masked, which is taken right after */
+            if (idle)
+            {
+                idle();
+            }
+            else
+            {
+                __WFI();
+            }
+        }
+
+        __enable_irq();
+
+        if (taken)
+        {
+            handlers[entry.event](entry.param);
+        }
+    }
+}
+
+/**
+ * Get the number of events dropped because their queue was full.
+ *
+ * @returns It returns the number of dropped events.
+ */
+uint32_t Sched_GetDropped(void)
+{
+    return dropped;
+}
+
+/**
+ * Take the next ready event out of the highest priority queue holding any.
+ *
+ * @param   entry   Memory where the event shall be stored.
+ *
+ * @returns It returns 'true' if an event has been taken. Otherwise, it
+ *          returns 'false'.
+ */
+static bool Sched_Take(Sched_Entry_t *entry)
+{
+    Sched_Queue_t *queue;
+    Sched_Entry_t *slot;
+    uint8_t priority;
+
+    for (priority = 0; priority < SCHED_PRIORITIES; priority++)
+    {
+        queue = &queues[priority];
+
+        if (queue->head == queue->tail)
+        {
+            continue;
+        }
+
+        slot = &queue->entries[queue->head & SCHED_QUEUE_MASK];
+
+        /* Reserved, but not written yet by the interrupt which posts it */
+        if (!slot->ready)
+        {
+            continue;
+        }
+
+        *entry = *slot;
+        slot->ready = false;
+
+        /* The slot shall be released only once it has been read */
+        __DMB();
+        queue->head++;
+
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Count an event dropped because its queue was full. Interrupts of any
+ * priority may drop events, so the counter is incremented with an exclusive
+ * access, as the queue tails are.
+ */
+static void Sched_CountDropped(void)
+{
+    uint32_t count;
+
+    do
+    {
+        count = __LDREXW(&dropped);
+    }
+    while (__STREXW(count + 1, &dropped) != 0);
+}
@@ -0,0 +1,178 @@
+/**
+ * @brief   Host benchmark of the I2C bus driver: the cost of a FIFO burst on
+ *          each path, and of streaming the accelerometer, per sample.
+ *
+ * The bus time and the traffic come from the bus model. The cycles are the
+ * ones the driver profiles with the DWT counter; on the host, the counter
+ * only moves with the register accesses and the exceptions, so they compare
+ * the paths rather than predict the target. The results are printed as the
+ * markdown table the README publishes.
+ */
+
+#include "board.h"
+#include "sim.h"
+#include "bus.h"
+#include "lis2de12_model.h"
+#include "lis2de12.h"
+#include "i2cbus.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_BURSTS                100
+#define BENCH_BURST_SAMPLES         LIS2DE12_STREAM_WATERMARK
+#define BENCH_STREAM_TIME           SIM_S(10)
+#define BENCH_STREAM_SIZE           (2 * LIS2DE12_STREAM_WATERMARK)
+
+/** Counters taken before and after a run. */
+typedef struct
+{
+    Bus_Stats_t bus;
+    I2CBus_Profile_t profile;
+    uint64_t interrupts;
+
+} Bench_Snapshot_t;
+
+static void StreamCallbackFromISR(const LIS2DE12_Sample_t *samples,
+        uint16_t count);
+
+static LIS2DE12_Sample_t streamBuffer[BENCH_STREAM_SIZE];
+static uint32_t streamed;
+
+/**
+ * Take the counters, and the interrupts of the bus (I2C and DMA).
+ */
+static void Bench_Take(I2CBus_Path_t path, Bench_Snapshot_t *snapshot)
+{
+    Sim_WakeStats_t wakes;
+
+    Bus_GetStats(&snapshot->bus);
+    I2CBus_GetProfile(path, &snapshot->profile);
+    Sim_GetWakeStats(&wakes);
+
+    snapshot->interrupts =
+        wakes.interrupts[I2C1_EV_IRQn + SIM_IRQ_OFFSET]
+        + wakes.interrupts[I2C1_ER_IRQn + SIM_IRQ_OFFSET]
+        + wakes.interrupts[DMA1_Stream0_IRQn + SIM_IRQ_OFFSET];
+}
+
+/**
+ * Print the cost of a run, per transfer and per sample, as a table row.
+ */
+static void Bench_Report(const char *name, const Bench_Snapshot_t *before,
+        const Bench_Snapshot_t *after, uint32_t samples)
+{
+    uint64_t transactions = after->bus.transactions
+        - before->bus.transactions;
+    uint64_t bytes = after->bus.bytesWritten + after->bus.bytesRead
+        - before->bus.bytesWritten - before->bus.bytesRead;
+    uint32_t transfers = after->profile.transfers
+        - before->profile.transfers;
+    uint32_t cycles = after->profile.cycles - before->profile.cycles;
+    uint64_t interrupts = after->interrupts - before->interrupts;
+    double busy = (double) (after->bus.busy - before->bus.busy)
+        / SIM_UNITS_PER_US;
+
+    printf("| %-16s | %5u | %8.3f | %9.2f | %10.1f | %8.1f | %11u | %10.1f |\n",
+        name, transfers, (double) transactions / samples,
+        (double) bytes / samples, busy / samples,
+        transfers ? (double) interrupts / transfers : 0,
+        transfers ? cycles / transfers : 0, (double) cycles / samples);
+}
+
+/**
+ * Read FIFO bursts of a stream watermark, one path after the other.
+ */
+static void Bench_Bursts(void)
+{
+    uint8_t data[BENCH_BURST_SAMPLES * sizeof(LIS2DE12_Sample_t)];
+    Bench_Snapshot_t before;
+    Bench_Snapshot_t after;
+    uint32_t index;
+
+    Model_Reset();
+    LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG5,
+        LI2DE12_FIFO_EN);
+    LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_CTRL_REG,
+        LI2DE12_FIFO_MODE_STREAM);
+    LIS2DE12_SetOdr(LI2DE12_ODR_1620HZ);
+    Sim_Idle(SIM_MS(20));
+
+    Bench_Take(I2CBUS_PATH_HAL, &before);
+
+    for (index = 0; index < BENCH_BURSTS; index++)
+    {
+        I2CBus_MemRead(LI2DE12_I2C_DEFAULT_ADDR,
+            LI2DE12_FIFO_READ_START | 0x80, data, sizeof(data));
+    }
+
+    Bench_Take(I2CBUS_PATH_HAL, &after);
+    Bench_Report("burst, HAL path", &before, &after,
+        BENCH_BURSTS * BENCH_BURST_SAMPLES);
+
+    Bench_Take(I2CBUS_PATH_FAST, &before);
+
+    for (index = 0; index < BENCH_BURSTS; index++)
+    {
+        I2CBus_FastRead(LI2DE12_I2C_DEFAULT_ADDR,
+            LI2DE12_FIFO_READ_START | 0x80, data, sizeof(data));
+    }
+
+    Bench_Take(I2CBUS_PATH_FAST, &after);
+    Bench_Report("burst, fast path", &before, &after,
+        BENCH_BURSTS * BENCH_BURST_SAMPLES);
+
+    LIS2DE12_SetOdr(LI2DE12_ODR_POWER_DOWN);
+    LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_CTRL_REG,
+        LI2DE12_FIFO_MODE_BYPASS);
+}
+
+/**
+ * Stream the accelerometer at a data rate, and report the cost per sample.
+ */
+static void Bench_Stream(const char *name, uint8_t odr)
+{
+    Bench_Snapshot_t before;
+    Bench_Snapshot_t after;
+
+    Model_Reset();
+    streamed = 0;
+
+    Bench_Take(I2CBUS_PATH_FAST, &before);
+
+    LIS2DE12_StartStream(odr, streamBuffer, BENCH_STREAM_SIZE,
+        StreamCallbackFromISR);
+    Sim_Idle(BENCH_STREAM_TIME);
+    LIS2DE12_StopStream();
+
+    Bench_Take(I2CBUS_PATH_FAST, &after);
+
+    Bench_Report(name, &before, &after, streamed);
+
+    LIS2DE12_SetOdr(LI2DE12_ODR_POWER_DOWN);
+}
+
+static void StreamCallbackFromISR(const LIS2DE12_Sample_t *samples,
+        uint16_t count)
+{
+    (void) samples;
+
+    streamed += count;
+}
+
+int main(void)
+{
+    Board_Init();
+
+    printf("Core clock %uHz\n\n", Sim_GetCoreClock());
+    printf("| %-16s | %5s | %8s | %9s | %10s | %8s | %11s | %10s |\n",
+        "Case", "Xfers", "Xact/smp", "Bytes/smp", "Bus us/smp", "Irq/xfer",
+        "Cycles/xfer", "Cycles/smp");
+    printf("|------------------|------:|---------:|----------:|-----------:"
+        "|---------:|------------:|-----------:|\n");
+
+    Bench_Bursts();
+    Bench_Stream("stream 100Hz", LI2DE12_ODR_100HZ);
+    Bench_Stream("stream 400Hz", LI2DE12_ODR_400HZ);
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+/**
+ * @brief   Host board: the sensor and the bus wired to the MCU pins, and the
+ *          firmware start-up sequence of the tests.
+ *
+ * PB6 and PB9 are the I2C1 SCL and SDA lines: SDA reads the bus, and the
+ * recovery sequence clocks the bus and issues the STOP through them once
+ * they are GPIO outputs. PB4 and PB5 are the LIS2DE12 INT1 and INT2 pins.
+ */
+
+#include "board.h"
+#include "bus.h"
+#include "gpio_periph.h"
+#include "lis2de12_model.h"
+#include "stm32f4xx_hal.h"
+#include "clock.h"
+#include "cycles.h"
+#include "rtc.h"
+#include "lis2de12.h"
+
+#define BOARD_SCL_PIN               6
+#define BOARD_SDA_PIN               9
+#define BOARD_INT1_PIN              4
+#define BOARD_INT2_PIN              5
+
+static void Board_Output(uint32_t pin, bool level);
+
+__attribute__((constructor(103)))
+static void Board_Wire(void)
+{
+    GpioPeriph_SetInput(BOARD_SDA_PIN, Bus_GetSda);
+    GpioPeriph_SetInput(BOARD_INT1_PIN, Model_GetInt1);
+    GpioPeriph_SetInput(BOARD_INT2_PIN, Model_GetInt2);
+    GpioPeriph_SetOutputHook(Board_Output);
+}
+
+/**
+ * Run the start-up sequence of the firmware, as main() does.
+ */
+void Board_Init(void)
+{
+    HAL_Init();
+    Clock_Init();
+    Cycles_Init();
+    RTC_Init();
+    LIS2DE12_Init();
+}
+
+/**
+ * Drive the bus from the I2C pins when they are GPIO outputs: a rising SCL
+ * clocks the bus, a rising SDA while SCL is high is a STOP.
+ */
+static void Board_Output(uint32_t pin, bool level)
+{
+    if (!level)
+    {
+        return;
+    }
+
+    if (pin == BOARD_SCL_PIN)
+    {
+        Bus_ClockPulse();
+    }
+    else if ((pin == BOARD_SDA_PIN) && GpioPeriph_GetOutput(BOARD_SCL_PIN))
+    {
+        Bus_Stop();
+    }
+}
@@ -0,0 +1,11 @@
+/**
+ * @brief   Host board: the sensor and the bus wired to the MCU pins, and the
+ *          firmware start-up sequence of the tests.
+ */
+
+#ifndef BOARD_H_
+#define BOARD_H_
+
+void Board_Init(void);
+
+#endif /* BOARD_H_ */
@@ -0,0 +1,231 @@
+/**
+ * @brief   Wire-level model of the I2C bus: the devices attached to it, the
+ *          traffic counters and the faults which can be injected.
+ */
+
+#include "bus.h"
+#include <stddef.h>
+#include <string.h>
+
+static const Bus_Device_t *devices[128];
+
+/** Device addressed by the transfer in progress. */
+static const Bus_Device_t *current;
+static bool inTransaction;
+static Sim_Time_t transactionStart;
+
+/** Faults to be injected: address phases to NACK or to lose, and the SCL
+ * pulses it takes to release the SDA line held low. */
+static uint32_t nacksLeft;
+static uint32_t arbitrationLossesLeft;
+static uint32_t stuckPulses;
+
+static Bus_Stats_t stats;
+
+/**
+ * Attach a device to the bus.
+ *
+ * @param   address     7-bit address.
+ * @param   device      Device.
+ */
+void Bus_Attach(uint8_t address, const Bus_Device_t *device)
+{
+    devices[address & 0x7F] = device;
+}
+
+/**
+ * Issue a START (or repeated START) and the address byte.
+ *
+ * @param   addressByte     Address shifted left, with the read bit.
+ *
+ * @returns It returns whether the address has been acknowledged, or the
+ *          arbitration has been lost.
+ */
+Bus_Result_t Bus_Start(uint8_t addressByte)
+{
+    const Bus_Device_t *device = devices[addressByte >> 1];
+
+    if (!inTransaction)
+    {
+        inTransaction = true;
+        transactionStart = Sim_Now();
+        stats.transactions++;
+    }
+
+    stats.starts++;
+    stats.bytesWritten++;
+
+    if ((arbitrationLossesLeft > 0) || (stuckPulses > 0))
+    {
+        if (arbitrationLossesLeft > 0)
+        {
+            arbitrationLossesLeft--;
+        }
+
+        stats.arbitrationLosses++;
+        Bus_Stop();
+
+        return BUS_ARBITRATION_LOST;
+    }
+
+    if (current && (current != device))
+    {
+        current->stop();
+    }
+
+    current = NULL;
+
+    if (nacksLeft > 0)
+    {
+        nacksLeft--;
+        stats.nacks++;
+
+        return BUS_NACK;
+    }
+
+    if ((device == NULL) || !device->start(addressByte & 1))
+    {
+        stats.nacks++;
+
+        return BUS_NACK;
+    }
+
+    current = device;
+
+    return BUS_ACK;
+}
+
+/**
+ * Send a data byte to the device addressed.
+ *
+ * @param   byte    Byte to be sent.
+ *
+ * @returns It returns whether the byte has been acknowledged.
+ */
+Bus_Result_t Bus_Write(uint8_t byte)
+{
+    stats.bytesWritten++;
+
+    if ((current == NULL) || !current->write(byte))
+    {
+        stats.nacks++;
+
+        return BUS_NACK;
+    }
+
+    return BUS_ACK;
+}
+
+/**
+ * Receive a data byte from the device addressed.
+ *
+ * @param   ack     Whether the master acknowledges it (more to come).
+ *
+ * @returns It returns the byte, or 0xFF if no device drives the line.
+ */
+uint8_t Bus_Read(bool ack)
+{
+    stats.bytesRead++;
+
+    if (current == NULL)
+    {
+        return 0xFF;
+    }
+
+    return current->read(ack);
+}
+
+/**
+ * Issue a STOP, which also ends a transfer aborted by the master.
+ */
+void Bus_Stop(void)
+{
+    if (current)
+    {
+        current->stop();
+        current = NULL;
+    }
+
+    if (inTransaction)
+    {
+        inTransaction = false;
+        stats.busy += Sim_Now() - transactionStart;
+    }
+}
+
+/**
+ * Check whether a transfer is in progress on the bus.
+ *
+ * @returns It returns true between a START and a STOP.
+ */
+bool Bus_IsBusy(void)
+{
+    return inTransaction;
+}
+
+/**
+ * Get the level of the SDA line, released (high) out of the transfers
+ * unless a device holds it low.
+ *
+ * @returns It returns true if SDA is high.
+ */
+bool Bus_GetSda(void)
+{
+    return stuckPulses == 0;
+}
+
+/**
+ * Clock the bus once, out of any transfer (the recovery sequence). A device
+ * holding SDA low shifts one more bit out on each pulse.
+ */
+void Bus_ClockPulse(void)
+{
+    stats.clockPulses++;
+
+    if ((stuckPulses > 0) && (--stuckPulses == 0))
+    {
+        stats.releases++;
+    }
+}
+
+/**
+ * NACK the next address phases, as a device which is busy or absent.
+ *
+ * @param   count   Number of address phases.
+ */
+void Bus_InjectNack(uint32_t count)
+{
+    nacksLeft = count;
+}
+
+/**
+ * Lose the arbitration on the next address phases, as if another master (or
+ * a glitch) drove SDA low.
+ *
+ * @param   count   Number of address phases.
+ */
+void Bus_InjectArbitrationLoss(uint32_t count)
+{
+    arbitrationLossesLeft = count;
+}
+
+/**
+ * Hold SDA low, as a device reset in the middle of a read does, until the
+ * bus has been clocked a number of times.
+ *
+ * @param   pulses  SCL pulses which release the line.
+ */
+void Bus_InjectStuckSda(uint32_t pulses)
+{
+    stuckPulses = pulses;
+}
+
+void Bus_GetStats(Bus_Stats_t *out)
+{
+    *out = stats;
+}
+
+void Bus_ResetStats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,77 @@
+/**
+ * @brief   Wire-level model of the I2C bus: the devices attached to it, the
+ *          traffic counters and the faults which can be injected.
+ *
+ * The I2C1 register model drives the bus through these calls, so the
+ * counters and the faults are the same whichever path (HAL or fast path)
+ * the firmware takes.
+ */
+
+#ifndef BUS_H_
+#define BUS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sim.h"
+
+#define BUS_DEVICES_MAX             4
+
+/** Time of a byte (8 bits and the acknowledge) at 100KHz, and of the START,
+ * repeated START and STOP conditions. */
+#define BUS_BYTE_TIME               SIM_US(90)
+#define BUS_START_TIME              SIM_US(5)
+#define BUS_RESTART_TIME            SIM_US(10)
+#define BUS_STOP_TIME               SIM_US(5)
+
+/** Outcome of an address or data byte sent by the master. */
+typedef enum
+{
+    BUS_ACK,
+    BUS_NACK,
+    BUS_ARBITRATION_LOST
+
+} Bus_Result_t;
+
+/** Device attached to the bus. */
+typedef struct
+{
+    bool (*start)(bool read);           /**< Addressed, returns the ACK. */
+    bool (*write)(uint8_t byte);        /**< Byte received, returns the ACK. */
+    uint8_t (*read)(bool ack);          /**< Byte sent, and the master ACK. */
+    void (*stop)(void);                 /**< STOP, or transfer aborted. */
+
+} Bus_Device_t;
+
+/** Traffic counters. */
+typedef struct
+{
+    uint64_t transactions;              /**< START to STOP. */
+    uint64_t starts;                    /**< START and repeated START. */
+    uint64_t bytesWritten;              /**< Address and data bytes. */
+    uint64_t bytesRead;
+    uint64_t nacks;
+    uint64_t arbitrationLosses;
+    uint64_t clockPulses;               /**< SCL pulses out of transfers. */
+    uint64_t releases;                  /**< Stuck SDA released. */
+    Sim_Time_t busy;                    /**< Time between START and STOP. */
+
+} Bus_Stats_t;
+
+void Bus_Attach(uint8_t address, const Bus_Device_t *device);
+Bus_Result_t Bus_Start(uint8_t addressByte);
+Bus_Result_t Bus_Write(uint8_t byte);
+uint8_t Bus_Read(bool ack);
+void Bus_Stop(void);
+bool Bus_IsBusy(void);
+
+bool Bus_GetSda(void);
+void Bus_ClockPulse(void);
+
+void Bus_InjectNack(uint32_t count);
+void Bus_InjectArbitrationLoss(uint32_t count);
+void Bus_InjectStuckSda(uint32_t pulses);
+
+void Bus_GetStats(Bus_Stats_t *stats);
+void Bus_ResetStats(void);
+
+#endif /* BUS_H_ */
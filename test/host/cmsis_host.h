@@ -0,0 +1,122 @@
+/**
+ * @brief   Host replacement of the CMSIS core intrinsics, forced into every
+ *          firmware source built for the host tests.
+ *
+ * The CMSIS headers of the tree only know the ARM instructions, so their
+ * instruction and register access headers are kept out (by defining their
+ * include guards) and the intrinsics are provided here instead. The
+ * interrupt mask and the sleep instructions are handed over to the
+ * simulator, which takes the pending interrupts and moves the simulated
+ * time forward.
+ */
+
+#ifndef CMSIS_HOST_H_
+#define CMSIS_HOST_H_
+
+#include <stdint.h>
+
+#define __CORE_CMINSTR_H
+#define __CORE_CMFUNC_H
+#define __CORE_CMSIMD_H
+
+void Sim_Wfi(void);
+void Sim_Wfe(void);
+void Sim_Sev(void);
+uint32_t Sim_GetPrimask(void);
+void Sim_SetPrimask(uint32_t primask);
+
+static inline void __NOP(void)
+{
+}
+
+static inline void __WFI(void)
+{
+    Sim_Wfi();
+}
+
+static inline void __WFE(void)
+{
+    Sim_Wfe();
+}
+
+static inline void __SEV(void)
+{
+    Sim_Sev();
+}
+
+static inline void __ISB(void)
+{
+    __sync_synchronize();
+}
+
+static inline void __DSB(void)
+{
+    __sync_synchronize();
+}
+
+static inline void __DMB(void)
+{
+    __sync_synchronize();
+}
+
+static inline uint32_t __REV(uint32_t value)
+{
+    return __builtin_bswap32(value);
+}
+
+static inline uint32_t __RBIT(uint32_t value)
+{
+    uint32_t result = 0;
+    uint8_t bit;
+
+    for (bit = 0; bit < 32; bit++)
+    {
+        result = (result << 1) | ((value >> bit) & 1);
+    }
+
+    return result;
+}
+
+static inline uint8_t __CLZ(uint32_t value)
+{
+    return (value == 0) ? 32 : __builtin_clz(value);
+}
+
+/* The exclusive store always succeeds: the interrupts are only taken after
+ * the register accesses and the simulator calls, never in between */
+static inline uint32_t __LDREXW(volatile uint32_t *addr)
+{
+    return *addr;
+}
+
+static inline uint32_t __STREXW(uint32_t value, volatile uint32_t *addr)
+{
+    *addr = value;
+    return 0;
+}
+
+static inline void __CLREX(void)
+{
+}
+
+static inline void __enable_irq(void)
+{
+    Sim_SetPrimask(0);
+}
+
+static inline void __disable_irq(void)
+{
+    Sim_SetPrimask(1);
+}
+
+static inline uint32_t __get_PRIMASK(void)
+{
+    return Sim_GetPrimask();
+}
+
+static inline void __set_PRIMASK(uint32_t priMask)
+{
+    Sim_SetPrimask(priMask);
+}
+
+#endif /* CMSIS_HOST_H_ */
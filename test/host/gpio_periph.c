@@ -0,0 +1,264 @@
+/**
+ * @brief   Register model of the GPIO port B and of the EXTI controller: the
+ *          pins wired to the bus and to the sensor interrupts, and the edge
+ *          detection of the external interrupt lines.
+ *
+ * The input data register is sampled when it's read: an output pin reads its
+ * output level (wired-AND with the line for the open-drain ones), an input
+ * pin reads the level of what drives it, or its pull resistor if nothing
+ * does. The edges of the inputs routed to the EXTI set the pending flags,
+ * which raise the EXTI interrupts for as long as they are set and unmasked.
+ */
+
+#include "gpio_periph.h"
+#include "sim.h"
+#include <stddef.h>
+
+#define GPIO_PERIPH_PINS            16
+
+/* Port B in the EXTI source selection of the SYSCFG */
+#define GPIO_PERIPH_EXTI_PORT_B     1
+
+/* MODER pin modes */
+#define GPIO_PERIPH_MODE_OUTPUT     1
+
+/* PUPDR pull resistors */
+#define GPIO_PERIPH_PULL_UP         1
+
+static void GpioPeriph_Pre(uintptr_t address, bool write);
+static void GpioPeriph_Post(uintptr_t address, bool write);
+static void GpioPeriph_ExtiPre(uintptr_t address, bool write);
+static void GpioPeriph_ExtiPost(uintptr_t address, bool write);
+static uint32_t GpioPeriph_Levels(void);
+static bool GpioPeriph_Exti4Level(void);
+static bool GpioPeriph_Exti9_5Level(void);
+
+static GPIO_TypeDef *gpio;
+static EXTI_TypeDef *exti;
+static const SYSCFG_TypeDef *syscfg;
+
+static bool (*inputs[GPIO_PERIPH_PINS])(void);
+static void (*outputHook)(uint32_t pin, bool level);
+
+/** Pin levels last seen, for the edge detection. */
+static uint32_t levels;
+
+/** Output data and EXTI pending registers before the access trapped. */
+static uint32_t odrBefore;
+static uint32_t prBefore;
+
+__attribute__((constructor(102)))
+static void GpioPeriph_Init(void)
+{
+    gpio = Sim_Backdoor(GPIOB);
+    exti = Sim_Backdoor(EXTI);
+    syscfg = Sim_Backdoor(SYSCFG);
+
+    /* Reset values of the port B: PB3 and PB4 belong to the debug port */
+    gpio->MODER = 0x00000280;
+    gpio->OSPEEDR = 0x000000C0;
+    gpio->PUPDR = 0x00000100;
+
+    Sim_Trap((uintptr_t) GPIOB, sizeof(GPIO_TypeDef), GpioPeriph_Pre,
+        GpioPeriph_Post);
+    Sim_Trap((uintptr_t) EXTI, sizeof(EXTI_TypeDef), GpioPeriph_ExtiPre,
+        GpioPeriph_ExtiPost);
+    Sim_SetIrqLevel(EXTI4_IRQn, GpioPeriph_Exti4Level);
+    Sim_SetIrqLevel(EXTI9_5_IRQn, GpioPeriph_Exti9_5Level);
+    Sim_AddPoll(GpioPeriph_InputChanged);
+}
+
+/**
+ * Wire a pin to what drives it.
+ *
+ * @param   pin     Pin number (0 to 15).
+ * @param   level   Function which returns the level driven, or NULL.
+ */
+void GpioPeriph_SetInput(uint32_t pin, bool (*level)(void))
+{
+    inputs[pin] = level;
+    levels = GpioPeriph_Levels();
+}
+
+/**
+ * Set the function called when an output pin changes.
+ *
+ * @param   hook    Function called with the pin number and its new level.
+ */
+void GpioPeriph_SetOutputHook(void (*hook)(uint32_t pin, bool level))
+{
+    outputHook = hook;
+}
+
+/**
+ * Sample the pins after what drives them may have changed, and latch the
+ * edges of those routed to the EXTI.
+ */
+void GpioPeriph_InputChanged(void)
+{
+    uint32_t now = GpioPeriph_Levels();
+    uint32_t rising = now & ~levels;
+    uint32_t falling = levels & ~now;
+    uint32_t line;
+
+    levels = now;
+
+    for (line = 0; line < GPIO_PERIPH_PINS; line++)
+    {
+        if ((((syscfg->EXTICR[line / 4] >> ((line % 4) * 4)) & 0xF)
+                    != GPIO_PERIPH_EXTI_PORT_B)
+                || !(exti->IMR & (1U << line)))
+        {
+            continue;
+        }
+
+        if (((rising & exti->RTSR) | (falling & exti->FTSR)) & (1U << line))
+        {
+            exti->PR |= 1U << line;
+        }
+    }
+}
+
+/**
+ * Get the level an output pin drives.
+ *
+ * @param   pin     Pin number (0 to 15).
+ *
+ * @returns It returns true if the pin is an output driven high.
+ */
+bool GpioPeriph_GetOutput(uint32_t pin)
+{
+    return (((gpio->MODER >> (pin * 2)) & 3) == GPIO_PERIPH_MODE_OUTPUT)
+        && (gpio->ODR & (1U << pin));
+}
+
+/**
+ * Sample the input data register before it's read.
+ */
+static void GpioPeriph_Pre(uintptr_t address, bool write)
+{
+    odrBefore = gpio->ODR;
+
+    if ((address & ~(uintptr_t) 3) == (uintptr_t) &GPIOB->IDR)
+    {
+        gpio->IDR = GpioPeriph_Levels();
+    }
+}
+
+/**
+ * Apply the writes of the bit set/reset register, and tell the outputs which
+ * changed.
+ */
+static void GpioPeriph_Post(uintptr_t address, bool write)
+{
+    uint32_t changed;
+    uint32_t pin;
+    uint32_t bsrr;
+
+    if (!write)
+    {
+        return;
+    }
+
+    if ((address & ~(uintptr_t) 3) == (uintptr_t) &GPIOB->BSRR)
+    {
+        bsrr = gpio->BSRR;
+        gpio->ODR = (gpio->ODR & ~(bsrr >> 16)) | (bsrr & 0xFFFF);
+        gpio->BSRR = 0;
+    }
+
+    changed = (gpio->ODR ^ odrBefore) & 0xFFFF;
+
+    for (pin = 0; (pin < GPIO_PERIPH_PINS) && outputHook; pin++)
+    {
+        if ((changed & (1U << pin)) && (((gpio->MODER >> (pin * 2)) & 3)
+                    == GPIO_PERIPH_MODE_OUTPUT))
+        {
+            outputHook(pin, (gpio->ODR & (1U << pin)) != 0);
+        }
+    }
+
+    GpioPeriph_InputChanged();
+}
+
+static void GpioPeriph_ExtiPre(uintptr_t address, bool write)
+{
+    prBefore = exti->PR;
+}
+
+/**
+ * Apply the EXTI writes: the pending flags are cleared by writing 1s, and
+ * the software interrupt register sets them.
+ */
+static void GpioPeriph_ExtiPost(uintptr_t address, bool write)
+{
+    uint32_t reg = address & ~(uintptr_t) 3;
+
+    if (!write)
+    {
+        return;
+    }
+
+    if (reg == (uintptr_t) &EXTI->PR)
+    {
+        exti->PR = prBefore & ~exti->PR;
+    }
+    else if (reg == (uintptr_t) &EXTI->SWIER)
+    {
+        exti->PR |= exti->SWIER & exti->IMR;
+        exti->SWIER = 0;
+    }
+}
+
+/**
+ * Get the level of the pins.
+ */
+static uint32_t GpioPeriph_Levels(void)
+{
+    uint32_t result = 0;
+    uint32_t mode;
+    uint32_t pin;
+    bool level;
+
+    for (pin = 0; pin < GPIO_PERIPH_PINS; pin++)
+    {
+        mode = (gpio->MODER >> (pin * 2)) & 3;
+
+        if (inputs[pin])
+        {
+            level = inputs[pin]();
+        }
+        else
+        {
+            level = ((gpio->PUPDR >> (pin * 2)) & 3) == GPIO_PERIPH_PULL_UP;
+        }
+
+        if (mode == GPIO_PERIPH_MODE_OUTPUT)
+        {
+            /* An open-drain output only pulls the line low */
+            if (!(gpio->OTYPER & (1U << pin)) || !inputs[pin])
+            {
+                level = true;
+            }
+
+            level = level && (gpio->ODR & (1U << pin));
+        }
+
+        if (level)
+        {
+            result |= 1U << pin;
+        }
+    }
+
+    return result;
+}
+
+static bool GpioPeriph_Exti4Level(void)
+{
+    return (exti->PR & exti->IMR & (1U << 4)) != 0;
+}
+
+static bool GpioPeriph_Exti9_5Level(void)
+{
+    return (exti->PR & exti->IMR & (0x1FU << 5)) != 0;
+}
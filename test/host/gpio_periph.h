@@ -0,0 +1,18 @@
+/**
+ * @brief   Register model of the GPIO port B and of the EXTI controller: the
+ *          pins wired to the bus and to the sensor interrupts, and the edge
+ *          detection of the external interrupt lines.
+ */
+
+#ifndef GPIO_PERIPH_H_
+#define GPIO_PERIPH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void GpioPeriph_SetInput(uint32_t pin, bool (*level)(void));
+void GpioPeriph_SetOutputHook(void (*hook)(uint32_t pin, bool level));
+void GpioPeriph_InputChanged(void);
+bool GpioPeriph_GetOutput(uint32_t pin);
+
+#endif /* GPIO_PERIPH_H_ */
@@ -0,0 +1,36 @@
+/**
+ * @brief   HAL functions the host build doesn't take from the HAL sources.
+ *
+ * The tree has no DMA HAL: the bus driver drives its DMA stream directly,
+ * and the I2C HAL only calls the DMA functions for its DMA transfers, which
+ * the firmware doesn't use. They fail loudly if that ever changes.
+ */
+
+#include "stm32f4xx_hal.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void HalHost_Unsupported(const char *function)
+{
+    fprintf(stderr, "hal: %s is not supported on the host\n", function);
+    abort();
+}
+
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef *hdma,
+        uint32_t SrcAddress, uint32_t DstAddress, uint32_t DataLength)
+{
+    HalHost_Unsupported(__func__);
+    return HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort_IT(DMA_HandleTypeDef *hdma)
+{
+    HalHost_Unsupported(__func__);
+    return HAL_ERROR;
+}
+
+uint32_t HAL_DMA_GetError(DMA_HandleTypeDef *hdma)
+{
+    HalHost_Unsupported(__func__);
+    return 0;
+}
@@ -0,0 +1,642 @@
+/**
+ * @brief   Register model of the I2C1 master and of the DMA1 stream 0 which
+ *          receives its data, as driven by the HAL and by the fast path of
+ *          the bus driver.
+ *
+ * The model follows the reference manual sequences: SB, ADDR and BTF
+ * stretch the clock until software clears them, the ACK bit (or the POS
+ * bit and the DMA LAST bit) decides whether each received byte is
+ * acknowledged, and a requested STOP or repeated START is issued at the
+ * next point the clock is held.
+ */
+
+#include "bus.h"
+#include "sim.h"
+#include <stddef.h>
+#include <string.h>
+
+#define I2C_PERIPH_SR1_ERRORS       (I2C_SR1_BERR | I2C_SR1_ARLO | \
+                                     I2C_SR1_AF | I2C_SR1_OVR | \
+                                     I2C_SR1_PECERR | I2C_SR1_TIMEOUT | \
+                                     I2C_SR1_SMBALERT)
+
+#define I2C_PERIPH_REG(reg)         offsetof(I2C_TypeDef, reg)
+
+/** Master state, between the register accesses. */
+typedef enum
+{
+    I2C_PERIPH_IDLE,
+    I2C_PERIPH_START,           /**< Issuing a (repeated) START. */
+    I2C_PERIPH_SB,              /**< Waiting for the address (SB set). */
+    I2C_PERIPH_ADDRESS,         /**< Sending the address. */
+    I2C_PERIPH_ADDR,            /**< Waiting for ADDR to be cleared. */
+    I2C_PERIPH_TX,              /**< Sending a byte. */
+    I2C_PERIPH_RX,              /**< Receiving a byte. */
+    I2C_PERIPH_HOLD,            /**< Clock held (BTF, NACK, empty DR). */
+    I2C_PERIPH_STOP             /**< Issuing a STOP. */
+
+} I2cPeriph_Phase_t;
+
+static void I2cPeriph_Pre(uintptr_t address, bool write);
+static void I2cPeriph_Post(uintptr_t address, bool write);
+static void I2cPeriph_DmaPre(uintptr_t address, bool write);
+static void I2cPeriph_DmaPost(uintptr_t address, bool write);
+static Sim_Time_t I2cPeriph_Next(void);
+static void I2cPeriph_Run(Sim_Time_t now);
+static bool I2cPeriph_EventLevel(void);
+static bool I2cPeriph_ErrorLevel(void);
+static void I2cPeriph_Control(void);
+static void I2cPeriph_WriteData(uint8_t value);
+static void I2cPeriph_ReadData(void);
+static void I2cPeriph_ClearAddr(void);
+static void I2cPeriph_Receive(void);
+static void I2cPeriph_DmaTransfer(uint8_t byte);
+static void I2cPeriph_Hold(void);
+static void I2cPeriph_LoseArbitration(void);
+static void I2cPeriph_Reset(void);
+static uint32_t I2cPeriph_Status2(void);
+static void I2cPeriph_Begin(I2cPeriph_Phase_t next, Sim_Time_t duration);
+
+/** Register aliases of the models. */
+static I2C_TypeDef *i2c;
+static DMA_TypeDef *dma;
+static DMA_Stream_TypeDef *stream;
+
+static I2cPeriph_Phase_t phase;
+static Sim_Time_t phaseEnd = SIM_NEVER;
+static bool master;
+static bool transmitter;
+
+/** Address byte, byte being sent and byte written to DR meanwhile. */
+static uint8_t addressByte;
+static uint8_t txShift;
+static uint8_t txData;
+static bool txPending;
+
+/** Byte in DR, and byte held in the shift register while DR is full. */
+static uint8_t rxData;
+static uint8_t rxShift;
+static bool rxShiftFull;
+static bool rxShiftAcked;
+
+/** ACK sampled for the next byte, with POS set. */
+static bool posAck;
+
+/** Whether SR1 has been read, which arms the SB and ADDR clear sequences. */
+static bool sr1Read;
+
+/** Register values before the access being trapped. */
+static uint32_t cr1Before;
+static uint32_t sr1Before;
+static uint32_t dmaCrBefore;
+
+/** Number of bytes the DMA stream has been armed with, and the host memory
+ * it writes to. */
+static uint32_t dmaTotal;
+static uint8_t *dmaMemory;
+
+__attribute__((constructor(102)))
+static void I2cPeriph_Init(void)
+{
+    i2c = Sim_Backdoor(I2C1);
+    dma = Sim_Backdoor(DMA1);
+    stream = Sim_Backdoor(DMA1_Stream0);
+
+    Sim_Trap(I2C1_BASE, sizeof(I2C_TypeDef), I2cPeriph_Pre, I2cPeriph_Post);
+    Sim_Trap(DMA1_BASE, DMA1_Stream1_BASE - DMA1_BASE, I2cPeriph_DmaPre,
+        I2cPeriph_DmaPost);
+    Sim_AddComponent(I2cPeriph_Next, I2cPeriph_Run);
+    Sim_SetIrqLevel(I2C1_EV_IRQn, I2cPeriph_EventLevel);
+    Sim_SetIrqLevel(I2C1_ER_IRQn, I2cPeriph_ErrorLevel);
+}
+
+static void I2cPeriph_Pre(uintptr_t address, bool write)
+{
+    uint32_t offset = (address & ~(uintptr_t) 3) - I2C1_BASE;
+
+    cr1Before = i2c->CR1;
+    sr1Before = i2c->SR1;
+
+    if (!write && (offset == I2C_PERIPH_REG(DR)))
+    {
+        i2c->DR = rxData;
+    }
+    else if (offset == I2C_PERIPH_REG(SR2))
+    {
+        i2c->SR2 = I2cPeriph_Status2();
+    }
+}
+
+static void I2cPeriph_Post(uintptr_t address, bool write)
+{
+    uint32_t offset = (address & ~(uintptr_t) 3) - I2C1_BASE;
+
+    switch (offset)
+    {
+        case I2C_PERIPH_REG(CR1):
+            if (write)
+            {
+                I2cPeriph_Control();
+            }
+            break;
+
+        case I2C_PERIPH_REG(DR):
+            if (write)
+            {
+                I2cPeriph_WriteData(i2c->DR & I2C_DR_DR);
+            }
+            else
+            {
+                I2cPeriph_ReadData();
+            }
+            break;
+
+        case I2C_PERIPH_REG(SR1):
+            if (write)
+            {
+                /* Error flags are cleared by writing 0, the rest is read-only */
+                i2c->SR1 = sr1Before & (i2c->SR1 | ~I2C_PERIPH_SR1_ERRORS);
+            }
+            else
+            {
+                sr1Read = true;
+            }
+            break;
+
+        case I2C_PERIPH_REG(SR2):
+            i2c->SR2 = I2cPeriph_Status2();
+
+            if (!write && sr1Read && (i2c->SR1 & I2C_SR1_ADDR))
+            {
+                I2cPeriph_ClearAddr();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void I2cPeriph_DmaPre(uintptr_t address, bool write)
+{
+    dmaCrBefore = stream->CR;
+}
+
+/**
+ * Apply the DMA flag clears and the stream enable. The memory address is
+ * resolved on the enable, while the firmware which armed the stream is still
+ * running and its buffer in scope, as it may be on the stack.
+ */
+static void I2cPeriph_DmaPost(uintptr_t address, bool write)
+{
+    uint32_t reg = address & ~(uintptr_t) 3;
+
+    if (!write)
+    {
+        return;
+    }
+
+    if (reg == (uintptr_t) &DMA1->LIFCR)
+    {
+        dma->LISR &= ~dma->LIFCR;
+        dma->LIFCR = 0;
+    }
+    else if (reg == (uintptr_t) &DMA1->HIFCR)
+    {
+        dma->HISR &= ~dma->HIFCR;
+        dma->HIFCR = 0;
+    }
+    else if ((reg == (uintptr_t) &DMA1_Stream0->CR)
+            && (stream->CR & DMA_SxCR_EN) && !(dmaCrBefore & DMA_SxCR_EN))
+    {
+        dmaTotal = stream->NDTR;
+        dmaMemory = (uint8_t *) Sim_HostPointer(stream->M0AR);
+    }
+}
+
+static Sim_Time_t I2cPeriph_Next(void)
+{
+    switch (phase)
+    {
+        case I2C_PERIPH_START:
+        case I2C_PERIPH_ADDRESS:
+        case I2C_PERIPH_TX:
+        case I2C_PERIPH_RX:
+        case I2C_PERIPH_STOP:
+            return phaseEnd;
+
+        default:
+            return SIM_NEVER;
+    }
+}
+
+/**
+ * Complete the condition or byte in progress on the bus.
+ */
+static void I2cPeriph_Run(Sim_Time_t now)
+{
+    Bus_Result_t result;
+
+    switch (phase)
+    {
+        case I2C_PERIPH_START:
+            i2c->CR1 &= ~I2C_CR1_START;
+
+            if (!Bus_GetSda())
+            {
+                I2cPeriph_LoseArbitration();
+                break;
+            }
+
+            master = true;
+            sr1Read = false;
+            i2c->SR1 &= ~(I2C_SR1_TXE | I2C_SR1_BTF);
+            i2c->SR1 |= I2C_SR1_SB;
+            phase = I2C_PERIPH_SB;
+            break;
+
+        case I2C_PERIPH_ADDRESS:
+            result = Bus_Start(addressByte);
+
+            if (result == BUS_ARBITRATION_LOST)
+            {
+                I2cPeriph_LoseArbitration();
+            }
+            else if (result == BUS_NACK)
+            {
+                i2c->SR1 |= I2C_SR1_AF;
+                phase = I2C_PERIPH_HOLD;
+            }
+            else
+            {
+                transmitter = !(addressByte & 1);
+                sr1Read = false;
+                i2c->SR1 |= I2C_SR1_ADDR;
+                phase = I2C_PERIPH_ADDR;
+            }
+            break;
+
+        case I2C_PERIPH_TX:
+            if (Bus_Write(txShift) != BUS_ACK)
+            {
+                i2c->SR1 |= I2C_SR1_AF;
+                phase = I2C_PERIPH_HOLD;
+            }
+            else if (txPending)
+            {
+                txShift = txData;
+                txPending = false;
+                i2c->SR1 |= I2C_SR1_TXE;
+                phaseEnd += BUS_BYTE_TIME;
+            }
+            else
+            {
+                i2c->SR1 |= I2C_SR1_BTF;
+                phase = I2C_PERIPH_HOLD;
+                I2cPeriph_Hold();
+            }
+            break;
+
+        case I2C_PERIPH_RX:
+            I2cPeriph_Receive();
+            break;
+
+        case I2C_PERIPH_STOP:
+            Bus_Stop();
+            master = false;
+            transmitter = false;
+            i2c->CR1 &= ~I2C_CR1_STOP;
+            i2c->SR1 &= ~(I2C_SR1_TXE | I2C_SR1_BTF);
+            phase = I2C_PERIPH_IDLE;
+
+            if (i2c->CR1 & I2C_CR1_START)
+            {
+                I2cPeriph_Begin(I2C_PERIPH_START, BUS_START_TIME);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static bool I2cPeriph_EventLevel(void)
+{
+    uint32_t cr2 = i2c->CR2;
+    uint32_t sr1 = i2c->SR1;
+
+    return (cr2 & I2C_CR2_ITEVTEN)
+        && ((sr1 & (I2C_SR1_SB | I2C_SR1_ADDR | I2C_SR1_BTF | I2C_SR1_ADD10
+                | I2C_SR1_STOPF))
+            || ((cr2 & I2C_CR2_ITBUFEN)
+                && (sr1 & (I2C_SR1_TXE | I2C_SR1_RXNE))));
+}
+
+static bool I2cPeriph_ErrorLevel(void)
+{
+    return (i2c->CR2 & I2C_CR2_ITERREN)
+        && (i2c->SR1 & I2C_PERIPH_SR1_ERRORS);
+}
+
+/**
+ * Apply a write to CR1: software reset, enable, START and STOP requests.
+ */
+static void I2cPeriph_Control(void)
+{
+    uint32_t cr1 = i2c->CR1;
+
+    if (cr1 & I2C_CR1_SWRST)
+    {
+        I2cPeriph_Reset();
+        i2c->CR1 = I2C_CR1_SWRST;
+        return;
+    }
+
+    if (!(cr1 & I2C_CR1_PE))
+    {
+        /* Disabling keeps the configuration, only the state is reset */
+        if (cr1Before & I2C_CR1_PE)
+        {
+            I2C_TypeDef config = *i2c;
+
+            I2cPeriph_Reset();
+            i2c->CR1 = cr1 & ~(I2C_CR1_START | I2C_CR1_STOP);
+            i2c->CR2 = config.CR2;
+            i2c->OAR1 = config.OAR1;
+            i2c->OAR2 = config.OAR2;
+            i2c->CCR = config.CCR;
+            i2c->TRISE = config.TRISE;
+            i2c->FLTR = config.FLTR;
+        }
+        return;
+    }
+
+    if (phase == I2C_PERIPH_HOLD)
+    {
+        I2cPeriph_Hold();
+    }
+    else if ((phase == I2C_PERIPH_IDLE) && (cr1 & I2C_CR1_START))
+    {
+        I2cPeriph_Begin(I2C_PERIPH_START, BUS_START_TIME);
+    }
+    else if ((phase == I2C_PERIPH_IDLE) && (cr1 & I2C_CR1_STOP))
+    {
+        /* Nothing to stop */
+        i2c->CR1 &= ~I2C_CR1_STOP;
+    }
+}
+
+/**
+ * Apply a write to DR: the address once SB is set, or a byte to send.
+ */
+static void I2cPeriph_WriteData(uint8_t value)
+{
+    if (phase == I2C_PERIPH_SB)
+    {
+        if (!sr1Read)
+        {
+            return;
+        }
+
+        i2c->SR1 &= ~I2C_SR1_SB;
+        sr1Read = false;
+        addressByte = value;
+        I2cPeriph_Begin(I2C_PERIPH_ADDRESS, BUS_BYTE_TIME);
+        return;
+    }
+
+    if (!master || !transmitter)
+    {
+        return;
+    }
+
+    if (phase == I2C_PERIPH_HOLD)
+    {
+        txShift = value;
+        i2c->SR1 &= ~I2C_SR1_BTF;
+        i2c->SR1 |= I2C_SR1_TXE;
+        I2cPeriph_Begin(I2C_PERIPH_TX, BUS_BYTE_TIME);
+    }
+    else if (phase == I2C_PERIPH_TX)
+    {
+        txData = value;
+        txPending = true;
+        i2c->SR1 &= ~I2C_SR1_TXE;
+    }
+}
+
+/**
+ * Apply a read of DR: the byte held in the shift register moves in, and the
+ * reception goes on if it had been acknowledged.
+ */
+static void I2cPeriph_ReadData(void)
+{
+    if (!(i2c->SR1 & I2C_SR1_RXNE))
+    {
+        return;
+    }
+
+    if (!rxShiftFull)
+    {
+        i2c->SR1 &= ~I2C_SR1_RXNE;
+        return;
+    }
+
+    rxData = rxShift;
+    rxShiftFull = false;
+    i2c->SR1 &= ~I2C_SR1_BTF;
+
+    if ((phase == I2C_PERIPH_HOLD) && rxShiftAcked)
+    {
+        I2cPeriph_Begin(I2C_PERIPH_RX, BUS_BYTE_TIME);
+    }
+}
+
+/**
+ * Clear ADDR (SR1 then SR2 read): a transmitter waits for its first byte, a
+ * receiver starts clocking the data in.
+ */
+static void I2cPeriph_ClearAddr(void)
+{
+    i2c->SR1 &= ~I2C_SR1_ADDR;
+    sr1Read = false;
+
+    if (transmitter)
+    {
+        i2c->SR1 |= I2C_SR1_TXE;
+        phase = I2C_PERIPH_HOLD;
+        I2cPeriph_Hold();
+    }
+    else
+    {
+        posAck = true;
+        rxShiftFull = false;
+        I2cPeriph_Begin(I2C_PERIPH_RX, BUS_BYTE_TIME);
+    }
+}
+
+/**
+ * Complete a received byte: acknowledge it as the ACK, POS and LAST bits
+ * tell, and hand it to the DMA, to DR or to the shift register.
+ */
+static void I2cPeriph_Receive(void)
+{
+    bool dmaOn = (i2c->CR2 & I2C_CR2_DMAEN) && (stream->CR & DMA_SxCR_EN);
+    uint32_t cr1 = i2c->CR1;
+    uint8_t byte;
+    bool ack;
+
+    if (dmaOn && (i2c->CR2 & I2C_CR2_LAST) && (stream->NDTR == 1))
+    {
+        ack = false;
+    }
+    else if (cr1 & I2C_CR1_POS)
+    {
+        ack = posAck;
+        posAck = (cr1 & I2C_CR1_ACK) != 0;
+    }
+    else
+    {
+        ack = (cr1 & I2C_CR1_ACK) != 0;
+    }
+
+    byte = Bus_Read(ack);
+
+    if (dmaOn)
+    {
+        I2cPeriph_DmaTransfer(byte);
+    }
+    else if (!(i2c->SR1 & I2C_SR1_RXNE))
+    {
+        rxData = byte;
+        i2c->SR1 |= I2C_SR1_RXNE;
+    }
+    else
+    {
+        /* DR full: the byte waits in the shift register, clock held */
+        rxShift = byte;
+        rxShiftFull = true;
+        rxShiftAcked = ack;
+        i2c->SR1 |= I2C_SR1_BTF;
+        phase = I2C_PERIPH_HOLD;
+        I2cPeriph_Hold();
+        return;
+    }
+
+    if (ack)
+    {
+        phaseEnd += BUS_BYTE_TIME;
+    }
+    else
+    {
+        phase = I2C_PERIPH_HOLD;
+        I2cPeriph_Hold();
+    }
+}
+
+/**
+ * Copy a received byte to memory through the DMA stream.
+ */
+static void I2cPeriph_DmaTransfer(uint8_t byte)
+{
+    uint32_t index = dmaTotal - stream->NDTR;
+    dmaMemory[(stream->CR & DMA_SxCR_MINC) ? index : 0] = byte;
+    stream->NDTR--;
+
+    if (stream->NDTR == dmaTotal / 2)
+    {
+        dma->LISR |= DMA_LISR_HTIF0;
+    }
+
+    if (stream->NDTR == 0)
+    {
+        dma->LISR |= DMA_LISR_TCIF0;
+        stream->CR &= ~DMA_SxCR_EN;
+
+        if (stream->CR & DMA_SxCR_TCIE)
+        {
+            Sim_PendIrq(DMA1_Stream0_IRQn);
+        }
+    }
+}
+
+/**
+ * Issue the STOP or repeated START requested, now the clock is held.
+ */
+static void I2cPeriph_Hold(void)
+{
+    uint32_t cr1 = i2c->CR1;
+
+    if (cr1 & I2C_CR1_STOP)
+    {
+        I2cPeriph_Begin(I2C_PERIPH_STOP, BUS_STOP_TIME);
+    }
+    else if (cr1 & I2C_CR1_START)
+    {
+        I2cPeriph_Begin(I2C_PERIPH_START, BUS_RESTART_TIME);
+    }
+}
+
+/**
+ * Drop the master mode on an arbitration loss.
+ */
+static void I2cPeriph_LoseArbitration(void)
+{
+    i2c->SR1 |= I2C_SR1_ARLO;
+    i2c->CR1 &= ~(I2C_CR1_START | I2C_CR1_STOP);
+    master = false;
+    transmitter = false;
+    phase = I2C_PERIPH_IDLE;
+}
+
+/**
+ * Reset the peripheral state (software reset or disable). A transfer in
+ * progress is abandoned on the bus.
+ */
+static void I2cPeriph_Reset(void)
+{
+    if (master)
+    {
+        Bus_Stop();
+    }
+
+    memset(i2c, 0, sizeof(*i2c));
+
+    phase = I2C_PERIPH_IDLE;
+    master = false;
+    transmitter = false;
+    txPending = false;
+    rxShiftFull = false;
+    sr1Read = false;
+}
+
+/**
+ * Compute SR2 from the master state and the bus lines.
+ */
+static uint32_t I2cPeriph_Status2(void)
+{
+    uint32_t sr2 = 0;
+
+    if (master)
+    {
+        sr2 |= I2C_SR2_MSL;
+    }
+
+    if (master || (phase != I2C_PERIPH_IDLE) || !Bus_GetSda())
+    {
+        sr2 |= I2C_SR2_BUSY;
+    }
+
+    if (master && transmitter)
+    {
+        sr2 |= I2C_SR2_TRA;
+    }
+
+    return sr2;
+}
+
+static void I2cPeriph_Begin(I2cPeriph_Phase_t next, Sim_Time_t duration)
+{
+    phase = next;
+    phaseEnd = Sim_Now() + duration;
+}
@@ -0,0 +1,994 @@
+/**
+ * @brief   Register model of the LIS2DE12 accelerometer, attached to the I2C
+ *          bus model, with its FIFO, its interrupt generators and pins, the
+ *          temperature sensor and the self-test.
+ *
+ * The model converts a sample at each data rate period, from a constant
+ * acceleration or a replayed trace, plus the noise and the self-test
+ * response. Each sample goes through the high-pass filter into the output
+ * registers or the FIFO, the interrupt generators and the temperature
+ * output, and the INT1/INT2 pins are recomputed from the routing registers.
+ *
+ * The register accesses follow the datasheet: the MSB of the sub-address
+ * enables the auto-increment, which rolls back from OUT_Z_H to OUT_X_L while
+ * the FIFO is enabled, reading OUT_Z_H pops a FIFO sample, reading the
+ * source registers clears the latched interrupts and reading REFERENCE
+ * resets the high-pass filter.
+ */
+
+#include "lis2de12_model.h"
+#include "lis2de12.h"
+#include "bus.h"
+#include "sim.h"
+#include "trace.h"
+#include <string.h>
+
+#define MODEL_REGISTERS             0x40
+#define MODEL_WHO_AM_I              0x33
+
+/* Turn-on time from the power-down mode, on top of the first period */
+#define MODEL_TURN_ON_TIME          SIM_MS(1)
+
+/* Routing of the INT1 pin (CTRL_REG3) and its polarity (CTRL_REG6) */
+#define MODEL_I1_IA1                (1 << 6)
+#define MODEL_I1_IA2                (1 << 5)
+#define MODEL_I1_ZYXDA              (1 << 4)
+#define MODEL_I1_OVERRUN            (1 << 1)
+#define MODEL_INT_POLARITY          (1 << 1)
+
+/* Interrupt generator 1 latch and 4D detection (CTRL_REG5) */
+#define MODEL_LIR_INT1              (1 << 3)
+#define MODEL_D4D_INT1              (1 << 2)
+#define MODEL_BOOT                  (1 << 7)
+
+/* Full scale (CTRL_REG4) */
+#define MODEL_FS_MASK               (0b11 << 4)
+#define MODEL_FS_POS                4
+#define MODEL_ST_MASK               (0b11 << 1)
+
+/* STATUS_REG and STATUS_REG_AUX */
+#define MODEL_ZYXDA                 0x0F
+#define MODEL_ZYXOR                 0xF0
+#define MODEL_TOR                   (1 << 6)
+
+/* FIFO_CTRL_REG and FIFO_SRC_REG */
+#define MODEL_FIFO_MODE_MASK        (0b11 << 6)
+#define MODEL_FIFO_MODE_TRIGGER     (0b11 << 6)
+#define MODEL_FIFO_TR               (1 << 5)
+#define MODEL_FIFO_FTH_MASK         0x1F
+#define MODEL_FIFO_WTM              (1 << 7)
+#define MODEL_FIFO_EMPTY            (1 << 5)
+
+/* Interrupt generator configuration modes (INTx_CFG AOI and 6D) */
+#define MODEL_INT_MODE_OR           0
+#define MODEL_INT_MODE_6D_MOVEMENT  LI2DE12_INT_6D
+#define MODEL_INT_MODE_AND          LI2DE12_INT_AOI
+#define MODEL_INT_MODE_6D_POSITION  (LI2DE12_INT_AOI | LI2DE12_INT_6D)
+#define MODEL_INT_EVENTS            0x3F
+#define MODEL_INT_Z_EVENTS          (LI2DE12_INT_ZLIE | LI2DE12_INT_ZHIE)
+
+/* Fixed-point fractional bits of the high-pass filter state */
+#define MODEL_HP_SHIFT              8
+
+#define MODEL_AXES                  3
+
+/** Interrupt generator. */
+typedef struct
+{
+    uint8_t cfgReg;                 /**< INTx_CFG, then SRC, THS and DUR. */
+    uint8_t latchBit;               /**< LIR_INTx in CTRL_REG5. */
+    uint8_t d4dBit;                 /**< D4D_INTx in CTRL_REG5. */
+    uint8_t duration;               /**< Samples the condition has held. */
+    uint8_t position;               /**< Last 6D position, for movements. */
+    bool active;                    /**< IA, as routed to the pins. */
+
+} Model_IntGen_t;
+
+/** Sample, in output digits. */
+typedef struct
+{
+    int8_t axis[MODEL_AXES];
+
+} Model_Sample_t;
+
+static bool Model_Start(bool read);
+static bool Model_Write(uint8_t byte);
+static uint8_t Model_Read(bool ack);
+static void Model_Stop(void);
+static Sim_Time_t Model_Next(void);
+static void Model_Run(Sim_Time_t now);
+static uint32_t Model_OdrFrequency(void);
+static void Model_Schedule(bool powerUp);
+static void Model_Convert(void);
+static int32_t Model_Digits(int32_t accel);
+static void Model_FifoPush(const Model_Sample_t *sample);
+static void Model_FifoPop(void);
+static bool Model_FifoActive(void);
+static void Model_Evaluate(Model_IntGen_t *gen, const int32_t value[]);
+static void Model_UpdateFlags(void);
+static uint8_t Model_ReadRegister(uint8_t reg);
+static void Model_WriteRegister(uint8_t reg, uint8_t value);
+static bool Model_IsReadOnly(uint8_t reg);
+static void Model_ResetFilter(void);
+static uint32_t Model_Random(void);
+
+static const Bus_Device_t device =
+{
+    Model_Start, Model_Write, Model_Read, Model_Stop
+};
+
+static bool present = true;
+static uint8_t regs[MODEL_REGISTERS];
+
+/** Register pointer of the transfer in progress. */
+static uint8_t pointer;
+static bool autoIncrement;
+static bool expectSubAddress;
+
+/** Sampling: time the current data rate started at, and samples since. */
+static Sim_Time_t sampleBase;
+static uint64_t sampleIndex;
+static Sim_Time_t nextSample = SIM_NEVER;
+
+/** Input: a constant value, or a trace replayed from its start time. */
+static int32_t accel[MODEL_AXES] = { 0, 0, 1000 };
+static int32_t temperature = 25000;
+static int32_t tempReference = 25000;
+static Trace_t trace;
+static Sim_Time_t traceStart;
+static uint32_t noise;
+static uint32_t noiseState = 1;
+static int32_t selfTestResponse[MODEL_AXES] = { 70, 70, 100 };
+
+/** Output: last sample, FIFO, filter state and interrupt generators. */
+static Model_Sample_t output;
+static Model_Sample_t fifo[LIS2DE12_FIFO_SIZE];
+static uint32_t fifoHead;
+static uint32_t fifoCount;
+static bool fifoOverrun;
+static int32_t raw[MODEL_AXES];
+static int32_t hpState[MODEL_AXES];
+static bool hpReset;
+static Model_IntGen_t gen1 = { LI2DE12_INT1_CFG, MODEL_LIR_INT1,
+    MODEL_D4D_INT1 };
+static Model_IntGen_t gen2 = { LI2DE12_INT2_CFG, LI2DE12_LIR_INT2,
+    LI2DE12_D4D_INT2 };
+
+/** Temperature output locked between the OUT_TEMP_L and OUT_TEMP_H reads. */
+static bool tempLocked;
+
+static Model_Stats_t stats;
+
+__attribute__((constructor(102)))
+static void Model_Init(void)
+{
+    Model_Reset();
+    Bus_Attach(LIS2DE12_I2C_ADDR_1, &device);
+    Sim_AddComponent(Model_Next, Model_Run);
+}
+
+/**
+ * Power-on reset: the registers, the FIFO and the filter are reset, and the
+ * device is powered down. The input and the faults are kept.
+ */
+void Model_Reset(void)
+{
+    memset(regs, 0, sizeof(regs));
+    regs[LI2DE12_WHO_AM_I] = MODEL_WHO_AM_I;
+    regs[LI2DE12_CTRL_REG0] = 0x10;
+    regs[LI2DE12_CTRL_REG1] = LI2DE12_XYZ_EN;
+
+    memset(&output, 0, sizeof(output));
+    fifoHead = 0;
+    fifoCount = 0;
+    fifoOverrun = false;
+    memset(raw, 0, sizeof(raw));
+    memset(hpState, 0, sizeof(hpState));
+    hpReset = true;
+    gen1.duration = gen2.duration = 0;
+    gen1.position = gen2.position = 0;
+    gen1.active = gen2.active = false;
+    tempLocked = false;
+    expectSubAddress = false;
+    nextSample = SIM_NEVER;
+
+    Model_UpdateFlags();
+}
+
+/**
+ * Connect or disconnect the device: a missing device doesn't acknowledge
+ * its address.
+ *
+ * @param   connected   Whether the device answers.
+ */
+void Model_SetPresent(bool connected)
+{
+    present = connected;
+}
+
+/**
+ * Set a constant acceleration, replacing any trace.
+ *
+ * @param   x   Acceleration of the X axis (mg).
+ * @param   y   Acceleration of the Y axis (mg).
+ * @param   z   Acceleration of the Z axis (mg).
+ */
+void Model_SetAcceleration(int32_t x, int32_t y, int32_t z)
+{
+    Trace_Free(&trace);
+    accel[0] = x;
+    accel[1] = y;
+    accel[2] = z;
+}
+
+/**
+ * Set a constant temperature, replacing any trace.
+ *
+ * @param   temp    Temperature (m°C).
+ */
+void Model_SetTemperature(int32_t temp)
+{
+    Trace_Free(&trace);
+    temperature = temp;
+}
+
+/**
+ * Set the device-specific temperature which reads as zero.
+ *
+ * @param   temp    Temperature (m°C).
+ */
+void Model_SetTempReference(int32_t temp)
+{
+    tempReference = temp;
+}
+
+/**
+ * Replay a trace from now on.
+ *
+ * @param   path    Path of the trace file.
+ *
+ * @returns It returns true if the trace has been loaded with success.
+ */
+bool Model_LoadTrace(const char *path)
+{
+    Trace_Free(&trace);
+    traceStart = Sim_Now();
+
+    return Trace_Load(&trace, path);
+}
+
+/**
+ * Add a uniform noise to each axis of each sample.
+ *
+ * @param   amplitude   Peak noise (mg), 0 for none.
+ * @param   seed        Seed of the pseudo-random sequence (not 0).
+ */
+void Model_SetNoise(uint32_t amplitude, uint32_t seed)
+{
+    noise = amplitude;
+    noiseState = seed ? seed : 1;
+}
+
+/**
+ * Set the output change of an axis in the positive self-test mode, e.g. to
+ * model a broken axis. The negative mode changes it the other way round.
+ *
+ * @param   axis        Axis (LIS2DE12_AXIS_*).
+ * @param   response    Output change (digits at +-2g).
+ */
+void Model_SetSelfTestResponse(uint32_t axis, int32_t response)
+{
+    selfTestResponse[axis] = response;
+}
+
+/**
+ * Get a register value without any side effect.
+ *
+ * @param   reg     Register address.
+ *
+ * @returns It returns the register value.
+ */
+uint8_t Model_GetRegister(uint8_t reg)
+{
+    return regs[reg & (MODEL_REGISTERS - 1)];
+}
+
+uint32_t Model_GetFifoLevel(void)
+{
+    return fifoCount;
+}
+
+/**
+ * Get the level of the INT1 pin.
+ *
+ * @returns It returns true if the pin is high.
+ */
+bool Model_GetInt1(void)
+{
+    uint8_t ctrl3 = regs[LI2DE12_CTRL_REG3];
+    uint8_t fifoSrc = regs[LI2DE12_FIFO_SRC_REG];
+    bool active;
+
+    active = ((ctrl3 & MODEL_I1_IA1) && gen1.active)
+        || ((ctrl3 & MODEL_I1_IA2) && gen2.active)
+        || ((ctrl3 & MODEL_I1_ZYXDA)
+            && (regs[LI2DE12_STATUS_REG] & MODEL_ZYXDA))
+        || ((ctrl3 & LI2DE12_I1_WTM) && (fifoSrc & MODEL_FIFO_WTM))
+        || ((ctrl3 & MODEL_I1_OVERRUN) && (fifoSrc & LI2DE12_FIFO_OVRN));
+
+    return active != ((regs[LI2DE12_CTRL_REG6] & MODEL_INT_POLARITY) != 0);
+}
+
+/**
+ * Get the level of the INT2 pin.
+ *
+ * @returns It returns true if the pin is high.
+ */
+bool Model_GetInt2(void)
+{
+    uint8_t ctrl6 = regs[LI2DE12_CTRL_REG6];
+    bool active;
+
+    active = ((ctrl6 & LI2DE12_I2_IA1) && gen1.active)
+        || ((ctrl6 & LI2DE12_I2_IA2) && gen2.active);
+
+    return active != ((ctrl6 & MODEL_INT_POLARITY) != 0);
+}
+
+void Model_GetStats(Model_Stats_t *out)
+{
+    *out = stats;
+}
+
+void Model_ResetStats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+/**
+ * Addressed: a write starts with the sub-address, a read (after a repeated
+ * START) goes on from the register pointer.
+ */
+static bool Model_Start(bool read)
+{
+    if (!present)
+    {
+        return false;
+    }
+
+    expectSubAddress = !read;
+
+    return true;
+}
+
+static bool Model_Write(uint8_t byte)
+{
+    if (expectSubAddress)
+    {
+        pointer = byte & 0x7F;
+        autoIncrement = (byte & 0x80) != 0;
+        expectSubAddress = false;
+        return true;
+    }
+
+    Model_WriteRegister(pointer, byte);
+
+    if (autoIncrement)
+    {
+        pointer = (pointer + 1) & 0x7F;
+    }
+
+    return true;
+}
+
+static uint8_t Model_Read(bool ack)
+{
+    uint8_t value = Model_ReadRegister(pointer);
+
+    if (!autoIncrement)
+    {
+        return value;
+    }
+
+    /* The FIFO is read as a burst of whole samples */
+    if ((pointer == LI2DE12_OUT_Z_H)
+            && (regs[LI2DE12_CTRL_REG5] & LI2DE12_FIFO_EN))
+    {
+        pointer = LI2DE12_FIFO_READ_START;
+    }
+    else
+    {
+        pointer = (pointer + 1) & 0x7F;
+    }
+
+    return value;
+}
+
+static void Model_Stop(void)
+{
+    expectSubAddress = false;
+}
+
+static Sim_Time_t Model_Next(void)
+{
+    return nextSample;
+}
+
+/**
+ * Convert the samples due.
+ */
+static void Model_Run(Sim_Time_t now)
+{
+    uint32_t frequency = Model_OdrFrequency();
+
+    Model_Convert();
+
+    sampleIndex++;
+    nextSample = sampleBase + (sampleIndex * SIM_S(1)) / frequency;
+}
+
+/**
+ * Get the data rate set in CTRL_REG1.
+ *
+ * @returns It returns the frequency in Hertz, or 0 if powered down.
+ */
+static uint32_t Model_OdrFrequency(void)
+{
+    static const uint32_t frequencies[] =
+    {
+        0, 1, 10, 25, 50, 100, 200, 400, 1620, 5376
+    };
+    uint8_t odr = (regs[LI2DE12_CTRL_REG1] & LI2DE12_ODR_MASK) >> 4;
+
+    if (odr >= sizeof(frequencies) / sizeof(frequencies[0]))
+    {
+        return 0;
+    }
+
+    /* 1344Hz in the normal mode */
+    if ((odr == 9) && !(regs[LI2DE12_CTRL_REG1] & LI2DE12_LP_EN))
+    {
+        return 1344;
+    }
+
+    return frequencies[odr];
+}
+
+/**
+ * Start sampling at the data rate just set.
+ *
+ * @param   powerUp     Whether the device was powered down.
+ */
+static void Model_Schedule(bool powerUp)
+{
+    uint32_t frequency = Model_OdrFrequency();
+
+    if (frequency == 0)
+    {
+        nextSample = SIM_NEVER;
+        return;
+    }
+
+    sampleBase = Sim_Now() + (powerUp ? MODEL_TURN_ON_TIME : 0);
+    sampleIndex = 1;
+    nextSample = sampleBase + SIM_S(1) / frequency;
+}
+
+/**
+ * Convert a sample: acceleration through the filter to the outputs and the
+ * interrupt generators, and temperature.
+ */
+static void Model_Convert(void)
+{
+    uint8_t ctrl2 = regs[LI2DE12_CTRL_REG2];
+    uint8_t ctrl4 = regs[LI2DE12_CTRL_REG4];
+    uint8_t cutoff = (ctrl2 & LI2DE12_HPCF_MASK) >> 4;
+    Trace_Point_t point;
+    Model_Sample_t sample;
+    int32_t filtered[MODEL_AXES];
+    int32_t input[MODEL_AXES];
+    int32_t value;
+    uint32_t axis;
+
+    if (trace.count)
+    {
+        Trace_Sample(&trace, (Sim_Now() - traceStart) / SIM_UNITS_PER_US,
+            &point);
+        memcpy(accel, point.accel, sizeof(accel));
+        temperature = point.temp;
+    }
+
+    for (axis = 0; axis < MODEL_AXES; axis++)
+    {
+        value = accel[axis];
+
+        if (noise)
+        {
+            value += (int32_t) (Model_Random() % (2 * noise + 1))
+                - (int32_t) noise;
+        }
+
+        raw[axis] = Model_Digits(value);
+
+        switch (ctrl4 & MODEL_ST_MASK)
+        {
+            case LI2DE12_ST_0:
+                raw[axis] += selfTestResponse[axis];
+                break;
+
+            case LI2DE12_ST_1:
+                raw[axis] -= selfTestResponse[axis];
+                break;
+
+            default:
+                break;
+        }
+
+        raw[axis] = (raw[axis] > INT8_MAX) ? INT8_MAX
+            : (raw[axis] < INT8_MIN) ? INT8_MIN : raw[axis];
+
+        /* First order high-pass filter, whose cutoff halves with each
+         * HPCF step, or a plain difference in the reference mode */
+        if ((ctrl2 & LI2DE12_HPM_MASK) == LI2DE12_HPM_REFERENCE)
+        {
+            filtered[axis] = raw[axis]
+                - (int8_t) regs[LI2DE12_REFERENCE];
+        }
+        else
+        {
+            if (hpReset)
+            {
+                hpState[axis] = raw[axis] << MODEL_HP_SHIFT;
+            }
+
+            hpState[axis] += ((raw[axis] << MODEL_HP_SHIFT) - hpState[axis])
+                >> (3 + cutoff);
+            filtered[axis] = raw[axis] - (hpState[axis] >> MODEL_HP_SHIFT);
+        }
+
+        sample.axis[axis] = (ctrl2 & LI2DE12_HP_FDS) ? filtered[axis]
+            : raw[axis];
+    }
+
+    hpReset = false;
+    stats.samples++;
+
+    /* Output registers and FIFO */
+    if (regs[LI2DE12_STATUS_REG] & MODEL_ZYXDA)
+    {
+        regs[LI2DE12_STATUS_REG] |= MODEL_ZYXOR;
+    }
+
+    regs[LI2DE12_STATUS_REG] |= MODEL_ZYXDA;
+    output = sample;
+
+    if (Model_FifoActive())
+    {
+        Model_FifoPush(&sample);
+    }
+
+    /* Interrupt generators */
+    for (axis = 0; axis < MODEL_AXES; axis++)
+    {
+        input[axis] = (ctrl2 & LI2DE12_HP_IA1) ? filtered[axis] : raw[axis];
+    }
+
+    Model_Evaluate(&gen1, input);
+
+    for (axis = 0; axis < MODEL_AXES; axis++)
+    {
+        input[axis] = (ctrl2 & LI2DE12_HP_IA2) ? filtered[axis] : raw[axis];
+    }
+
+    Model_Evaluate(&gen2, input);
+
+    if (((ctrl2 & LI2DE12_HPM_MASK) == LI2DE12_HPM_AUTORESET)
+            && (gen1.active || gen2.active))
+    {
+        Model_ResetFilter();
+    }
+
+    /* Temperature, only updated with the block data update */
+    if (((regs[LI2DE12_TEMP_CFG_REG] & LI2DE12_TEMP_ENABLED)
+                == LI2DE12_TEMP_ENABLED)
+            && (ctrl4 & LI2DE12_BDU) && !tempLocked)
+    {
+        value = (temperature - tempReference
+            + ((temperature >= tempReference) ? 500 : -500)) / 1000;
+        value = (value > INT8_MAX) ? INT8_MAX
+            : (value < INT8_MIN) ? INT8_MIN : value;
+
+        if (regs[LI2DE12_STATUS_REG_AUX] & LI2DE12_TDA)
+        {
+            regs[LI2DE12_STATUS_REG_AUX] |= MODEL_TOR;
+        }
+
+        regs[LI2DE12_STATUS_REG_AUX] |= LI2DE12_TDA;
+        regs[LI2DE12_OUT_TEMP_L] = 0;
+        regs[LI2DE12_OUT_TEMP_H] = (uint8_t) value;
+    }
+
+    Model_UpdateFlags();
+}
+
+/**
+ * Convert an acceleration into output digits (8-bit) at the full scale set.
+ */
+static int32_t Model_Digits(int32_t value)
+{
+    static const int32_t sensitivities[] = { 16, 32, 64, 192 };
+    int32_t sensitivity = sensitivities[(regs[LI2DE12_CTRL_REG4]
+        & MODEL_FS_MASK) >> MODEL_FS_POS];
+
+    return (value + ((value >= 0) ? sensitivity / 2 : -sensitivity / 2))
+        / sensitivity;
+}
+
+/**
+ * Store a sample in the FIFO: the FIFO mode stops once full, the stream
+ * mode discards the oldest sample.
+ */
+static void Model_FifoPush(const Model_Sample_t *sample)
+{
+    uint8_t mode = regs[LI2DE12_FIFO_CTRL_REG] & MODEL_FIFO_MODE_MASK;
+    bool triggered;
+
+    /* Stream-to-FIFO: stream until the trigger, FIFO afterwards */
+    if (mode == MODEL_FIFO_MODE_TRIGGER)
+    {
+        triggered = (regs[LI2DE12_FIFO_CTRL_REG] & MODEL_FIFO_TR)
+            ? gen2.active : gen1.active;
+        mode = triggered ? LI2DE12_FIFO_MODE_FIFO : LI2DE12_FIFO_MODE_STREAM;
+    }
+
+    if (fifoCount == LIS2DE12_FIFO_SIZE)
+    {
+        stats.fifoLost++;
+        fifoOverrun = true;
+
+        if (mode == LI2DE12_FIFO_MODE_FIFO)
+        {
+            return;
+        }
+
+        fifoHead = (fifoHead + 1) % LIS2DE12_FIFO_SIZE;
+        fifoCount--;
+    }
+
+    fifo[(fifoHead + fifoCount) % LIS2DE12_FIFO_SIZE] = *sample;
+    fifoCount++;
+    stats.fifoPushed++;
+
+    if (fifoCount == LIS2DE12_FIFO_SIZE)
+    {
+        fifoOverrun = true;
+    }
+}
+
+static void Model_FifoPop(void)
+{
+    if (fifoCount == 0)
+    {
+        return;
+    }
+
+    fifoHead = (fifoHead + 1) % LIS2DE12_FIFO_SIZE;
+    fifoCount--;
+    fifoOverrun = false;
+    stats.fifoPopped++;
+}
+
+static bool Model_FifoActive(void)
+{
+    return (regs[LI2DE12_CTRL_REG5] & LI2DE12_FIFO_EN)
+        && ((regs[LI2DE12_FIFO_CTRL_REG] & MODEL_FIFO_MODE_MASK)
+            != LI2DE12_FIFO_MODE_BYPASS);
+}
+
+/**
+ * Run an interrupt generator on a sample. Out of the 6D modes, the events
+ * compare the magnitude of each axis against the threshold; in the 6D modes,
+ * the high (low) event is the axis above the threshold (below its
+ * opposite), i.e. pointing up (down). The condition shall hold for the
+ * duration before the interrupt is raised; a 6D movement is a new position
+ * which has held for the duration. A latched interrupt and its source hold
+ * until the source register is read, and they are raised again on the next
+ * sample if the condition still holds.
+ */
+static void Model_Evaluate(Model_IntGen_t *gen, const int32_t value[])
+{
+    uint8_t cfg = regs[gen->cfgReg];
+    uint8_t threshold = regs[gen->cfgReg + 2] & 0x7F;
+    uint8_t duration = regs[gen->cfgReg + 3] & 0x7F;
+    uint8_t mode = cfg & MODEL_INT_MODE_6D_POSITION;
+    uint8_t enabled = cfg & MODEL_INT_EVENTS;
+    bool latched = (regs[LI2DE12_CTRL_REG5] & gen->latchBit) != 0;
+    uint8_t events = 0;
+    bool condition;
+    uint32_t axis;
+    int32_t magnitude;
+
+    for (axis = 0; axis < MODEL_AXES; axis++)
+    {
+        magnitude = (value[axis] < 0) ? -value[axis] : value[axis];
+
+        if (mode & LI2DE12_INT_6D)
+        {
+            events |= (value[axis] > threshold) ? (2 << (axis * 2)) : 0;
+            events |= (value[axis] < -threshold) ? (1 << (axis * 2)) : 0;
+        }
+        else
+        {
+            events |= (magnitude > threshold) ? (2 << (axis * 2))
+                : (1 << (axis * 2));
+        }
+    }
+
+    if ((mode & LI2DE12_INT_6D) && (regs[LI2DE12_CTRL_REG5] & gen->d4dBit))
+    {
+        enabled &= ~MODEL_INT_Z_EVENTS;
+    }
+
+    events &= enabled;
+
+    switch (mode)
+    {
+        case MODEL_INT_MODE_AND:
+            condition = enabled && (events == enabled);
+            break;
+
+        case MODEL_INT_MODE_6D_MOVEMENT:
+            condition = events && (events != gen->position);
+            break;
+
+        default:
+            condition = (events != 0);
+            break;
+    }
+
+    if (!condition)
+    {
+        gen->duration = 0;
+    }
+    else if (gen->duration < duration)
+    {
+        gen->duration++;
+        condition = false;
+    }
+
+    if (latched && gen->active)
+    {
+        return;
+    }
+
+    if (condition && (mode & LI2DE12_INT_6D))
+    {
+        gen->position = events;
+    }
+
+    gen->active = condition;
+    regs[gen->cfgReg + 1] = events | (condition ? LI2DE12_SRC_IA : 0);
+}
+
+/**
+ * Refresh the FIFO status from the FIFO content.
+ */
+static void Model_UpdateFlags(void)
+{
+    uint8_t threshold = regs[LI2DE12_FIFO_CTRL_REG] & MODEL_FIFO_FTH_MASK;
+    uint8_t fifoSrc;
+
+    fifoSrc = (fifoCount > LI2DE12_FIFO_FSS_MASK) ? LI2DE12_FIFO_FSS_MASK
+        : fifoCount;
+
+    if (fifoCount > threshold)
+    {
+        fifoSrc |= MODEL_FIFO_WTM;
+    }
+
+    if (fifoOverrun)
+    {
+        fifoSrc |= LI2DE12_FIFO_OVRN;
+    }
+
+    if (fifoCount == 0)
+    {
+        fifoSrc |= MODEL_FIFO_EMPTY;
+    }
+
+    regs[LI2DE12_FIFO_SRC_REG] = fifoSrc;
+}
+
+/**
+ * Read a register, with its side effects.
+ */
+static uint8_t Model_ReadRegister(uint8_t reg)
+{
+    const Model_Sample_t *sample = &output;
+    uint8_t value;
+    uint8_t hpm;
+
+    stats.registerReads++;
+
+    if (reg >= MODEL_REGISTERS)
+    {
+        return 0;
+    }
+
+    if ((reg >= LI2DE12_FIFO_READ_START) && (reg <= LI2DE12_OUT_Z_H))
+    {
+        if (Model_FifoActive() && fifoCount)
+        {
+            sample = &fifo[fifoHead];
+        }
+
+        /* 8-bit outputs: the low registers read 0 */
+        value = (reg & 1) ? (uint8_t) sample->axis[(reg
+            - LI2DE12_FIFO_READ_START) / 2] : 0;
+
+        if (reg == LI2DE12_OUT_Z_H)
+        {
+            regs[LI2DE12_STATUS_REG] = 0;
+
+            if (Model_FifoActive())
+            {
+                Model_FifoPop();
+                Model_UpdateFlags();
+            }
+        }
+
+        return value;
+    }
+
+    value = regs[reg];
+
+    switch (reg)
+    {
+        case LI2DE12_OUT_TEMP_L:
+            tempLocked = true;
+            break;
+
+        case LI2DE12_OUT_TEMP_H:
+            tempLocked = false;
+            regs[LI2DE12_STATUS_REG_AUX] &= ~(LI2DE12_TDA | MODEL_TOR);
+            break;
+
+        case LI2DE12_REFERENCE:
+            hpm = regs[LI2DE12_CTRL_REG2] & LI2DE12_HPM_MASK;
+
+            if ((hpm == LI2DE12_HPM_NORMAL_RESET)
+                    || (hpm == LI2DE12_HPM_NORMAL))
+            {
+                Model_ResetFilter();
+            }
+            break;
+
+        case LI2DE12_INT1_SRC:
+            if (regs[LI2DE12_CTRL_REG5] & gen1.latchBit)
+            {
+                gen1.active = false;
+                regs[LI2DE12_INT1_SRC] = 0;
+            }
+            break;
+
+        case LI2DE12_INT2_SRC:
+            if (regs[LI2DE12_CTRL_REG5] & gen2.latchBit)
+            {
+                gen2.active = false;
+                regs[LI2DE12_INT2_SRC] = 0;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return value;
+}
+
+/**
+ * Write a register, with its side effects. The read-only registers are left
+ * as they are.
+ */
+static void Model_WriteRegister(uint8_t reg, uint8_t value)
+{
+    uint8_t before;
+
+    stats.registerWrites++;
+
+    if ((reg >= MODEL_REGISTERS) || Model_IsReadOnly(reg))
+    {
+        return;
+    }
+
+    before = regs[reg];
+    regs[reg] = value;
+
+    switch (reg)
+    {
+        case LI2DE12_CTRL_REG1:
+            if ((value ^ before) & LI2DE12_ODR_MASK)
+            {
+                Model_Schedule((before & LI2DE12_ODR_MASK)
+                    == LI2DE12_ODR_POWER_DOWN);
+            }
+            break;
+
+        case LI2DE12_CTRL_REG5:
+            /* The boot only reloads the trimming, which isn't modelled */
+            regs[reg] &= ~MODEL_BOOT;
+            break;
+
+        case LI2DE12_FIFO_CTRL_REG:
+            /* The bypass mode empties the FIFO */
+            if ((value & MODEL_FIFO_MODE_MASK) == LI2DE12_FIFO_MODE_BYPASS)
+            {
+                fifoHead = 0;
+                fifoCount = 0;
+                fifoOverrun = false;
+            }
+            break;
+
+        case LI2DE12_INT1_CFG:
+            gen1.duration = 0;
+            gen1.position = 0;
+            gen1.active = false;
+            regs[LI2DE12_INT1_SRC] = 0;
+            break;
+
+        case LI2DE12_INT2_CFG:
+            gen2.duration = 0;
+            gen2.position = 0;
+            gen2.active = false;
+            regs[LI2DE12_INT2_SRC] = 0;
+            break;
+
+        default:
+            break;
+    }
+
+    Model_UpdateFlags();
+}
+
+static bool Model_IsReadOnly(uint8_t reg)
+{
+    switch (reg)
+    {
+        case LI2DE12_STATUS_REG_AUX:
+        case LI2DE12_OUT_TEMP_L:
+        case LI2DE12_OUT_TEMP_H:
+        case LI2DE12_WHO_AM_I:
+        case LI2DE12_STATUS_REG:
+        case LI2DE12_FIFO_SRC_REG:
+        case LI2DE12_INT1_SRC:
+        case LI2DE12_INT2_SRC:
+        case LI2DE12_CLICK_SRC:
+            return true;
+
+        default:
+            return (reg < LI2DE12_CTRL_REG0)
+                || ((reg >= LI2DE12_FIFO_READ_START)
+                    && (reg <= LI2DE12_OUT_Z_H));
+    }
+}
+
+/**
+ * Make the acceleration the reference of the high-pass filter, from the next
+ * sample on.
+ */
+static void Model_ResetFilter(void)
+{
+    hpReset = true;
+}
+
+/**
+ * Get the next number of the noise sequence (xorshift32).
+ */
+static uint32_t Model_Random(void)
+{
+    noiseState ^= noiseState << 13;
+    noiseState ^= noiseState >> 17;
+    noiseState ^= noiseState << 5;
+
+    return noiseState;
+}
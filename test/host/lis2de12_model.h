@@ -0,0 +1,41 @@
+/**
+ * @brief   Register model of the LIS2DE12 accelerometer, attached to the I2C
+ *          bus model, with its FIFO, its interrupt generators and pins, the
+ *          temperature sensor and the self-test.
+ */
+
+#ifndef LIS2DE12_MODEL_H_
+#define LIS2DE12_MODEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Model counters. */
+typedef struct
+{
+    uint64_t samples;               /**< Samples converted. */
+    uint64_t fifoPushed;            /**< Samples stored in the FIFO. */
+    uint64_t fifoPopped;            /**< Samples read out of the FIFO. */
+    uint64_t fifoLost;              /**< Samples overwritten or dropped. */
+    uint64_t registerReads;
+    uint64_t registerWrites;
+
+} Model_Stats_t;
+
+void Model_Reset(void);
+void Model_SetPresent(bool present);
+void Model_SetAcceleration(int32_t x, int32_t y, int32_t z);
+void Model_SetTemperature(int32_t temp);
+void Model_SetTempReference(int32_t temp);
+bool Model_LoadTrace(const char *path);
+void Model_SetNoise(uint32_t amplitude, uint32_t seed);
+void Model_SetSelfTestResponse(uint32_t axis, int32_t response);
+
+uint8_t Model_GetRegister(uint8_t reg);
+uint32_t Model_GetFifoLevel(void);
+bool Model_GetInt1(void);
+bool Model_GetInt2(void);
+void Model_GetStats(Model_Stats_t *stats);
+void Model_ResetStats(void);
+
+#endif /* LIS2DE12_MODEL_H_ */
@@ -0,0 +1,185 @@
+/**
+ * @brief   Register model of the RCC and of the PWR controller: the
+ *          oscillators, the system clock switch, the over-drive and the
+ *          clocks the core wakes up on from the STOP mode.
+ *
+ * The oscillators, the PLLs and the over-drive are ready as soon as they are
+ * enabled, and the system clock is switched as soon as it's selected, so
+ * every wait loop of the HAL and of the firmware ends on its first check.
+ * The core clock the simulator runs at follows the switch.
+ */
+
+#include "rcc_periph.h"
+#include "sim.h"
+
+/* Oscillators of the CR register, with their ready flags one bit above */
+#define RCC_PERIPH_CR_ON            (RCC_CR_HSION | RCC_CR_HSEON | \
+                                     RCC_CR_PLLON | RCC_CR_PLLI2SON | \
+                                     RCC_CR_PLLSAION)
+
+static void RccPeriph_Post(uintptr_t address, bool write);
+static void RccPeriph_PwrPost(uintptr_t address, bool write);
+static void RccPeriph_StopExit(void);
+static bool RccPeriph_IsReady(uint32_t source);
+
+static RCC_TypeDef *rcc;
+static PWR_TypeDef *pwr;
+
+/** Whether a LSE crystal is fitted. */
+static bool lsePresent = true;
+
+__attribute__((constructor(102)))
+static void RccPeriph_Init(void)
+{
+    rcc = Sim_Backdoor(RCC);
+    pwr = Sim_Backdoor(PWR);
+
+    /* Reset values, running on the HSI */
+    rcc->CR = RCC_CR_HSION | RCC_CR_HSIRDY | (0x10 << RCC_CR_HSITRIM_Pos);
+    rcc->PLLCFGR = 0x24003010;
+    rcc->CSR = 0x0E000000;
+    pwr->CSR = PWR_CSR_VOSRDY;
+
+    Sim_Trap((uintptr_t) RCC, sizeof(RCC_TypeDef), NULL, RccPeriph_Post);
+    Sim_Trap((uintptr_t) PWR, sizeof(PWR_TypeDef), NULL, RccPeriph_PwrPost);
+    Sim_SetStopExitHook(RccPeriph_StopExit);
+}
+
+/**
+ * Fit or remove the LSE crystal. Without it, the LSE never gets ready.
+ *
+ * @param   present     Whether the crystal is fitted.
+ */
+void RccPeriph_SetLsePresent(bool present)
+{
+    lsePresent = present;
+
+    if (!present)
+    {
+        rcc->BDCR &= ~RCC_BDCR_LSERDY;
+    }
+}
+
+/**
+ * Apply the writes: the ready flags follow the oscillators, the system
+ * clock follows its selection and the reset flags are cleared.
+ */
+static void RccPeriph_Post(uintptr_t address, bool write)
+{
+    uint32_t reg = address & ~(uintptr_t) 3;
+    uint32_t cfgr;
+
+    if (!write)
+    {
+        return;
+    }
+
+    if (reg == (uintptr_t) &RCC->CR)
+    {
+        rcc->CR = (rcc->CR & ~(RCC_PERIPH_CR_ON << 1))
+            | ((rcc->CR & RCC_PERIPH_CR_ON) << 1);
+    }
+    else if (reg == (uintptr_t) &RCC->CFGR)
+    {
+        cfgr = rcc->CFGR;
+
+        if (RccPeriph_IsReady(cfgr & RCC_CFGR_SW))
+        {
+            rcc->CFGR = (cfgr & ~RCC_CFGR_SWS)
+                | ((cfgr & RCC_CFGR_SW) << RCC_CFGR_SWS_Pos);
+        }
+
+        Sim_ClockChanged();
+    }
+    else if (reg == (uintptr_t) &RCC->BDCR)
+    {
+        if (rcc->BDCR & RCC_BDCR_BDRST)
+        {
+            rcc->BDCR = RCC_BDCR_BDRST;
+        }
+        else if ((rcc->BDCR & RCC_BDCR_LSEON) && lsePresent)
+        {
+            rcc->BDCR |= RCC_BDCR_LSERDY;
+        }
+        else
+        {
+            rcc->BDCR &= ~RCC_BDCR_LSERDY;
+        }
+    }
+    else if (reg == (uintptr_t) &RCC->CSR)
+    {
+        if (rcc->CSR & RCC_CSR_RMVF)
+        {
+            rcc->CSR &= ~(RCC_CSR_RMVF | RCC_CSR_BORRSTF | RCC_CSR_PINRSTF
+                | RCC_CSR_PORRSTF | RCC_CSR_SFTRSTF | RCC_CSR_IWDGRSTF
+                | RCC_CSR_WWDGRSTF | RCC_CSR_LPWRRSTF);
+        }
+
+        rcc->CSR = (rcc->CSR & ~RCC_CSR_LSIRDY)
+            | ((rcc->CSR & RCC_CSR_LSION) ? RCC_CSR_LSIRDY : 0);
+    }
+}
+
+/**
+ * Apply the writes of the PWR control register: the over-drive ready flags
+ * follow its enable bits, and the wake-up and standby flags are cleared.
+ */
+static void RccPeriph_PwrPost(uintptr_t address, bool write)
+{
+    uint32_t cr = pwr->CR;
+
+    if (!write || ((address & ~(uintptr_t) 3) != (uintptr_t) &PWR->CR))
+    {
+        return;
+    }
+
+    if (cr & PWR_CR_CWUF)
+    {
+        pwr->CSR &= ~PWR_CSR_WUF;
+    }
+
+    if (cr & PWR_CR_CSBF)
+    {
+        pwr->CSR &= ~PWR_CSR_SBF;
+    }
+
+    pwr->CR = cr & ~(PWR_CR_CWUF | PWR_CR_CSBF);
+    pwr->CSR = (pwr->CSR & ~(PWR_CSR_ODRDY | PWR_CSR_ODSWRDY))
+        | ((cr & PWR_CR_ODEN) ? PWR_CSR_ODRDY : 0)
+        | ((cr & PWR_CR_ODEN) && (cr & PWR_CR_ODSWEN) ? PWR_CSR_ODSWRDY : 0);
+}
+
+/**
+ * Leave the STOP mode: the core runs on the HSI, the PLLs, the HSE and the
+ * over-drive are off.
+ */
+static void RccPeriph_StopExit(void)
+{
+    rcc->CR &= ~(RCC_CR_HSEON | RCC_CR_HSERDY | RCC_CR_PLLON | RCC_CR_PLLRDY
+        | RCC_CR_PLLI2SON | RCC_CR_PLLI2SRDY | RCC_CR_PLLSAION
+        | RCC_CR_PLLSAIRDY);
+    rcc->CR |= RCC_CR_HSION | RCC_CR_HSIRDY;
+    rcc->CFGR &= ~(RCC_CFGR_SW | RCC_CFGR_SWS);
+    pwr->CR &= ~(PWR_CR_ODEN | PWR_CR_ODSWEN);
+    pwr->CSR &= ~(PWR_CSR_ODRDY | PWR_CSR_ODSWRDY);
+
+    Sim_ClockChanged();
+}
+
+/**
+ * Check whether a system clock source is ready to be switched to.
+ */
+static bool RccPeriph_IsReady(uint32_t source)
+{
+    switch (source)
+    {
+        case RCC_CFGR_SW_HSI:
+            return (rcc->CR & RCC_CR_HSIRDY) != 0;
+
+        case RCC_CFGR_SW_HSE:
+            return (rcc->CR & RCC_CR_HSERDY) != 0;
+
+        default:
+            return (rcc->CR & RCC_CR_PLLRDY) != 0;
+    }
+}
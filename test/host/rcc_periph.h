@@ -0,0 +1,14 @@
+/**
+ * @brief   Register model of the RCC and of the PWR controller: the
+ *          oscillators, the system clock switch, the over-drive and the
+ *          clocks the core wakes up on from the STOP mode.
+ */
+
+#ifndef RCC_PERIPH_H_
+#define RCC_PERIPH_H_
+
+#include <stdbool.h>
+
+void RccPeriph_SetLsePresent(bool present);
+
+#endif /* RCC_PERIPH_H_ */
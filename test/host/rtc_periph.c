@@ -0,0 +1,391 @@
+/**
+ * @brief   Register model of the RTC: the calendar counted from the RTC
+ *          clock through the prescalers, the wake-up timer and the
+ *          timestamp of the event input.
+ *
+ * The calendar registers are computed from the simulated time whenever
+ * they are read, as with the shadow registers bypassed. The calendar starts
+ * at 2000-01-01 00:00:00, as after a backup domain reset, and keeps its
+ * seconds (not its sub-seconds) through the initialization mode.
+ */
+
+#include "rtc_periph.h"
+#include "sim.h"
+
+/* Flags cleared by writing 0 */
+#define RTC_PERIPH_ISR_RC_W0        (RTC_ISR_ALRAF | RTC_ISR_ALRBF | \
+                                     RTC_ISR_WUTF | RTC_ISR_TSF | \
+                                     RTC_ISR_TSOVF | RTC_ISR_TAMP1F | \
+                                     RTC_ISR_TAMP2F | RTC_ISR_RSF)
+
+/* EXTI lines of the timestamp and the wake-up timer */
+#define RTC_PERIPH_EXTI_TIMESTAMP   (1U << 21)
+#define RTC_PERIPH_EXTI_WAKEUP      (1U << 22)
+
+#define RTC_PERIPH_SECONDS_PER_DAY  86400
+
+#define RTC_PERIPH_BCD(value)       ((((value) / 10) << 4) | ((value) % 10))
+
+static void RtcPeriph_Pre(uintptr_t address, bool write);
+static void RtcPeriph_Post(uintptr_t address, bool write);
+static Sim_Time_t RtcPeriph_Next(void);
+static void RtcPeriph_Run(Sim_Time_t now);
+static uint32_t RtcPeriph_Synch(void);
+static uint32_t RtcPeriph_Asynch(void);
+static uint64_t RtcPeriph_Ticks(void);
+static void RtcPeriph_Calendar(uint32_t *ssr, uint32_t *tr, uint32_t *dr);
+static void RtcPeriph_StartWakeUpTimer(void);
+static Sim_Time_t RtcPeriph_CycleTime(uint64_t cycle);
+
+static RTC_TypeDef *rtc;
+static EXTI_TypeDef *exti;
+
+/** RTC clock (LSE by default). */
+static uint32_t rtcClock = LSE_VALUE;
+
+/** Calendar: synchronous prescaler ticks since 2000 at the epoch, or the
+ * seconds it's stopped at in the initialization mode. */
+static Sim_Time_t epochTime;
+static uint64_t epochTicks;
+static bool frozen;
+static uint64_t frozenSeconds;
+
+/** Wake-up timer: next expiry and reload period. */
+static Sim_Time_t wutNext = SIM_NEVER;
+static Sim_Time_t wutPeriod;
+static uint64_t wakeUps;
+
+/** Level of the timestamp input. */
+static bool timestampPin;
+
+/** Register values before the access being trapped. */
+static uint32_t isrBefore;
+static uint32_t crBefore;
+
+__attribute__((constructor(102)))
+static void RtcPeriph_Init(void)
+{
+    rtc = Sim_Backdoor(RTC);
+    exti = Sim_Backdoor(EXTI);
+
+    /* Reset values */
+    rtc->DR = 0x00002101;
+    rtc->ISR = RTC_ISR_INITS | RTC_ISR_WUTWF | RTC_ISR_ALRBWF
+        | RTC_ISR_ALRAWF;
+    rtc->PRER = 0x007F00FF;
+    rtc->WUTR = 0x0000FFFF;
+
+    Sim_Trap(RTC_BASE, sizeof(RTC_TypeDef), RtcPeriph_Pre, RtcPeriph_Post);
+    Sim_AddComponent(RtcPeriph_Next, RtcPeriph_Run);
+}
+
+/**
+ * Set the RTC clock frequency (e.g. a LSI off its nominal value).
+ *
+ * @param   frequency   Frequency in Hertz.
+ */
+void RtcPeriph_SetClock(uint32_t frequency)
+{
+    epochTicks = RtcPeriph_Ticks();
+    epochTime = Sim_Now();
+    rtcClock = frequency;
+}
+
+/**
+ * Set the calendar, at the start of a second.
+ *
+ * @param   days        Days since 2000-01-01.
+ * @param   seconds     Seconds since midnight.
+ */
+void RtcPeriph_SetCalendar(uint32_t days, uint32_t seconds)
+{
+    uint64_t total = (uint64_t) days * RTC_PERIPH_SECONDS_PER_DAY + seconds;
+
+    frozenSeconds = total;
+    epochTime = Sim_Now();
+    epochTicks = total * (RtcPeriph_Synch() + 1);
+}
+
+/**
+ * Drive the timestamp input. The edge selected by TSEDGE latches the
+ * calendar, or sets the overflow flag if an earlier one is still pending.
+ *
+ * @param   level   Level of the input.
+ */
+void RtcPeriph_TimestampPin(bool level)
+{
+    bool falling = (rtc->CR & RTC_CR_TSEDGE) != 0;
+    bool edge = (level != timestampPin) && (level != falling);
+    uint32_t ssr;
+    uint32_t tr;
+    uint32_t dr;
+
+    timestampPin = level;
+
+    if (!edge || !(rtc->CR & RTC_CR_TSE))
+    {
+        return;
+    }
+
+    if (rtc->ISR & RTC_ISR_TSF)
+    {
+        rtc->ISR |= RTC_ISR_TSOVF;
+        return;
+    }
+
+    RtcPeriph_Calendar(&ssr, &tr, &dr);
+
+    rtc->TSTR = tr;
+    rtc->TSDR = dr & (RTC_TSDR_WDU | RTC_TSDR_MT | RTC_TSDR_MU | RTC_TSDR_DT
+        | RTC_TSDR_DU);
+    rtc->TSSSR = ssr;
+    rtc->ISR |= RTC_ISR_TSF;
+
+    if (rtc->CR & RTC_CR_TSIE)
+    {
+        exti->PR |= RTC_PERIPH_EXTI_TIMESTAMP;
+        Sim_PendIrq(TAMP_STAMP_IRQn);
+    }
+}
+
+/**
+ * Get the number of wake-up timer expiries.
+ *
+ * @returns It returns the number of expiries.
+ */
+uint64_t RtcPeriph_GetWakeUps(void)
+{
+    return wakeUps;
+}
+
+/**
+ * Refresh the calendar and the status flags before they are accessed.
+ */
+static void RtcPeriph_Pre(uintptr_t address, bool write)
+{
+    uint32_t reg = address & ~(uintptr_t) 3;
+
+    isrBefore = rtc->ISR;
+    crBefore = rtc->CR;
+
+    if ((reg == (uintptr_t) &RTC->SSR) || (reg == (uintptr_t) &RTC->TR)
+            || (reg == (uintptr_t) &RTC->DR))
+    {
+        RtcPeriph_Calendar((uint32_t *) &rtc->SSR, (uint32_t *) &rtc->TR,
+            (uint32_t *) &rtc->DR);
+    }
+    else if (reg == (uintptr_t) &RTC->ISR)
+    {
+        /* The shadow registers are always synced, and the write flags are
+         * set as soon as their unit is disabled */
+        rtc->ISR &= ~(RTC_ISR_ALRAWF | RTC_ISR_ALRBWF | RTC_ISR_WUTWF);
+        rtc->ISR |= RTC_ISR_RSF
+            | ((rtc->CR & RTC_CR_ALRAE) ? 0 : RTC_ISR_ALRAWF)
+            | ((rtc->CR & RTC_CR_ALRBE) ? 0 : RTC_ISR_ALRBWF)
+            | ((rtc->CR & RTC_CR_WUTE) ? 0 : RTC_ISR_WUTWF);
+        isrBefore = rtc->ISR;
+    }
+}
+
+/**
+ * Apply the writes: the ISR flags and the initialization mode, and the
+ * wake-up timer enable.
+ */
+static void RtcPeriph_Post(uintptr_t address, bool write)
+{
+    uint32_t reg = address & ~(uintptr_t) 3;
+    uint32_t value;
+
+    if (!write)
+    {
+        return;
+    }
+
+    if (reg == (uintptr_t) &RTC->ISR)
+    {
+        value = rtc->ISR;
+
+        rtc->ISR = (isrBefore & ~(RTC_PERIPH_ISR_RC_W0 | RTC_ISR_INIT
+                | RTC_ISR_INITF))
+            | (isrBefore & value & RTC_PERIPH_ISR_RC_W0)
+            | ((value & RTC_ISR_INIT) ? (RTC_ISR_INIT | RTC_ISR_INITF) : 0);
+
+        if ((value & RTC_ISR_INIT) && !frozen)
+        {
+            frozenSeconds = RtcPeriph_Ticks() / (RtcPeriph_Synch() + 1);
+            frozen = true;
+        }
+        else if (!(value & RTC_ISR_INIT) && frozen)
+        {
+            /* The counters restart from the whole second */
+            frozen = false;
+            epochTime = Sim_Now();
+            epochTicks = frozenSeconds * (RtcPeriph_Synch() + 1);
+        }
+    }
+    else if (reg == (uintptr_t) &RTC->CR)
+    {
+        if ((rtc->CR & RTC_CR_WUTE) && !(crBefore & RTC_CR_WUTE))
+        {
+            RtcPeriph_StartWakeUpTimer();
+        }
+        else if (!(rtc->CR & RTC_CR_WUTE))
+        {
+            wutNext = SIM_NEVER;
+        }
+    }
+}
+
+static Sim_Time_t RtcPeriph_Next(void)
+{
+    return wutNext;
+}
+
+/**
+ * Expire the wake-up timer, which reloads itself.
+ */
+static void RtcPeriph_Run(Sim_Time_t now)
+{
+    rtc->ISR |= RTC_ISR_WUTF;
+    wakeUps++;
+
+    if (rtc->CR & RTC_CR_WUTIE)
+    {
+        exti->PR |= RTC_PERIPH_EXTI_WAKEUP;
+        Sim_PendIrq(RTC_WKUP_IRQn);
+    }
+
+    wutNext += wutPeriod;
+}
+
+static uint32_t RtcPeriph_Synch(void)
+{
+    return rtc->PRER & RTC_PRER_PREDIV_S;
+}
+
+static uint32_t RtcPeriph_Asynch(void)
+{
+    return (rtc->PRER & RTC_PRER_PREDIV_A) >> RTC_PRER_PREDIV_A_Pos;
+}
+
+/**
+ * Get the synchronous prescaler ticks elapsed since 2000.
+ */
+static uint64_t RtcPeriph_Ticks(void)
+{
+    unsigned __int128 cycles;
+
+    if (frozen)
+    {
+        return frozenSeconds * (RtcPeriph_Synch() + 1);
+    }
+
+    cycles = ((unsigned __int128) (Sim_Now() - epochTime) * rtcClock)
+        / SIM_S(1);
+
+    return epochTicks + (uint64_t) (cycles / (RtcPeriph_Asynch() + 1));
+}
+
+/**
+ * Compute the calendar registers from the time.
+ *
+ * @param   ssr     Sub-second register value.
+ * @param   tr      Time register value.
+ * @param   dr      Date register value.
+ */
+static void RtcPeriph_Calendar(uint32_t *ssr, uint32_t *tr, uint32_t *dr)
+{
+    static const uint8_t daysInMonth[] =
+        { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    uint32_t synch = RtcPeriph_Synch();
+    uint64_t ticks = RtcPeriph_Ticks();
+    uint64_t seconds = ticks / (synch + 1);
+    uint32_t days = seconds / RTC_PERIPH_SECONDS_PER_DAY;
+    uint32_t time = seconds % RTC_PERIPH_SECONDS_PER_DAY;
+    uint32_t weekDay = (days + 5) % 7 + 1;
+    uint32_t year = 0;
+    uint32_t month = 0;
+    uint32_t length;
+
+    while (days >= ((year % 4) ? 365U : 366U))
+    {
+        days -= (year % 4) ? 365 : 366;
+        year++;
+    }
+
+    while (1)
+    {
+        length = daysInMonth[month] + (((month == 1) && !(year % 4)) ? 1 : 0);
+
+        if (days < length)
+        {
+            break;
+        }
+
+        days -= length;
+        month++;
+    }
+
+    *ssr = synch - (uint32_t) (ticks % (synch + 1));
+    *tr = (RTC_PERIPH_BCD(time / 3600) << RTC_TR_HU_Pos)
+        | (RTC_PERIPH_BCD(time / 60 % 60) << RTC_TR_MNU_Pos)
+        | (RTC_PERIPH_BCD(time % 60) << RTC_TR_SU_Pos);
+    *dr = (RTC_PERIPH_BCD(year % 100) << RTC_DR_YU_Pos)
+        | (weekDay << RTC_DR_WDU_Pos)
+        | (RTC_PERIPH_BCD(month + 1) << RTC_DR_MU_Pos)
+        | (RTC_PERIPH_BCD(days + 1) << RTC_DR_DU_Pos);
+}
+
+/**
+ * Start the wake-up timer: it counts the edges of the clock selected, the
+ * RTCCLK divider (free running) or the 1Hz calendar clock, and expires after
+ * the reload value plus one of them, and then again every such interval.
+ */
+static void RtcPeriph_StartWakeUpTimer(void)
+{
+    uint32_t select = (rtc->CR & RTC_CR_WUCKSEL) >> RTC_CR_WUCKSEL_Pos;
+    uint64_t count = (rtc->WUTR & RTC_WUTR_WUT) + 1;
+    uint64_t divider;
+    uint64_t edge;
+    uint64_t ticks;
+    uint32_t synch;
+
+    if (select < 4)
+    {
+        divider = 16 >> select;
+        edge = ((uint64_t) (((unsigned __int128) Sim_Now() * rtcClock)
+                / SIM_S(1)) / divider + 1) * divider;
+        wutNext = RtcPeriph_CycleTime(edge + (count - 1) * divider);
+    }
+    else
+    {
+        synch = RtcPeriph_Synch() + 1;
+        divider = (uint64_t) (RtcPeriph_Asynch() + 1) * synch;
+
+        if (select >= 6)
+        {
+            count += 0x10000;
+        }
+
+        /* Next second of the calendar */
+        ticks = (RtcPeriph_Ticks() / synch + 1) * synch;
+        wutNext = epochTime + (((ticks - epochTicks)
+                * (RtcPeriph_Asynch() + 1) * SIM_S(1) + rtcClock - 1)
+            / rtcClock) + ((count - 1) * divider * SIM_S(1)) / rtcClock;
+    }
+
+    wutPeriod = (count * divider * SIM_S(1)) / rtcClock;
+}
+
+/**
+ * Get the time of a RTC clock edge, counted from the start.
+ *
+ * @param   cycle   RTC clock cycles since the start.
+ *
+ * @returns It returns the time of the edge.
+ */
+static Sim_Time_t RtcPeriph_CycleTime(uint64_t cycle)
+{
+    return (Sim_Time_t) (((unsigned __int128) cycle * SIM_S(1) + rtcClock - 1)
+        / rtcClock);
+}
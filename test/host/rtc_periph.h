@@ -0,0 +1,18 @@
+/**
+ * @brief   Register model of the RTC: the calendar counted from the RTC
+ *          clock through the prescalers, the wake-up timer and the
+ *          timestamp of the event input.
+ */
+
+#ifndef RTC_PERIPH_H_
+#define RTC_PERIPH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void RtcPeriph_SetClock(uint32_t frequency);
+void RtcPeriph_SetCalendar(uint32_t days, uint32_t seconds);
+void RtcPeriph_TimestampPin(bool level);
+uint64_t RtcPeriph_GetWakeUps(void);
+
+#endif /* RTC_PERIPH_H_ */
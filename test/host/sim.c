@@ -0,0 +1,1382 @@
+/**
+ * @brief   Host simulator of the STM32F446 core the firmware runs on: the
+ *          peripheral memory, the simulated time, the interrupts and the
+ *          low power modes.
+ */
+
+#include "sim.h"
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#define SIM_PAGE_SIZE               4096
+#define SIM_PAGE(address)           ((address) & ~(uintptr_t) (SIM_PAGE_SIZE - 1))
+
+#define SIM_TRAPS_MAX               16
+#define SIM_COMPONENTS_MAX          16
+#define SIM_POLLS_MAX               4
+
+/* Trapped pages a single instruction may touch */
+#define SIM_ACCESSES_MAX            4
+
+/* Trap flag of the x86 EFLAGS register, which single-steps an instruction */
+#define SIM_EFLAGS_TF               0x100
+
+/* Page fault error code bit set on writes */
+#define SIM_PF_WRITE                0x2
+
+/* Core cycles taken by the exception entry */
+#define SIM_EXCEPTION_CYCLES        12
+
+/* Number of times the same interrupt may be taken back to back before it's
+ * reported as a storm (a flag which is never cleared) */
+#define SIM_STORM_LIMIT             100000
+
+#define SIM_UNITS_PER_S             SIM_S(1)
+
+#define SIM_THREAD_PRIORITY         256
+
+/* Bit-band alias of the peripherals simulated */
+#define SIM_BIT_BAND_SIZE           (0x80000 * 32)
+
+/** Memory window mapped at the firmware addresses. */
+typedef struct
+{
+    uintptr_t base;
+    size_t size;
+    size_t offset;                  /**< Offset in the backing memory. */
+    uint8_t fill;                   /**< Value of the erased memory. */
+
+} Sim_Window_t;
+
+/** Trapped address range. */
+typedef struct
+{
+    uintptr_t base;
+    uint32_t size;
+    Sim_TrapHook_t pre;
+    Sim_TrapHook_t post;
+
+} Sim_TrapRange_t;
+
+/** Trapped access being single-stepped. */
+typedef struct
+{
+    const Sim_TrapRange_t *trap;
+    uintptr_t address;
+    uintptr_t page;
+    bool write;
+
+} Sim_Access_t;
+
+typedef struct
+{
+    Sim_NextEvent_t next;
+    Sim_Run_t run;
+
+} Sim_Component_t;
+
+/** Interrupt line. */
+typedef struct
+{
+    const char *name;
+    void (*handler)(void);
+    bool (*level)(void);
+    bool enabled;
+    bool pending;
+    bool active;
+    bool wakesFromStop;             /**< Routed through the EXTI. */
+
+} Sim_Irq_t;
+
+/* Firmware handlers, the ones it doesn't define are left NULL */
+extern void SysTick_Handler(void) __attribute__((weak));
+extern void PendSV_Handler(void) __attribute__((weak));
+extern void I2C1_EV_IRQHandler(void) __attribute__((weak));
+extern void I2C1_ER_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Stream0_IRQHandler(void) __attribute__((weak));
+extern void EXTI4_IRQHandler(void) __attribute__((weak));
+extern void EXTI9_5_IRQHandler(void) __attribute__((weak));
+extern void RTC_WKUP_IRQHandler(void) __attribute__((weak));
+extern void RTC_Alarm_IRQHandler(void) __attribute__((weak));
+extern void TAMP_STAMP_IRQHandler(void) __attribute__((weak));
+
+extern const uint8_t AHBPrescTable[16];
+
+/* Bounds of the host memory the firmware may hand to a DMA stream */
+extern void *__libc_stack_end;
+extern const char __executable_start[];
+
+static void Sim_MapMemory(void);
+static const Sim_Window_t *Sim_FindWindow(uintptr_t address);
+static bool Sim_IsTrappedPage(uintptr_t page);
+static const Sim_TrapRange_t *Sim_FindTrap(uintptr_t address);
+static void Sim_OnSegv(int sig, siginfo_t *info, void *context);
+static void Sim_OnStep(int sig, siginfo_t *info, void *context);
+static void Sim_SetNow(Sim_Time_t time);
+static Sim_Time_t Sim_NextEventTime(void);
+static void Sim_ScsPre(uintptr_t address, bool write);
+static void Sim_ScsPost(uintptr_t address, bool write);
+static void Sim_DwtPre(uintptr_t address, bool write);
+static void Sim_DwtPost(uintptr_t address, bool write);
+static uintptr_t Sim_BitBandTarget(uintptr_t address, uint32_t *bit);
+static void Sim_BitBandPre(uintptr_t address, bool write);
+static void Sim_BitBandPost(uintptr_t address, bool write);
+static Sim_Time_t Sim_TickNext(void);
+static void Sim_TickRun(Sim_Time_t now);
+static void Sim_TickRestart(void);
+static uint32_t Sim_Priority(int index);
+static bool Sim_IsPending(int index);
+static int Sim_NextInterrupt(bool ignoreMask, bool stop);
+static void Sim_Exception(int index);
+static void Sim_Sleep(bool wfe);
+static void Sim_Fail(const char *message, ...)
+    __attribute__((format(printf, 1, 2), noreturn));
+
+/* Peripherals (APB1, APB2, AHB1 with the backup SRAM), their bit-band
+ * aliases, the private peripheral bus and the OTP page */
+static const Sim_Window_t windows[] =
+{
+    { PERIPH_BASE, 0x80000, 0x0000000, 0x00 },
+    { PERIPH_BB_BASE, 0x1000000, 0x0080000, 0x00 },
+    { 0xE0000000, 0x100000, 0x1080000, 0x00 },
+    { SIM_PAGE(FLASH_OTP_BASE), SIM_PAGE_SIZE, 0x1180000, 0xFF }
+};
+
+#define SIM_MEMORY_SIZE             0x1181000
+
+static uint8_t *backdoor;
+
+static Sim_TrapRange_t traps[SIM_TRAPS_MAX];
+static uint32_t trapCount;
+
+static Sim_Access_t accesses[SIM_ACCESSES_MAX];
+static uint32_t accessCount;
+
+static Sim_Component_t components[SIM_COMPONENTS_MAX];
+static uint32_t componentCount;
+static void (*polls[SIM_POLLS_MAX])(void);
+static uint32_t pollCount;
+static void (*stopExitHook)(void);
+static bool advancing;
+
+/** Simulated time, and the deadline which ends the simulation. */
+static Sim_Time_t now;
+static Sim_Time_t deadline = SIM_NEVER;
+static jmp_buf *deadlineExit;
+
+/** Core state. */
+static uint32_t primask;
+static bool eventRegister;
+static bool asleep;
+static bool stopped;
+
+/** Interrupt lines, and the priorities of the active ones. */
+static Sim_Irq_t irqs[SIM_IRQS];
+static uint32_t activePriorities[SIM_IRQS];
+static uint32_t activeDepth;
+static int lastTaken = -1;
+static uint32_t takenInARow;
+
+/** Cycle counter: cycles at the last rebase, plus the awake time since
+ * then, in cycles * SIM_UNITS_PER_S. */
+static uint32_t cycleBase;
+static unsigned __int128 cycleAccum;
+static uint32_t coreClock;
+
+/** SysTick: next expiry, and the time left to it while stopped. */
+static Sim_Time_t tickNext = SIM_NEVER;
+static Sim_Time_t tickLeft;
+static Sim_Time_t tickPeriod;
+static uint32_t tickCtrlBefore;
+
+static Sim_WakeStats_t wakeStats;
+
+/** Cycles run while awake since the wake-up statistics were reset, in
+ * cycles * SIM_UNITS_PER_S. */
+static unsigned __int128 wakeCycleAccum;
+
+/**
+ * Map the memory, install the trap handlers and trap the core peripherals.
+ */
+__attribute__((constructor(101)))
+static void Sim_Init(void)
+{
+    struct sigaction action;
+
+    Sim_MapMemory();
+    coreClock = HSI_VALUE;
+
+    /* The interrupt handlers run from the trap handlers and access the
+     * registers too, so the traps shall nest */
+    memset(&action, 0, sizeof(action));
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+
+    action.sa_sigaction = Sim_OnSegv;
+    sigaction(SIGSEGV, &action, NULL);
+
+    action.sa_sigaction = Sim_OnStep;
+    sigaction(SIGTRAP, &action, NULL);
+
+    irqs[SysTick_IRQn + SIM_IRQ_OFFSET] = (Sim_Irq_t)
+        { "SysTick", SysTick_Handler, NULL, true };
+    irqs[PendSV_IRQn + SIM_IRQ_OFFSET] = (Sim_Irq_t)
+        { "PendSV", PendSV_Handler, NULL, true };
+    irqs[I2C1_EV_IRQn + SIM_IRQ_OFFSET] = (Sim_Irq_t)
+        { "I2C1_EV", I2C1_EV_IRQHandler };
+    irqs[I2C1_ER_IRQn + SIM_IRQ_OFFSET] = (Sim_Irq_t)
+        { "I2C1_ER", I2C1_ER_IRQHandler };
+    irqs[DMA1_Stream0_IRQn + SIM_IRQ_OFFSET] = (Sim_Irq_t)
+        { "DMA1_Stream0", DMA1_Stream0_IRQHandler };
+    irqs[EXTI4_IRQn + SIM_IRQ_OFFSET] = (Sim_Irq_t)
+        { "EXTI4", EXTI4_IRQHandler, NULL, false, false, false, true };
+    irqs[EXTI9_5_IRQn + SIM_IRQ_OFFSET] = (Sim_Irq_t)
+        { "EXTI9_5", EXTI9_5_IRQHandler, NULL, false, false, false, true };
+    irqs[RTC_WKUP_IRQn + SIM_IRQ_OFFSET] = (Sim_Irq_t)
+        { "RTC_WKUP", RTC_WKUP_IRQHandler, NULL, false, false, false, true };
+    irqs[RTC_Alarm_IRQn + SIM_IRQ_OFFSET] = (Sim_Irq_t)
+        { "RTC_Alarm", RTC_Alarm_IRQHandler, NULL, false, false, false, true };
+    irqs[TAMP_STAMP_IRQn + SIM_IRQ_OFFSET] = (Sim_Irq_t)
+        { "TAMP_STAMP", TAMP_STAMP_IRQHandler, NULL, false, false, false,
+            true };
+
+    Sim_AddComponent(Sim_TickNext, Sim_TickRun);
+
+    Sim_Trap(SCS_BASE, SIM_PAGE_SIZE, Sim_ScsPre, Sim_ScsPost);
+    Sim_Trap(DWT_BASE, SIM_PAGE_SIZE, Sim_DwtPre, Sim_DwtPost);
+    Sim_Trap(PERIPH_BB_BASE, SIM_BIT_BAND_SIZE, Sim_BitBandPre,
+        Sim_BitBandPost);
+}
+
+/**
+ * Get the simulated time.
+ *
+ * @returns It returns the time elapsed since the start.
+ */
+Sim_Time_t Sim_Now(void)
+{
+    return now;
+}
+
+/**
+ * Move the simulated time forward, running the events of the components in
+ * order. The interrupts raised meanwhile are left pending.
+ *
+ * @param   time    Time to be advanced to.
+ */
+void Sim_AdvanceTo(Sim_Time_t time)
+{
+    Sim_Component_t *next;
+    Sim_Time_t nextTime;
+    Sim_Time_t event;
+    uint32_t index;
+
+    if (advancing)
+    {
+        Sim_Fail("time advanced from a component event (trapped access "
+            "without the backdoor?)");
+    }
+
+    advancing = true;
+
+    while (1)
+    {
+        next = NULL;
+        nextTime = time;
+
+        for (index = 0; index < componentCount; index++)
+        {
+            event = components[index].next();
+
+            if ((event <= nextTime) && ((next == NULL) || (event < nextTime)))
+            {
+                next = &components[index];
+                nextTime = event;
+            }
+        }
+
+        if (next == NULL)
+        {
+            break;
+        }
+
+        Sim_SetNow(nextTime);
+        next->run(now);
+
+        for (index = 0; index < pollCount; index++)
+        {
+            polls[index]();
+        }
+    }
+
+    Sim_SetNow(time);
+
+    advancing = false;
+}
+
+/**
+ * Spend some time running, e.g. on a register access.
+ *
+ * @param   duration    Time spent.
+ */
+void Sim_Consume(Sim_Time_t duration)
+{
+    Sim_AdvanceTo(now + duration);
+}
+
+/**
+ * Spend some cycles of the core clock running.
+ *
+ * @param   cycles      Cycles spent.
+ */
+void Sim_ConsumeCycles(uint32_t cycles)
+{
+    Sim_Consume(((Sim_Time_t) cycles * SIM_UNITS_PER_S + coreClock - 1)
+        / coreClock);
+}
+
+/**
+ * Let the time go by from the thread mode, taking the interrupts as they
+ * come, as the main loop of a test.
+ *
+ * @param   duration    Time to let go by.
+ */
+void Sim_Idle(Sim_Time_t duration)
+{
+    Sim_Time_t end = now + duration;
+    Sim_Time_t next;
+
+    while (1)
+    {
+        Sim_TakeInterrupts();
+
+        if (now >= end)
+        {
+            return;
+        }
+
+        /* Idling between the interrupts, as a sleep, ends any storm */
+        next = Sim_NextEventTime();
+        Sim_AdvanceTo((next < end) ? next : end);
+        lastTaken = -1;
+    }
+}
+
+/**
+ * Set the time the simulation ends at. It's checked while the core sleeps,
+ * so firmware which never returns can be run for a given time.
+ *
+ * @param   time    End of the simulation, or SIM_NEVER.
+ * @param   exit    Where to jump to once reached.
+ */
+void Sim_SetDeadline(Sim_Time_t time, jmp_buf *exit)
+{
+    deadline = time;
+    deadlineExit = exit;
+}
+
+/**
+ * Add a component which takes part in the simulated time.
+ *
+ * @param   next    Function which returns the time of its next event.
+ * @param   run     Function which runs its events due.
+ */
+void Sim_AddComponent(Sim_NextEvent_t next, Sim_Run_t run)
+{
+    if (componentCount == SIM_COMPONENTS_MAX)
+    {
+        Sim_Fail("too many components");
+    }
+
+    components[componentCount++] = (Sim_Component_t) { next, run };
+}
+
+/**
+ * Add a function called after every event, which watches signals which
+ * changed (e.g. the GPIO inputs).
+ *
+ * @param   poll    Function to be called.
+ */
+void Sim_AddPoll(void (*poll)(void))
+{
+    if (pollCount == SIM_POLLS_MAX)
+    {
+        Sim_Fail("too many polls");
+    }
+
+    polls[pollCount++] = poll;
+}
+
+/**
+ * Set the function which applies the STOP mode exit to the clocks.
+ *
+ * @param   hook    Function to be called on the STOP mode exit.
+ */
+void Sim_SetStopExitHook(void (*hook)(void))
+{
+    stopExitHook = hook;
+}
+
+/**
+ * Trap the accesses to a register range. The pages it covers are protected,
+ * the other registers of those pages are accessed without any hook.
+ *
+ * @param   base    First address of the range.
+ * @param   size    Size of the range.
+ * @param   pre     Hook called before the access (it shall leave the value
+ *                  to be read in the register), or NULL.
+ * @param   post    Hook called after the access (the written value is in
+ *                  the register), or NULL.
+ */
+void Sim_Trap(uintptr_t base, uint32_t size, Sim_TrapHook_t pre,
+        Sim_TrapHook_t post)
+{
+    uintptr_t page;
+
+    if (trapCount == SIM_TRAPS_MAX)
+    {
+        Sim_Fail("too many traps");
+    }
+
+    traps[trapCount++] = (Sim_TrapRange_t) { base, size, pre, post };
+
+    for (page = SIM_PAGE(base); page < base + size; page += SIM_PAGE_SIZE)
+    {
+        mprotect((void *) page, SIM_PAGE_SIZE, PROT_NONE);
+    }
+}
+
+/**
+ * Get the alias of a register which is never trapped, for the peripheral
+ * models.
+ *
+ * @param   reg     Register address.
+ *
+ * @returns It returns the alias of the register.
+ */
+void *Sim_Backdoor(volatile const void *reg)
+{
+    uintptr_t address = (uintptr_t) reg;
+    const Sim_Window_t *window = Sim_FindWindow(address);
+
+    if (window == NULL)
+    {
+        Sim_Fail("no simulated memory at 0x%08lx", (unsigned long) address);
+    }
+
+    return backdoor + window->offset + (address - window->base);
+}
+
+/**
+ * Rebuild a host pointer which the firmware has stored into a 32-bit
+ * register (e.g. a DMA memory address). The tests are built without PIE, so
+ * the static data and the heap lie below 4GB, and only a stack address loses
+ * its high bits. The stack frames in scope lie between the current one and
+ * the top of the stack, so a stack address is rebuilt from the current one,
+ * and it shall be called while the memory is in scope.
+ *
+ * @param   address     Address held by the register.
+ *
+ * @returns It returns the host pointer.
+ */
+uintptr_t Sim_HostPointer(uint32_t address)
+{
+    uintptr_t current = (uintptr_t) &address;
+    uintptr_t stack = (current & ~(uintptr_t) UINT32_MAX) | address;
+
+    /* The stack may cross a 4GB boundary */
+    if (stack < current)
+    {
+        stack += (uintptr_t) UINT32_MAX + 1;
+    }
+
+    if (stack < (uintptr_t) __libc_stack_end)
+    {
+        return stack;
+    }
+
+    if (((uintptr_t) address >= (uintptr_t) __executable_start)
+            && ((uintptr_t) address < (uintptr_t) sbrk(0)))
+    {
+        return address;
+    }
+
+    Sim_Fail("no host memory at 0x%08lx", (unsigned long) address);
+}
+
+/**
+ * Set the priority of an interrupt.
+ *
+ * @param   irq         Interrupt.
+ * @param   priority    Priority (0 is the highest, up to 15).
+ */
+void Sim_SetIrqPriority(IRQn_Type irq, uint32_t priority)
+{
+    NVIC_SetPriority(irq, priority);
+}
+
+/**
+ * Enable or disable an interrupt.
+ *
+ * @param   irq     Interrupt.
+ * @param   enable  Whether it's enabled.
+ */
+void Sim_EnableIrq(IRQn_Type irq, bool enable)
+{
+    if (enable)
+    {
+        NVIC_EnableIRQ(irq);
+    }
+    else
+    {
+        NVIC_DisableIRQ(irq);
+    }
+}
+
+/**
+ * Set an interrupt pending, as a pulse on its line would.
+ *
+ * @param   irq     Interrupt.
+ */
+void Sim_PendIrq(IRQn_Type irq)
+{
+    irqs[irq + SIM_IRQ_OFFSET].pending = true;
+}
+
+/**
+ * Attach a level source to an interrupt line, which keeps it pending while
+ * it's high (e.g. the flags of a peripheral).
+ *
+ * @param   irq     Interrupt.
+ * @param   level   Function which returns the level of the line.
+ */
+void Sim_SetIrqLevel(IRQn_Type irq, bool (*level)(void))
+{
+    irqs[irq + SIM_IRQ_OFFSET].level = level;
+}
+
+/**
+ * Check whether an interrupt handler is running.
+ *
+ * @param   irq     Interrupt.
+ *
+ * @returns It returns true if the interrupt is active.
+ */
+bool Sim_IsIrqActive(IRQn_Type irq)
+{
+    return irqs[irq + SIM_IRQ_OFFSET].active;
+}
+
+/**
+ * Check whether an interrupt is pending, latched or by its level.
+ *
+ * @param   irq     Interrupt.
+ *
+ * @returns It returns true if the interrupt is pending.
+ */
+bool Sim_IsIrqPending(IRQn_Type irq)
+{
+    return Sim_IsPending(irq + SIM_IRQ_OFFSET);
+}
+
+/**
+ * Take the pending interrupts which preempt the running context, if the
+ * interrupts are not masked.
+ */
+void Sim_TakeInterrupts(void)
+{
+    int index;
+
+    while (!primask)
+    {
+        index = Sim_NextInterrupt(false, false);
+
+        if (index < 0)
+        {
+            return;
+        }
+
+        Sim_Exception(index);
+
+        /* Sleep-on-exit: straight back to sleep on the return to the
+         * thread mode */
+        if ((activeDepth == 0) && (((SCB_Type *) Sim_Backdoor(SCB))->SCR
+                    & SCB_SCR_SLEEPONEXIT_Msk))
+        {
+            Sim_Sleep(false);
+        }
+    }
+}
+
+void Sim_Wfi(void)
+{
+    Sim_Sleep(false);
+    Sim_TakeInterrupts();
+}
+
+void Sim_Wfe(void)
+{
+    if (eventRegister)
+    {
+        eventRegister = false;
+        return;
+    }
+
+    Sim_Sleep(true);
+    Sim_TakeInterrupts();
+}
+
+void Sim_Sev(void)
+{
+    eventRegister = true;
+}
+
+uint32_t Sim_GetPrimask(void)
+{
+    return primask;
+}
+
+void Sim_SetPrimask(uint32_t mask)
+{
+    primask = mask & 1;
+
+    if (!primask)
+    {
+        Sim_TakeInterrupts();
+    }
+}
+
+/**
+ * Get the clock the core actually runs at, from the RCC registers (not the
+ * SystemCoreClock the firmware keeps).
+ *
+ * @returns It returns the core clock in Hertz.
+ */
+uint32_t Sim_GetCoreClock(void)
+{
+    const RCC_TypeDef *rcc = Sim_Backdoor(RCC);
+    uint32_t pllcfgr = rcc->PLLCFGR;
+    uint64_t input;
+    uint64_t sysclk;
+
+    switch (rcc->CFGR & RCC_CFGR_SWS)
+    {
+        case RCC_CFGR_SWS_HSE:
+            sysclk = HSE_VALUE;
+            break;
+
+        case RCC_CFGR_SWS_PLL:
+            input = (pllcfgr & RCC_PLLCFGR_PLLSRC) ? HSE_VALUE : HSI_VALUE;
+            sysclk = input / (pllcfgr & RCC_PLLCFGR_PLLM)
+                * ((pllcfgr & RCC_PLLCFGR_PLLN) >> RCC_PLLCFGR_PLLN_Pos)
+                / ((((pllcfgr & RCC_PLLCFGR_PLLP) >> RCC_PLLCFGR_PLLP_Pos)
+                    + 1) * 2);
+            break;
+
+        default:
+            sysclk = HSI_VALUE;
+            break;
+    }
+
+    return sysclk >> AHBPrescTable[(rcc->CFGR & RCC_CFGR_HPRE)
+        >> RCC_CFGR_HPRE_Pos];
+}
+
+/**
+ * Account a change of the core clock: the cycle counter and the SysTick run
+ * at the new one from now on.
+ */
+void Sim_ClockChanged(void)
+{
+    uint32_t clock = Sim_GetCoreClock();
+    const SysTick_Type *tick = Sim_Backdoor(SysTick);
+
+    if (clock == coreClock)
+    {
+        return;
+    }
+
+    coreClock = clock;
+    tickPeriod = ((uint64_t) (tick->LOAD + 1) * SIM_UNITS_PER_S) / coreClock;
+}
+
+void Sim_GetWakeStats(Sim_WakeStats_t *stats)
+{
+    *stats = wakeStats;
+    stats->cycles = (uint64_t) (wakeCycleAccum / SIM_UNITS_PER_S);
+}
+
+void Sim_ResetWakeStats(void)
+{
+    memset(&wakeStats, 0, sizeof(wakeStats));
+    wakeCycleAccum = 0;
+}
+
+/**
+ * Get the name of an interrupt line.
+ *
+ * @param   index   Line index (IRQn + SIM_IRQ_OFFSET).
+ *
+ * @returns It returns the name, or NULL for the lines not simulated.
+ */
+const char *Sim_IrqName(int index)
+{
+    return irqs[index].name;
+}
+
+/**
+ * Map the simulated memory at the firmware addresses, backed by a memory
+ * file which is also mapped once more as the backdoor.
+ */
+static void Sim_MapMemory(void)
+{
+    uint32_t index;
+    void *mapped;
+    int fd;
+
+    fd = memfd_create("sim", 0);
+
+    if ((fd < 0) || (ftruncate(fd, SIM_MEMORY_SIZE) != 0))
+    {
+        Sim_Fail("can't create the simulated memory");
+    }
+
+    backdoor = mmap(NULL, SIM_MEMORY_SIZE, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+
+    if (backdoor == MAP_FAILED)
+    {
+        Sim_Fail("can't map the simulated memory");
+    }
+
+    for (index = 0; index < sizeof(windows) / sizeof(windows[0]); index++)
+    {
+        mapped = mmap((void *) windows[index].base, windows[index].size,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, fd,
+            windows[index].offset);
+
+        if (mapped != (void *) windows[index].base)
+        {
+            Sim_Fail("can't map the simulated memory at 0x%08lx",
+                (unsigned long) windows[index].base);
+        }
+
+        memset(backdoor + windows[index].offset, windows[index].fill,
+            windows[index].size);
+    }
+
+    close(fd);
+}
+
+static const Sim_Window_t *Sim_FindWindow(uintptr_t address)
+{
+    uint32_t index;
+
+    for (index = 0; index < sizeof(windows) / sizeof(windows[0]); index++)
+    {
+        if ((address >= windows[index].base)
+                && (address < windows[index].base + windows[index].size))
+        {
+            return &windows[index];
+        }
+    }
+
+    return NULL;
+}
+
+static bool Sim_IsTrappedPage(uintptr_t page)
+{
+    uint32_t index;
+
+    for (index = 0; index < trapCount; index++)
+    {
+        if ((page < traps[index].base + traps[index].size)
+                && (page + SIM_PAGE_SIZE > traps[index].base))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static const Sim_TrapRange_t *Sim_FindTrap(uintptr_t address)
+{
+    uint32_t index;
+
+    for (index = 0; index < trapCount; index++)
+    {
+        if ((address >= traps[index].base)
+                && (address < traps[index].base + traps[index].size))
+        {
+            return &traps[index];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Handle an access to a trapped page: open the page, run the hook before
+ * the access and single-step the instruction.
+ */
+static void Sim_OnSegv(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = context;
+    uintptr_t address = (uintptr_t) info->si_addr;
+    uintptr_t page = SIM_PAGE(address);
+    Sim_Access_t *access;
+
+    if (!Sim_IsTrappedPage(page) || (accessCount == SIM_ACCESSES_MAX))
+    {
+        fprintf(stderr, "sim: invalid access at %p\n", info->si_addr);
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+
+    mprotect((void *) page, SIM_PAGE_SIZE, PROT_READ | PROT_WRITE);
+
+    access = &accesses[accessCount++];
+    access->trap = Sim_FindTrap(address);
+    access->address = address;
+    access->page = page;
+    access->write = (uc->uc_mcontext.gregs[REG_ERR] & SIM_PF_WRITE) != 0;
+
+    if (access->trap && access->trap->pre)
+    {
+        access->trap->pre(address, access->write);
+    }
+
+    uc->uc_mcontext.gregs[REG_EFL] |= SIM_EFLAGS_TF;
+}
+
+/**
+ * Complete the trapped accesses once the instruction has been executed: run
+ * the hooks after the access, protect the pages again and account the time
+ * taken.
+ */
+static void Sim_OnStep(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = context;
+    Sim_Access_t done[SIM_ACCESSES_MAX];
+    uint32_t count = accessCount;
+    uint32_t index;
+
+    uc->uc_mcontext.gregs[REG_EFL] &= ~SIM_EFLAGS_TF;
+
+    if (count == 0)
+    {
+        fprintf(stderr, "sim: unexpected trap\n");
+        abort();
+    }
+
+    memcpy(done, accesses, sizeof(done[0]) * count);
+    accessCount = 0;
+
+    for (index = 0; index < count; index++)
+    {
+        if (done[index].trap && done[index].trap->post)
+        {
+            done[index].trap->post(done[index].address, done[index].write);
+        }
+    }
+
+    for (index = 0; index < count; index++)
+    {
+        mprotect((void *) done[index].page, SIM_PAGE_SIZE, PROT_NONE);
+    }
+
+    Sim_ConsumeCycles(SIM_ACCESS_CYCLES * count);
+
+    /* The instruction is done: the interrupts raised meanwhile preempt the
+     * code which accessed the register, as on the core */
+    Sim_TakeInterrupts();
+}
+
+/**
+ * Set the time, counting the cycles of the core while it's awake.
+ */
+static void Sim_SetNow(Sim_Time_t time)
+{
+    const DWT_Type *dwt = Sim_Backdoor(DWT);
+
+    if (time <= now)
+    {
+        return;
+    }
+
+    if (!asleep && (dwt->CTRL & DWT_CTRL_CYCCNTENA_Msk))
+    {
+        cycleAccum += (unsigned __int128) (time - now) * coreClock;
+        wakeCycleAccum += (unsigned __int128) (time - now) * coreClock;
+    }
+
+    now = time;
+}
+
+static Sim_Time_t Sim_NextEventTime(void)
+{
+    Sim_Time_t next = SIM_NEVER;
+    Sim_Time_t event;
+    uint32_t index;
+
+    for (index = 0; index < componentCount; index++)
+    {
+        event = components[index].next();
+
+        if (event < next)
+        {
+            next = event;
+        }
+    }
+
+    return next;
+}
+
+/**
+ * Refresh the System Control Space registers which are read.
+ */
+static void Sim_ScsPre(uintptr_t address, bool write)
+{
+    SysTick_Type *tick = Sim_Backdoor(SysTick);
+    NVIC_Type *nvic = Sim_Backdoor(NVIC);
+    uint32_t reg = address & ~(uintptr_t) 3;
+    int index;
+
+    tickCtrlBefore = tick->CTRL;
+
+    if (reg == (uintptr_t) &SysTick->VAL)
+    {
+        tick->VAL = ((tickNext == SIM_NEVER) || (tickNext < now)) ? 0
+            : (uint32_t) (((unsigned __int128) (tickNext - now) * coreClock)
+                / SIM_UNITS_PER_S);
+    }
+    else if ((reg >= (uintptr_t) &NVIC->ISPR[0])
+            && (reg < (uintptr_t) &NVIC->ISPR[8]))
+    {
+        memset((void *) nvic->ISPR, 0, sizeof(nvic->ISPR));
+
+        for (index = SIM_IRQ_OFFSET; index < SIM_IRQS; index++)
+        {
+            if (irqs[index].pending)
+            {
+                nvic->ISPR[(index - SIM_IRQ_OFFSET) / 32] |=
+                    1U << ((index - SIM_IRQ_OFFSET) % 32);
+            }
+        }
+    }
+}
+
+/**
+ * Apply the System Control Space registers written: the SysTick, the NVIC
+ * enable and pending bits, and the PendSV.
+ */
+static void Sim_ScsPost(uintptr_t address, bool write)
+{
+    SysTick_Type *tick = Sim_Backdoor(SysTick);
+    NVIC_Type *nvic = Sim_Backdoor(NVIC);
+    SCB_Type *scb = Sim_Backdoor(SCB);
+    uint32_t reg = address & ~(uintptr_t) 3;
+    uint32_t word;
+    uint32_t bits;
+    int index;
+
+    if (!write)
+    {
+        return;
+    }
+
+    /* Writing VAL clears the counter, and so does enabling it; masking the
+     * interrupt (HAL_SuspendTick) leaves it counting */
+    if ((reg == (uintptr_t) &SysTick->VAL)
+            || ((reg == (uintptr_t) &SysTick->CTRL)
+                && ((tick->CTRL ^ tickCtrlBefore) & SysTick_CTRL_ENABLE_Msk)))
+    {
+        tick->VAL = 0;
+        Sim_TickRestart();
+    }
+    else if ((reg >= (uintptr_t) &NVIC->ISER[0])
+            && (reg < (uintptr_t) &NVIC->IP[0]))
+    {
+        /* Set and clear registers: the 1s written act, the rest is kept */
+        word = (reg - (uintptr_t) &NVIC->ISER[0]) / 4;
+        bits = ((volatile uint32_t *) nvic->ISER)[word];
+        ((volatile uint32_t *) nvic->ISER)[word] = 0;
+
+        for (index = 0; index < 32; index++)
+        {
+            int line = SIM_IRQ_OFFSET + (word % 32) * 32 + index;
+
+            if (!(bits & (1U << index)) || (line >= SIM_IRQS))
+            {
+                continue;
+            }
+
+            switch (word / 32)
+            {
+                case 0: irqs[line].enabled = true; break;
+                case 1: irqs[line].enabled = false; break;
+                case 2: irqs[line].pending = true; break;
+                case 3: irqs[line].pending = false; break;
+                default: break;
+            }
+        }
+
+        /* ISER reads back the enabled lines */
+        for (index = SIM_IRQ_OFFSET; index < SIM_IRQS; index++)
+        {
+            if (irqs[index].enabled)
+            {
+                nvic->ISER[(index - SIM_IRQ_OFFSET) / 32] |=
+                    1U << ((index - SIM_IRQ_OFFSET) % 32);
+            }
+        }
+    }
+    else if (reg == (uintptr_t) &SCB->ICSR)
+    {
+        if (scb->ICSR & SCB_ICSR_PENDSVSET_Msk)
+        {
+            Sim_PendIrq(PendSV_IRQn);
+        }
+
+        if (scb->ICSR & SCB_ICSR_PENDSTSET_Msk)
+        {
+            Sim_PendIrq(SysTick_IRQn);
+        }
+
+        scb->ICSR = 0;
+    }
+}
+
+/**
+ * Refresh the cycle counter before it's read.
+ */
+static void Sim_DwtPre(uintptr_t address, bool write)
+{
+    DWT_Type *dwt = Sim_Backdoor(DWT);
+
+    if ((address & ~(uintptr_t) 3) == (uintptr_t) &DWT->CYCCNT)
+    {
+        dwt->CYCCNT = cycleBase + (uint32_t) (cycleAccum / SIM_UNITS_PER_S);
+    }
+}
+
+/**
+ * Rebase the cycle counter when it's written.
+ */
+static void Sim_DwtPost(uintptr_t address, bool write)
+{
+    const DWT_Type *dwt = Sim_Backdoor(DWT);
+
+    if (write && ((address & ~(uintptr_t) 3) == (uintptr_t) &DWT->CYCCNT))
+    {
+        cycleBase = dwt->CYCCNT;
+        cycleAccum = 0;
+    }
+}
+
+/**
+ * Get the register and bit a bit-band alias address stands for.
+ */
+static uintptr_t Sim_BitBandTarget(uintptr_t address, uint32_t *bit)
+{
+    uintptr_t offset = (address & ~(uintptr_t) 3) - PERIPH_BB_BASE;
+    uintptr_t byte = offset / 32;
+
+    *bit = (byte & 3) * 8 + (offset / 4) % 8;
+
+    return PERIPH_BASE + (byte & ~(uintptr_t) 3);
+}
+
+/**
+ * Read the bit of the target register into the alias, through the hook of
+ * the target register.
+ */
+static void Sim_BitBandPre(uintptr_t address, bool write)
+{
+    uint32_t bit;
+    uintptr_t target = Sim_BitBandTarget(address, &bit);
+    const Sim_TrapRange_t *trap = Sim_FindTrap(target);
+
+    if (trap && trap->pre)
+    {
+        trap->pre(target, write);
+    }
+
+    *(uint32_t *) Sim_Backdoor((void *) (address & ~(uintptr_t) 3)) =
+        (*(uint32_t *) Sim_Backdoor((void *) target) >> bit) & 1;
+}
+
+/**
+ * Write the bit of the alias into the target register, as a read-modify-write
+ * of the whole register, which is what the bus matrix does.
+ */
+static void Sim_BitBandPost(uintptr_t address, bool write)
+{
+    uint32_t bit;
+    uintptr_t target = Sim_BitBandTarget(address, &bit);
+    const Sim_TrapRange_t *trap = Sim_FindTrap(target);
+    uint32_t *reg = Sim_Backdoor((void *) target);
+
+    if (write)
+    {
+        if (*(uint32_t *) Sim_Backdoor((void *) (address & ~(uintptr_t) 3))
+                & 1)
+        {
+            *reg |= 1U << bit;
+        }
+        else
+        {
+            *reg &= ~(1U << bit);
+        }
+    }
+
+    if (trap && trap->post)
+    {
+        trap->post(target, write);
+    }
+}
+
+static Sim_Time_t Sim_TickNext(void)
+{
+    return stopped ? SIM_NEVER : tickNext;
+}
+
+/**
+ * Count a SysTick period, raising its exception if enabled.
+ */
+static void Sim_TickRun(Sim_Time_t time)
+{
+    const SysTick_Type *tick = Sim_Backdoor(SysTick);
+
+    if (tick->CTRL & SysTick_CTRL_TICKINT_Msk)
+    {
+        Sim_PendIrq(SysTick_IRQn);
+    }
+
+    tickNext += tickPeriod;
+}
+
+/**
+ * Start the SysTick counting a new period from now, as the HAL does on each
+ * configuration, or stop it.
+ */
+static void Sim_TickRestart(void)
+{
+    const SysTick_Type *tick = Sim_Backdoor(SysTick);
+
+    coreClock = Sim_GetCoreClock();
+    tickPeriod = ((uint64_t) (tick->LOAD + 1) * SIM_UNITS_PER_S) / coreClock;
+    tickNext = (tick->CTRL & SysTick_CTRL_ENABLE_Msk) ? now + tickPeriod
+        : SIM_NEVER;
+}
+
+/**
+ * Get the priority of an interrupt line, from the NVIC and SCB registers.
+ */
+static uint32_t Sim_Priority(int index)
+{
+    const NVIC_Type *nvic = Sim_Backdoor(NVIC);
+    const SCB_Type *scb = Sim_Backdoor(SCB);
+
+    if (index < SIM_IRQ_OFFSET)
+    {
+        return scb->SHP[index - 4] >> (8 - __NVIC_PRIO_BITS);
+    }
+
+    return nvic->IP[index - SIM_IRQ_OFFSET] >> (8 - __NVIC_PRIO_BITS);
+}
+
+static bool Sim_IsPending(int index)
+{
+    return irqs[index].pending
+        || (irqs[index].level && !irqs[index].active && irqs[index].level());
+}
+
+/**
+ * Find the pending interrupt which preempts the running context.
+ *
+ * @param   ignoreMask  Whether the PRIMASK is ignored (WFI wake-up).
+ * @param   stop        Whether only the lines which wake up from the STOP
+ *                      mode count.
+ *
+ * @returns It returns the line index, or -1 if there's none.
+ */
+static int Sim_NextInterrupt(bool ignoreMask, bool stop)
+{
+    uint32_t current = activeDepth ? activePriorities[activeDepth - 1]
+        : SIM_THREAD_PRIORITY;
+    uint32_t best = current;
+    uint32_t priority;
+    int found = -1;
+    int index;
+
+    if (primask && !ignoreMask)
+    {
+        return -1;
+    }
+
+    for (index = 0; index < SIM_IRQS; index++)
+    {
+        if (!irqs[index].enabled || (stop && !irqs[index].wakesFromStop)
+                || !Sim_IsPending(index))
+        {
+            continue;
+        }
+
+        priority = Sim_Priority(index);
+
+        if (priority < best)
+        {
+            best = priority;
+            found = index;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * Take an interrupt: run its handler on its priority.
+ */
+static void Sim_Exception(int index)
+{
+    Sim_Irq_t *irq = &irqs[index];
+
+    if (irq->handler == NULL)
+    {
+        Sim_Fail("no handler for the %s interrupt", irq->name ? irq->name
+            : "unknown");
+    }
+
+    if ((index == lastTaken) && (++takenInARow > SIM_STORM_LIMIT))
+    {
+        Sim_Fail("interrupt storm on %s", irq->name);
+    }
+    else if (index != lastTaken)
+    {
+        lastTaken = index;
+        takenInARow = 0;
+    }
+
+    irq->pending = false;
+    irq->active = true;
+    activePriorities[activeDepth++] = Sim_Priority(index);
+    eventRegister = true;
+    wakeStats.interrupts[index]++;
+
+    Sim_ConsumeCycles(SIM_EXCEPTION_CYCLES);
+
+    irq->handler();
+
+    activeDepth--;
+    irq->active = false;
+    eventRegister = true;
+}
+
+/**
+ * Sleep until a wake-up event: for WFI, an interrupt which would preempt
+ * with the PRIMASK clear; for WFE, one which preempts with the PRIMASK as it
+ * is. In the STOP mode (SLEEPDEEP), the clocks and the SysTick stop and only
+ * the EXTI lines wake the core up.
+ *
+ * @param   wfe     Whether it's WFE.
+ */
+static void Sim_Sleep(bool wfe)
+{
+    const SCB_Type *scb = Sim_Backdoor(SCB);
+    bool stop = (scb->SCR & SCB_SCR_SLEEPDEEP_Msk) != 0;
+    Sim_Time_t start = now;
+    Sim_Time_t next;
+    int wake;
+
+    wake = Sim_NextInterrupt(!wfe, stop);
+
+    if (wake >= 0)
+    {
+        return;
+    }
+
+    asleep = true;
+    stopped = stop;
+
+    if (stop && (tickNext != SIM_NEVER))
+    {
+        tickLeft = tickNext - now;
+    }
+
+    while ((wake = Sim_NextInterrupt(!wfe, stop)) < 0)
+    {
+        next = Sim_NextEventTime();
+
+        if ((deadline != SIM_NEVER) && (next > deadline))
+        {
+            Sim_AdvanceTo(deadline);
+
+            for (wake = 0; wake < SIM_IRQS; wake++)
+            {
+                irqs[wake].active = false;
+            }
+
+            asleep = false;
+            stopped = false;
+            activeDepth = 0;
+            primask = 0;
+            deadline = SIM_NEVER;
+            longjmp(*deadlineExit, 1);
+        }
+
+        if (next == SIM_NEVER)
+        {
+            Sim_Fail("%s with nothing to wake the core up", wfe ? "WFE"
+                : "WFI");
+        }
+
+        Sim_AdvanceTo(next);
+    }
+
+    if (stop && (tickNext != SIM_NEVER))
+    {
+        tickNext = now + tickLeft;
+    }
+
+    asleep = false;
+    stopped = false;
+
+    wakeStats.wakeUps++;
+    wakeStats.byIrq[wake]++;
+    wakeStats.asleep += now - start;
+
+    if (stop)
+    {
+        wakeStats.stopWakeUps++;
+        wakeStats.stopped += now - start;
+
+        if (stopExitHook)
+        {
+            stopExitHook();
+        }
+    }
+
+    lastTaken = -1;
+}
+
+static void Sim_Fail(const char *message, ...)
+{
+    va_list args;
+
+    fprintf(stderr, "sim: ");
+    va_start(args, message);
+    vfprintf(stderr, message, args);
+    va_end(args);
+    fprintf(stderr, " (at %llu us)\n",
+        (unsigned long long) (now / SIM_UNITS_PER_US));
+
+    abort();
+}
@@ -0,0 +1,102 @@
+/**
+ * @brief   Host simulator of the STM32F446 core the firmware runs on: the
+ *          peripheral memory, the simulated time, the interrupts and the
+ *          low power modes.
+ *
+ * The firmware sources and the HAL are built unchanged. The peripheral
+ * address ranges are mapped at their real addresses, so the CMSIS register
+ * definitions are used as they are. The registers with side effects (I2C1,
+ * DMA1, RCC, PWR, RTC, GPIOB, EXTI, the core peripherals and the bit-band
+ * aliases) sit on protected pages: each access traps, the instruction is
+ * single-stepped and the peripheral model applies the read or write
+ * semantics around it.
+ *
+ * Each trapped access takes SIM_ACCESS_CYCLES of the core clock, and the
+ * interrupts raised meanwhile are taken right after it, as the core would
+ * between two instructions. Code which doesn't touch any register takes no
+ * time, so the time only moves forward noticeably while the core sleeps
+ * (WFI/WFE).
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include "stm32f4xx.h"
+
+/** Simulated time units per microsecond. A LSE cycle (1/32768 s) is then a
+ * whole number of units (15625). */
+#define SIM_UNITS_PER_US            512ULL
+
+#define SIM_US(us)                  ((Sim_Time_t) (us) * SIM_UNITS_PER_US)
+#define SIM_MS(ms)                  (SIM_US(ms) * 1000)
+#define SIM_S(s)                    (SIM_MS(s) * 1000)
+
+/** No event scheduled. */
+#define SIM_NEVER                   UINT64_MAX
+
+/** Core cycles taken by each trapped register access, with the code around
+ * it, which isn't timed otherwise. */
+#define SIM_ACCESS_CYCLES           10
+
+/** Number of interrupt lines, including the system exceptions. */
+#define SIM_IRQ_OFFSET              16
+#define SIM_IRQS                    (FMPI2C1_ER_IRQn + 1 + SIM_IRQ_OFFSET)
+
+typedef uint64_t Sim_Time_t;
+
+/** Hook called around a trapped register access. */
+typedef void (*Sim_TrapHook_t)(uintptr_t address, bool write);
+
+/** Time of the next event of a component, and the handler of its events. */
+typedef Sim_Time_t (*Sim_NextEvent_t)(void);
+typedef void (*Sim_Run_t)(Sim_Time_t now);
+
+/** Wake-up statistics. */
+typedef struct
+{
+    uint64_t wakeUps;                   /**< Wake-ups from any sleep. */
+    uint64_t stopWakeUps;               /**< Wake-ups from the STOP mode. */
+    uint64_t byIrq[SIM_IRQS];           /**< Wake-ups by interrupt line. */
+    uint64_t interrupts[SIM_IRQS];      /**< Interrupts taken by line. */
+    Sim_Time_t asleep;                  /**< Time spent sleeping. */
+    Sim_Time_t stopped;                 /**< Time spent in the STOP mode. */
+    uint64_t cycles;                    /**< Cycles run while awake, as the
+                                             DWT counter counts them. */
+
+} Sim_WakeStats_t;
+
+Sim_Time_t Sim_Now(void);
+void Sim_AdvanceTo(Sim_Time_t time);
+void Sim_Consume(Sim_Time_t duration);
+void Sim_ConsumeCycles(uint32_t cycles);
+void Sim_Idle(Sim_Time_t duration);
+void Sim_SetDeadline(Sim_Time_t time, jmp_buf *exit);
+
+void Sim_AddComponent(Sim_NextEvent_t next, Sim_Run_t run);
+void Sim_AddPoll(void (*poll)(void));
+void Sim_SetStopExitHook(void (*hook)(void));
+
+void Sim_Trap(uintptr_t base, uint32_t size, Sim_TrapHook_t pre,
+        Sim_TrapHook_t post);
+void *Sim_Backdoor(volatile const void *reg);
+uintptr_t Sim_HostPointer(uint32_t address);
+
+void Sim_SetIrqPriority(IRQn_Type irq, uint32_t priority);
+void Sim_EnableIrq(IRQn_Type irq, bool enable);
+void Sim_PendIrq(IRQn_Type irq);
+void Sim_SetIrqLevel(IRQn_Type irq, bool (*level)(void));
+bool Sim_IsIrqActive(IRQn_Type irq);
+bool Sim_IsIrqPending(IRQn_Type irq);
+void Sim_TakeInterrupts(void);
+
+uint32_t Sim_GetCoreClock(void);
+void Sim_ClockChanged(void);
+
+void Sim_GetWakeStats(Sim_WakeStats_t *stats);
+void Sim_ResetWakeStats(void);
+const char *Sim_IrqName(int index);
+
+#endif /* SIM_H_ */
@@ -0,0 +1,117 @@
+/**
+ * @brief   Minimal unit test framework of the host tests.
+ *
+ * Each test program runs its test cases in order and reports the failed
+ * checks; the firmware assertions abort the program.
+ */
+
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef TEST_TRACES_DIR
+#define TEST_TRACES_DIR             "traces"
+#endif
+
+static uint32_t testsRun;
+static uint32_t testsFailed;
+static uint32_t checksFailed;
+
+/**
+ * Run a test case.
+ *
+ * @param   name    Name reported.
+ * @param   test    Test case.
+ */
+void Test_Run(const char *name, void (*test)(void))
+{
+    uint32_t failedBefore = checksFailed;
+
+    testsRun++;
+    test();
+
+    if (checksFailed != failedBefore)
+    {
+        testsFailed++;
+    }
+
+    printf("%-48s %s\n", name, (checksFailed == failedBefore) ? "ok"
+        : "FAILED");
+}
+
+/**
+ * Report the results.
+ *
+ * @returns It returns the exit status of the test program.
+ */
+int Test_Summary(void)
+{
+    printf("%u tests, %u failed\n", testsRun, testsFailed);
+
+    return testsFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+bool Test_Check(bool passed, const char *expr, const char *file,
+        uint32_t line)
+{
+    if (!passed)
+    {
+        checksFailed++;
+        printf("%s:%u: check failed: %s\n", file, line, expr);
+    }
+
+    return passed;
+}
+
+bool Test_CheckEqual(long long expected, long long actual, const char *expr,
+        const char *file, uint32_t line)
+{
+    if (expected != actual)
+    {
+        checksFailed++;
+        printf("%s:%u: %s is %lld, expected %lld\n", file, line, expr, actual,
+            expected);
+    }
+
+    return expected == actual;
+}
+
+bool Test_CheckRange(long long min, long long max, long long actual,
+        const char *expr, const char *file, uint32_t line)
+{
+    if ((actual < min) || (actual > max))
+    {
+        checksFailed++;
+        printf("%s:%u: %s is %lld, expected %lld..%lld\n", file, line, expr,
+            actual, min, max);
+    }
+
+    return (actual >= min) && (actual <= max);
+}
+
+/**
+ * Get the path of a trace file.
+ *
+ * @param   name    File name.
+ *
+ * @returns It returns the path (static storage).
+ */
+const char *Test_TracePath(const char *name)
+{
+    static char path[256];
+
+    snprintf(path, sizeof(path), "%s/%s", TEST_TRACES_DIR, name);
+
+    return path;
+}
+
+/**
+ * Firmware assertion: report it and abort, instead of hanging as on the
+ * target.
+ */
+void ASSERT_Failed(uint8_t *file, uint32_t line)
+{
+    fprintf(stderr, "%s:%u: firmware assertion failed\n", (const char *) file,
+        line);
+    abort();
+}
@@ -0,0 +1,32 @@
+/**
+ * @brief   Minimal unit test framework of the host tests.
+ */
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CHECK(expr)                                                     \
+    Test_Check((expr), #expr, __FILE__, __LINE__)
+
+#define CHECK_EQUAL(expected, actual)                                   \
+    Test_CheckEqual((long long) (expected), (long long) (actual),       \
+        #actual, __FILE__, __LINE__)
+
+#define CHECK_RANGE(min, max, actual)                                   \
+    Test_CheckRange((long long) (min), (long long) (max),               \
+        (long long) (actual), #actual, __FILE__, __LINE__)
+
+void Test_Run(const char *name, void (*test)(void));
+int Test_Summary(void);
+bool Test_Check(bool passed, const char *expr, const char *file,
+        uint32_t line);
+bool Test_CheckEqual(long long expected, long long actual, const char *expr,
+        const char *file, uint32_t line);
+bool Test_CheckRange(long long min, long long max, long long actual,
+        const char *expr, const char *file, uint32_t line);
+const char *Test_TracePath(const char *name);
+
+#endif /* TEST_H_ */
@@ -0,0 +1,164 @@
+/**
+ * @brief   Acceleration and temperature traces replayed by the sensor model.
+ */
+
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_LINE_MAX              256
+
+static int32_t Trace_Interpolate(int32_t from, int32_t to, uint64_t offset,
+        uint64_t span);
+
+/**
+ * Load a trace file. The points shall be in time order.
+ *
+ * @param   trace   Trace to be loaded.
+ * @param   path    Path of the file.
+ *
+ * @returns It returns true if the trace has been loaded with success.
+ *          Otherwise, it returns false (the error has been reported).
+ */
+bool Trace_Load(Trace_t *trace, const char *path)
+{
+    char line[TRACE_LINE_MAX];
+    Trace_Point_t point;
+    uint32_t capacity = 0;
+    uint32_t number = 0;
+    double temp;
+    char *text;
+    FILE *file;
+
+    memset(trace, 0, sizeof(*trace));
+    file = fopen(path, "r");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "trace: can't open %s\n", path);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file))
+    {
+        number++;
+        text = line + strspn(line, " \t");
+
+        if ((*text == '#') || (*text == '\n') || (*text == '\0'))
+        {
+            continue;
+        }
+
+        if ((sscanf(text, "%u %d %d %d %lf", &point.time, &point.accel[0],
+                    &point.accel[1], &point.accel[2], &temp) != 5)
+                || (trace->count
+                    && (point.time < trace->points[trace->count - 1].time)))
+        {
+            fprintf(stderr, "trace: %s:%u: invalid point\n", path, number);
+            fclose(file);
+            Trace_Free(trace);
+            return false;
+        }
+
+        point.temp = (int32_t) (temp * 1000 + ((temp < 0) ? -0.5 : 0.5));
+
+        if (trace->count == capacity)
+        {
+            capacity = capacity ? (capacity * 2) : 64;
+            trace->points = realloc(trace->points,
+                capacity * sizeof(trace->points[0]));
+        }
+
+        trace->points[trace->count++] = point;
+    }
+
+    fclose(file);
+
+    if (trace->count == 0)
+    {
+        fprintf(stderr, "trace: %s: no points\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+void Trace_Free(Trace_t *trace)
+{
+    free(trace->points);
+    memset(trace, 0, sizeof(*trace));
+}
+
+/**
+ * Get the point of a trace at a given time.
+ *
+ * @param   trace   Trace loaded.
+ * @param   timeUs  Time from the start of the trace (us).
+ * @param   point   Memory where the point shall be stored.
+ */
+void Trace_Sample(const Trace_t *trace, uint64_t timeUs, Trace_Point_t *point)
+{
+    const Trace_Point_t *from;
+    const Trace_Point_t *to;
+    uint64_t offset;
+    uint64_t span;
+    uint32_t low = 0;
+    uint32_t high = trace->count - 1;
+    uint32_t middle;
+    uint32_t axis;
+
+    if (timeUs >= (uint64_t) trace->points[high].time * 1000)
+    {
+        *point = trace->points[high];
+        return;
+    }
+
+    if (timeUs <= (uint64_t) trace->points[0].time * 1000)
+    {
+        *point = trace->points[0];
+        return;
+    }
+
+    /* Last point at or before the time */
+    while (high - low > 1)
+    {
+        middle = (low + high) / 2;
+
+        if ((uint64_t) trace->points[middle].time * 1000 <= timeUs)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    from = &trace->points[low];
+    to = &trace->points[high];
+    offset = timeUs - (uint64_t) from->time * 1000;
+    span = (uint64_t) (to->time - from->time) * 1000;
+
+    point->time = timeUs / 1000;
+
+    for (axis = 0; axis < 3; axis++)
+    {
+        point->accel[axis] = Trace_Interpolate(from->accel[axis],
+            to->accel[axis], offset, span);
+    }
+
+    point->temp = Trace_Interpolate(from->temp, to->temp, offset, span);
+}
+
+static int32_t Trace_Interpolate(int32_t from, int32_t to, uint64_t offset,
+        uint64_t span)
+{
+    if (span == 0)
+    {
+        return to;
+    }
+
+    return from + (int32_t) (((int64_t) (to - from) * (int64_t) offset)
+        / (int64_t) span);
+}
@@ -0,0 +1,37 @@
+/**
+ * @brief   Acceleration and temperature traces replayed by the sensor model.
+ *
+ * A trace is a text file with one point per line: the time in milliseconds,
+ * the acceleration of the three axes in mg and the temperature in °C. Blank
+ * lines and lines starting with '#' are skipped. The points are interpolated
+ * linearly, and the last one holds once the trace is over.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Trace point. */
+typedef struct
+{
+    uint32_t time;          /**< Time from the start of the trace (ms). */
+    int32_t accel[3];       /**< Acceleration of X, Y and Z (mg). */
+    int32_t temp;           /**< Temperature (m°C). */
+
+} Trace_Point_t;
+
+/** Trace loaded in memory. */
+typedef struct
+{
+    Trace_Point_t *points;
+    uint32_t count;
+
+} Trace_t;
+
+bool Trace_Load(Trace_t *trace, const char *path);
+void Trace_Free(Trace_t *trace);
+void Trace_Sample(const Trace_t *trace, uint64_t timeUs, Trace_Point_t *point);
+
+#endif /* TRACE_H_ */
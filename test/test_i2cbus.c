@@ -0,0 +1,228 @@
+/**
+ * @brief   Host tests of the I2C bus driver: the faults injected on the bus
+ *          model, on both paths.
+ */
+
+#include "test.h"
+#include "board.h"
+#include "sim.h"
+#include "bus.h"
+#include "lis2de12_model.h"
+#include "lis2de12.h"
+#include "i2cbus.h"
+#include "clock.h"
+#include <string.h>
+
+#define TEST_SIZE                   6
+
+/* Time allowed to detect a stuck bus and recover it, on top of the
+ * transfer itself. The delay loops of the recovery don't take any time on
+ * the host, they add about 110us on the target. */
+#define TEST_RECOVERY_TIME          SIM_US(500)
+
+/** Time taken by the last transfer, from its submission. */
+static Sim_Time_t elapsed;
+
+/**
+ * Read the output registers on a path.
+ *
+ * @param   flags   Transfer flags (I2CBUS_FLAG_FAST for the fast path).
+ * @param   data    Memory to store the registers read.
+ *
+ * @returns It returns the transfer error.
+ */
+static I2CBus_Error_t Read(uint8_t flags, uint8_t *data)
+{
+    I2CBus_Transfer_t xfer = { 0 };
+    Sim_Time_t start = Sim_Now();
+
+    xfer.deviceAddress = LI2DE12_I2C_DEFAULT_ADDR;
+    xfer.regAddress = LI2DE12_FIFO_READ_START | 0x80;
+    xfer.data = data;
+    xfer.size = TEST_SIZE;
+    xfer.direction = I2CBUS_DIR_READ;
+    xfer.priority = I2CBUS_PRIORITY_HIGHEST;
+    xfer.flags = flags;
+
+    I2CBus_Execute(&xfer);
+    elapsed = Sim_Now() - start;
+
+    CHECK(I2CBus_IsIdle());
+    CHECK_EQUAL((xfer.error == I2CBUS_ERROR_NONE) ? I2CBUS_STATUS_DONE
+        : I2CBUS_STATUS_ERROR, xfer.status);
+
+    return xfer.error;
+}
+
+/**
+ * Check that a fault has been cleared: the next transfer succeeds and reads
+ * the device, with no further recovery.
+ */
+static void CheckCleared(uint8_t flags)
+{
+    uint8_t data[TEST_SIZE];
+    uint32_t recoveries = I2CBus_GetRecoveries();
+
+    memset(data, 0, sizeof(data));
+    CHECK_EQUAL(I2CBUS_ERROR_NONE, Read(flags, data));
+    CHECK_EQUAL(63, (int8_t) data[5]);
+    CHECK_EQUAL(recoveries, I2CBus_GetRecoveries());
+}
+
+static void Setup(void)
+{
+    Model_Reset();
+    Model_SetAcceleration(0, 0, 1000);
+    LIS2DE12_SetOdr(LI2DE12_ODR_100HZ);
+    Sim_Idle(SIM_MS(20));
+    Bus_ResetStats();
+}
+
+static void TestNack(uint8_t flags)
+{
+    uint8_t data[TEST_SIZE];
+    uint32_t recoveries;
+
+    Setup();
+    recoveries = I2CBus_GetRecoveries();
+
+    /* A NACK is reported as such, and the STOP frees the bus without any
+     * recovery */
+    Bus_InjectNack(1);
+    CHECK_EQUAL(I2CBUS_ERROR_NACK, Read(flags, data));
+    CHECK_EQUAL(recoveries, I2CBus_GetRecoveries());
+    Sim_Idle(SIM_US(20));
+    CHECK(!Bus_IsBusy());
+
+    CheckCleared(flags);
+}
+
+static void TestNackHal(void)
+{
+    TestNack(0);
+}
+
+static void TestNackFast(void)
+{
+    TestNack(I2CBUS_FLAG_FAST);
+}
+
+static void TestArbitrationLoss(uint8_t flags)
+{
+    uint8_t data[TEST_SIZE];
+    uint32_t recoveries;
+
+    Setup();
+    recoveries = I2CBus_GetRecoveries();
+
+    /* The arbitration loss fails the transfer and recovers the bus */
+    Bus_InjectArbitrationLoss(1);
+    CHECK_EQUAL(I2CBUS_ERROR_BUS, Read(flags, data));
+    CHECK_EQUAL(recoveries + 1, I2CBus_GetRecoveries());
+
+    CheckCleared(flags);
+}
+
+static void TestArbitrationLossHal(void)
+{
+    TestArbitrationLoss(0);
+}
+
+static void TestArbitrationLossFast(void)
+{
+    TestArbitrationLoss(I2CBUS_FLAG_FAST);
+}
+
+static void TestStuckSda(uint8_t flags)
+{
+    uint8_t data[TEST_SIZE];
+    Sim_Time_t reference;
+    uint32_t recoveries;
+    Bus_Stats_t stats;
+
+    Setup();
+
+    CHECK_EQUAL(I2CBUS_ERROR_NONE, Read(flags, data));
+    reference = elapsed;
+    recoveries = I2CBus_GetRecoveries();
+
+    /* A slave left in the middle of a byte holds SDA low: it's caught before
+     * the START, the bus is clocked until SDA is released and the transfer
+     * goes on */
+    Bus_InjectStuckSda(5);
+    memset(data, 0, sizeof(data));
+    CHECK_EQUAL(I2CBUS_ERROR_NONE, Read(flags, data));
+    CHECK_EQUAL(63, (int8_t) data[5]);
+    CHECK_EQUAL(recoveries + 1, I2CBus_GetRecoveries());
+    CHECK_RANGE(reference, reference + TEST_RECOVERY_TIME, elapsed);
+
+    Bus_GetStats(&stats);
+    CHECK_EQUAL(1, stats.releases);
+    CHECK_EQUAL(0, stats.arbitrationLosses);
+
+    CheckCleared(flags);
+}
+
+static void TestStuckSdaHal(void)
+{
+    TestStuckSda(0);
+}
+
+static void TestStuckSdaFast(void)
+{
+    TestStuckSda(I2CBUS_FLAG_FAST);
+}
+
+/**
+ * A transfer submitted while the bus is held waits for the release, and the
+ * clock switches, which hold it, leave the bus working on the new timing.
+ */
+static void TestHold(void)
+{
+    uint8_t data[TEST_SIZE];
+    I2CBus_Transfer_t xfer = { 0 };
+
+    Setup();
+
+    CHECK(I2CBus_Hold());
+    CHECK(!I2CBus_Hold());
+
+    xfer.deviceAddress = LI2DE12_I2C_DEFAULT_ADDR;
+    xfer.regAddress = LI2DE12_FIFO_READ_START | 0x80;
+    xfer.data = data;
+    xfer.size = TEST_SIZE;
+    xfer.direction = I2CBUS_DIR_READ;
+    xfer.priority = I2CBUS_PRIORITY_HIGHEST;
+
+    CHECK(I2CBus_Submit(&xfer));
+    Sim_Idle(SIM_MS(5));
+    CHECK_EQUAL(I2CBUS_STATUS_PENDING, xfer.status);
+    CHECK(!Clock_SetMode(CLOCK_MODE_BURST));
+
+    I2CBus_Release();
+    Sim_Idle(SIM_MS(5));
+    CHECK_EQUAL(I2CBUS_STATUS_DONE, xfer.status);
+    CHECK(I2CBus_IsIdle());
+
+    CHECK(Clock_SetMode(CLOCK_MODE_BURST));
+    CHECK_EQUAL(CLOCK_MODE_BURST, Clock_GetMode());
+    CheckCleared(I2CBUS_FLAG_FAST);
+    CHECK(Clock_SetMode(CLOCK_MODE_IDLE));
+    CHECK_EQUAL(CLOCK_MODE_IDLE, Clock_GetMode());
+    CheckCleared(0);
+}
+
+int main(void)
+{
+    Board_Init();
+
+    Test_Run("nack_hal", TestNackHal);
+    Test_Run("nack_fast", TestNackFast);
+    Test_Run("arbitration_loss_hal", TestArbitrationLossHal);
+    Test_Run("arbitration_loss_fast", TestArbitrationLossFast);
+    Test_Run("stuck_sda_hal", TestStuckSdaHal);
+    Test_Run("stuck_sda_fast", TestStuckSdaFast);
+    Test_Run("hold", TestHold);
+
+    return Test_Summary();
+}
@@ -0,0 +1,480 @@
+/**
+ * @brief   Host tests of the LIS2DE12 driver, run against the register model
+ *          of the device through the HAL and the bus driver.
+ */
+
+#include "test.h"
+#include "board.h"
+#include "sim.h"
+#include "bus.h"
+#include "lis2de12_model.h"
+#include "lis2de12.h"
+#include "i2cbus.h"
+#include "circbuf.h"
+#include <string.h>
+
+/* Output of 1g at +-2g, in digits */
+#define TEST_1G                     63
+
+#define TEST_STREAM_SIZE            (2 * LIS2DE12_STREAM_WATERMARK)
+#define TEST_ORIENT_EVENTS          64
+
+/* Flash OTP blocks of the temperature calibration */
+#define TEST_OTP_BLOCKS             16
+#define TEST_OTP_BLOCK_SIZE         32
+
+/* Raw temperatures recorded from -40°C to 85°C, 25°C reading 0 */
+#define TEST_TEMP_POINTS            7
+
+static void StreamCallbackFromISR(const LIS2DE12_Sample_t *samples,
+        uint16_t count);
+static void ActivityCallbackFromISR(void);
+
+static LIS2DE12_Sample_t streamBuffer[TEST_STREAM_SIZE];
+static LIS2DE12_Sample_t streamed[1024];
+static uint32_t streamedCount;
+static uint32_t activityCount;
+
+/**
+ * Reset the device and let the driver start from the power-on state.
+ */
+static void Setup(void)
+{
+    Model_Reset();
+    Model_ResetStats();
+    Model_SetAcceleration(0, 0, 1000);
+    Model_SetTemperature(25000);
+    Model_SetNoise(0, 1);
+}
+
+/**
+ * Program the flash OTP blocks with temperature calibrations, the others
+ * left erased, and load them again.
+ */
+static void ProgramTempCalib(const LIS2DE12_TempCalib_t *calib,
+        const uint8_t *blocks, uint32_t count)
+{
+    uint8_t *otp = Sim_Backdoor((const void *) FLASH_OTP_BASE);
+    uint32_t index;
+
+    memset(otp, 0xFF, TEST_OTP_BLOCKS * TEST_OTP_BLOCK_SIZE);
+
+    for (index = 0; index < count; index++)
+    {
+        memcpy(otp + blocks[index] * TEST_OTP_BLOCK_SIZE, &calib[index],
+            sizeof(calib[index]));
+    }
+
+    LIS2DE12_Init();
+}
+
+static void TestWhoAmI(void)
+{
+    uint8_t value = 0;
+
+    Setup();
+
+    CHECK(LIS2DE12_ReadReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_WHO_AM_I,
+        &value));
+    CHECK_EQUAL(0x33, value);
+}
+
+static void TestWriteRead(void)
+{
+    uint8_t value = 0;
+
+    Setup();
+
+    CHECK(LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_INT1_THS,
+        0x2A));
+    CHECK_EQUAL(0x2A, Model_GetRegister(LI2DE12_INT1_THS));
+    CHECK(LIS2DE12_ReadReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_INT1_THS,
+        &value));
+    CHECK_EQUAL(0x2A, value);
+
+    /* Read-only registers are left as they are */
+    CHECK(LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_WHO_AM_I, 0));
+    CHECK_EQUAL(0x33, Model_GetRegister(LI2DE12_WHO_AM_I));
+
+    /* A missing device doesn't acknowledge */
+    CHECK(!LIS2DE12_ReadReg(LIS2DE12_I2C_ADDR_2, LI2DE12_WHO_AM_I, &value));
+}
+
+static void TestAutoIncrement(void)
+{
+    static const uint8_t ctrl[] = { 0x57, 0x01, 0x40, 0x80, 0x08, 0x20 };
+    uint8_t data[sizeof(ctrl)];
+    uint32_t index;
+
+    Setup();
+
+    for (index = 0; index < sizeof(ctrl); index++)
+    {
+        CHECK(LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR,
+            LI2DE12_CTRL_REG1 + index, ctrl[index]));
+    }
+
+    /* The sub-address MSB enables the auto-increment, on both paths */
+    memset(data, 0, sizeof(data));
+    CHECK(I2CBus_MemRead(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG1 | 0x80,
+        data, sizeof(data)));
+    CHECK(memcmp(data, ctrl, sizeof(ctrl)) == 0);
+
+    memset(data, 0, sizeof(data));
+    CHECK(I2CBus_FastRead(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG1 | 0x80,
+        data, sizeof(data)));
+    CHECK(memcmp(data, ctrl, sizeof(ctrl)) == 0);
+
+    /* Without it, the same register is read again */
+    memset(data, 0, sizeof(data));
+    CHECK(I2CBus_MemRead(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG1, data,
+        2));
+    CHECK_EQUAL(ctrl[0], data[0]);
+    CHECK_EQUAL(ctrl[0], data[1]);
+
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_POWER_DOWN));
+}
+
+static void TestFifoMode(void)
+{
+    LIS2DE12_Sample_t samples[LIS2DE12_FIFO_SIZE];
+    Model_Stats_t stats;
+    uint8_t fifoSrc = 0;
+    uint32_t index;
+
+    Setup();
+    Model_SetAcceleration(-250, 500, 1000);
+
+    CHECK(LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_CTRL_REG5,
+        LI2DE12_FIFO_EN));
+    CHECK(LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_CTRL_REG,
+        LI2DE12_FIFO_MODE_FIFO));
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_100HZ));
+
+    /* The FIFO mode stops once full */
+    Sim_Idle(SIM_MS(500));
+    CHECK(LIS2DE12_ReadReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_SRC_REG,
+        &fifoSrc));
+    CHECK(fifoSrc & LI2DE12_FIFO_OVRN);
+    CHECK_EQUAL(LIS2DE12_FIFO_SIZE, Model_GetFifoLevel());
+    Model_GetStats(&stats);
+    CHECK(stats.fifoLost > 0);
+
+    /* The burst wraps from OUT_Z_H to OUT_X_L, one sample at a time */
+    memset(samples, 0, sizeof(samples));
+    CHECK(LIS2DE12_ReadFifo(samples, LIS2DE12_FIFO_SIZE));
+    CHECK(Model_GetFifoLevel() <= 1);
+
+    for (index = 0; index < LIS2DE12_FIFO_SIZE; index++)
+    {
+        CHECK_EQUAL(-16, samples[index].x);
+        CHECK_EQUAL(31, samples[index].y);
+        CHECK_EQUAL(TEST_1G, samples[index].z);
+        CHECK_EQUAL(0, samples[index].reserved0 | samples[index].reserved1
+            | samples[index].reserved2);
+    }
+
+    CHECK(LIS2DE12_ReadReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_SRC_REG,
+        &fifoSrc));
+    CHECK(!(fifoSrc & LI2DE12_FIFO_OVRN));
+
+    /* The bypass mode empties it */
+    Sim_Idle(SIM_MS(100));
+    CHECK(Model_GetFifoLevel() > 0);
+    CHECK(LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_FIFO_CTRL_REG,
+        LI2DE12_FIFO_MODE_BYPASS));
+    CHECK_EQUAL(0, Model_GetFifoLevel());
+
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_POWER_DOWN));
+}
+
+static void TestStream(void)
+{
+    Model_Stats_t stats;
+    uint32_t index;
+
+    Setup();
+    CHECK(Model_LoadTrace(Test_TracePath("walk.trace")));
+    streamedCount = 0;
+
+    CHECK(LIS2DE12_StartStream(LI2DE12_ODR_100HZ, streamBuffer,
+        TEST_STREAM_SIZE, StreamCallbackFromISR));
+
+    /* Each watermark raises INT1, and the bursts keep up with the data
+     * rate without losing any sample */
+    Sim_Idle(SIM_S(10));
+    CHECK(LIS2DE12_StopStream());
+
+    Model_GetStats(&stats);
+    CHECK_RANGE(990, 1000, stats.samples);
+    CHECK_EQUAL(0, stats.fifoLost);
+    CHECK_RANGE(stats.fifoPushed - 2 * LIS2DE12_STREAM_WATERMARK,
+        stats.fifoPushed, streamedCount);
+
+    /* The samples follow the trace: still, then steps on Z */
+    for (index = 0; index < 150; index++)
+    {
+        CHECK_EQUAL(TEST_1G, streamed[index].z);
+    }
+
+    for (index = 300; index < 700; index++)
+    {
+        CHECK_RANGE(TEST_1G - 26, TEST_1G + 26, streamed[index].z);
+        CHECK_RANGE(-10, 10, streamed[index].x);
+        CHECK_EQUAL(1, streamed[index].y);
+    }
+
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_POWER_DOWN));
+}
+
+static void TestTemperature(void)
+{
+    int16_t temp = 0;
+    int16_t raw = 0;
+    LIS2DE12_OneShotTiming_t timing;
+
+    Setup();
+    Model_SetTemperature(31000);
+
+    /* The output isn't updated without BDU */
+    CHECK(LIS2DE12_WriteReg(LI2DE12_I2C_DEFAULT_ADDR, LI2DE12_TEMP_CFG_REG,
+        LI2DE12_TEMP_ENABLED));
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_100HZ));
+    Sim_Idle(SIM_MS(50));
+    CHECK(LIS2DE12_ReadTemp(&raw));
+    CHECK_EQUAL(0, raw);
+
+    CHECK(LIS2DE12_EnableTemp());
+    Sim_Idle(SIM_MS(50));
+    CHECK(LIS2DE12_ReadTemp(&raw));
+    CHECK_EQUAL(6 << 8, raw);
+    CHECK(LIS2DE12_ReadTempQ8(&temp));
+    CHECK_EQUAL(31 << 8, temp);
+
+    /* One-shot: powered up, read and powered down again */
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_POWER_DOWN));
+    Model_SetTemperature(19000);
+    CHECK(LIS2DE12_ReadTempOneShot(&temp, &timing));
+    CHECK_EQUAL(19 << 8, temp);
+    CHECK_EQUAL(LI2DE12_ODR_POWER_DOWN,
+        Model_GetRegister(LI2DE12_CTRL_REG1) & LI2DE12_ODR_MASK);
+    CHECK(timing.settle > 0);
+}
+
+static void TestConvertTemp(void)
+{
+    static const int16_t raw[TEST_TEMP_POINTS] =
+    {
+        -0x4100, -0x1900, -0x0700, 0x0000, 0x0380, 0x0A00, 0x3C00
+    };
+    static const int16_t uncalibrated[TEST_TEMP_POINTS] =
+    {
+        -0x2800, 0x0000, 0x1200, 0x1900, 0x1C80, 0x2300, 0x5500
+    };
+    static const int16_t calibrated[TEST_TEMP_POINTS] =
+    {
+        -0x2B1A, -0x0180, 0x1138, 0x1880, 0x1C24, 0x22E7, 0x56E7
+    };
+    const LIS2DE12_TempCalib_t unity =
+    {
+        LIS2DE12_TEMP_CALIB_MAGIC, 25 << 8, LIS2DE12_TEMP_GAIN_UNITY
+    };
+    /* 24.5°C offset, 1.04 gain */
+    const LIS2DE12_TempCalib_t calib =
+    {
+        LIS2DE12_TEMP_CALIB_MAGIC, 0x1880, 0x4290
+    };
+    uint32_t index;
+
+    for (index = 0; index < TEST_TEMP_POINTS; index++)
+    {
+        CHECK_EQUAL(uncalibrated[index],
+            LIS2DE12_ConvertTemp(raw[index], &unity));
+        CHECK_EQUAL(calibrated[index],
+            LIS2DE12_ConvertTemp(raw[index], &calib));
+    }
+}
+
+static void TestTempCalib(void)
+{
+    static const uint8_t blocks[] = { 0, 1, 5 };
+    const LIS2DE12_TempCalib_t calib[] =
+    {
+        { LIS2DE12_TEMP_CALIB_MAGIC, 20 << 8, LIS2DE12_TEMP_GAIN_UNITY },
+        { LIS2DE12_TEMP_CALIB_MAGIC, 0x1880, 0x4290 },
+        { 0, 30 << 8, LIS2DE12_TEMP_GAIN_UNITY }
+    };
+    int16_t temp = 0;
+
+    Setup();
+    Model_SetTemperature(35000);
+    CHECK(LIS2DE12_EnableTemp());
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_100HZ));
+    Sim_Idle(SIM_MS(50));
+
+    /* Erased OTP: 25°C and unity gain */
+    ProgramTempCalib(calib, blocks, 0);
+    CHECK(LIS2DE12_ReadTempQ8(&temp));
+    CHECK_EQUAL(35 << 8, temp);
+
+    /* A single block */
+    ProgramTempCalib(calib, blocks, 1);
+    CHECK(LIS2DE12_ReadTempQ8(&temp));
+    CHECK_EQUAL(30 << 8, temp);
+
+    /* The last valid block wins, the invalid one after it is ignored */
+    ProgramTempCalib(calib, blocks, 3);
+    CHECK(LIS2DE12_ReadTempQ8(&temp));
+    CHECK_EQUAL(0x22E7, temp);
+
+    ProgramTempCalib(calib, blocks, 0);
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_POWER_DOWN));
+}
+
+static void TestSelfTest(void)
+{
+    LIS2DE12_SelfTestResult_t result;
+
+    Setup();
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_25HZ));
+    CHECK(LIS2DE12_EnableTemp());
+
+    /* Each axis moves by its self-test response, Z clipped by gravity */
+    memset(&result, 0, sizeof(result));
+    CHECK(LIS2DE12_SelfTest(10, &result));
+    CHECK(result.passed);
+    CHECK_EQUAL(0, result.failedAxes);
+    CHECK_EQUAL(0, result.averageOff[LIS2DE12_AXIS_X]);
+    CHECK_EQUAL(TEST_1G, result.averageOff[LIS2DE12_AXIS_Z]);
+    CHECK_EQUAL(70, result.delta[LIS2DE12_AXIS_X]);
+    CHECK_EQUAL(70, result.delta[LIS2DE12_AXIS_Y]);
+    CHECK_EQUAL(INT8_MAX - TEST_1G, result.delta[LIS2DE12_AXIS_Z]);
+
+    /* The configuration is restored */
+    CHECK_EQUAL(LI2DE12_ODR_25HZ,
+        Model_GetRegister(LI2DE12_CTRL_REG1) & LI2DE12_ODR_MASK);
+    CHECK_EQUAL(LI2DE12_BDU, Model_GetRegister(LI2DE12_CTRL_REG4));
+    CHECK_EQUAL(0, Model_GetRegister(LI2DE12_CTRL_REG5));
+    CHECK_EQUAL(LI2DE12_FIFO_MODE_BYPASS,
+        Model_GetRegister(LI2DE12_FIFO_CTRL_REG));
+
+    /* A broken axis doesn't move */
+    Model_SetSelfTestResponse(LIS2DE12_AXIS_Y, 0);
+    memset(&result, 0, sizeof(result));
+    CHECK(LIS2DE12_SelfTest(10, &result));
+    CHECK(!result.passed);
+    CHECK_EQUAL(1 << LIS2DE12_AXIS_Y, result.failedAxes);
+    CHECK_EQUAL(0, result.delta[LIS2DE12_AXIS_Y]);
+    Model_SetSelfTestResponse(LIS2DE12_AXIS_Y, 70);
+
+    /* Nor does one already at full scale */
+    Model_SetAcceleration(0, 0, 2000);
+    memset(&result, 0, sizeof(result));
+    CHECK(LIS2DE12_SelfTest(10, &result));
+    CHECK(!result.passed);
+    CHECK_RANGE(0, 16, result.delta[LIS2DE12_AXIS_Z]);
+    CHECK_EQUAL(1 << LIS2DE12_AXIS_Z, result.failedAxes);
+
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_POWER_DOWN));
+}
+
+static void TestActivity(void)
+{
+    Setup();
+    activityCount = 0;
+
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_50HZ));
+    CHECK(LIS2DE12_EnableActivityInt(4, 1, ActivityCallbackFromISR));
+
+    /* Gravity is filtered out, a still device doesn't raise it */
+    Sim_Idle(SIM_S(2));
+    CHECK_EQUAL(0, activityCount);
+
+    /* A jolt does */
+    Model_SetAcceleration(300, 0, 1200);
+    Sim_Idle(SIM_MS(100));
+    CHECK(activityCount > 0);
+
+    /* Once the filter has settled on the new position, it's over */
+    Sim_Idle(SIM_S(3));
+    activityCount = 0;
+    Sim_Idle(SIM_S(2));
+    CHECK_EQUAL(0, activityCount);
+
+    CHECK(LIS2DE12_DisableActivityInt());
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_POWER_DOWN));
+}
+
+static void TestOrientation(void)
+{
+    static const LIS2DE12_Orientation_t expected[] =
+    {
+        LIS2DE12_ORIENT_Z_UP, LIS2DE12_ORIENT_X_UP, LIS2DE12_ORIENT_Y_DOWN,
+        LIS2DE12_ORIENT_Z_DOWN, LIS2DE12_ORIENT_Z_UP
+    };
+    LIS2DE12_OrientEvent_t buffer[TEST_ORIENT_EVENTS];
+    LIS2DE12_OrientEvent_t event;
+    CircularBuffer_t events;
+    uint32_t changes = 0;
+
+    Setup();
+    CircBuf_Init(&events, buffer, sizeof(buffer));
+    CHECK(Model_LoadTrace(Test_TracePath("tilt.trace")));
+
+    /* 0.5g threshold, held for 2 samples */
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_25HZ));
+    CHECK(LIS2DE12_EnableOrientation(false, 32, 2, &events, NULL));
+
+    Sim_Idle(SIM_MS(10800));
+    CHECK(LIS2DE12_DisableOrientation());
+
+    /* One event per change, the position isn't reported again while the
+     * device keeps still */
+    while (CircBuf_Read(&events, &event, sizeof(event)))
+    {
+        if (CHECK(changes < sizeof(expected) / sizeof(expected[0])))
+        {
+            CHECK_EQUAL(expected[changes], event.orientation);
+        }
+
+        changes++;
+    }
+
+    CHECK_EQUAL(sizeof(expected) / sizeof(expected[0]), changes);
+
+    CHECK(LIS2DE12_SetOdr(LI2DE12_ODR_POWER_DOWN));
+}
+
+static void StreamCallbackFromISR(const LIS2DE12_Sample_t *samples,
+        uint16_t count)
+{
+    uint32_t room = sizeof(streamed) / sizeof(streamed[0]) - streamedCount;
+
+    count = (count < room) ? count : room;
+    memcpy(&streamed[streamedCount], samples, count * sizeof(samples[0]));
+    streamedCount += count;
+}
+
+static void ActivityCallbackFromISR(void)
+{
+    activityCount++;
+}
+
+int main(void)
+{
+    Board_Init();
+
+    Test_Run("who_am_i", TestWhoAmI);
+    Test_Run("write_read", TestWriteRead);
+    Test_Run("auto_increment", TestAutoIncrement);
+    Test_Run("fifo_mode", TestFifoMode);
+    Test_Run("stream", TestStream);
+    Test_Run("temperature", TestTemperature);
+    Test_Run("convert_temp", TestConvertTemp);
+    Test_Run("temp_calib", TestTempCalib);
+    Test_Run("self_test", TestSelfTest);
+    Test_Run("activity", TestActivity);
+    Test_Run("orientation", TestOrientation);
+
+    return Test_Summary();
+}
@@ -0,0 +1,109 @@
+/**
+ * @brief   Host tests of the RTC timers: the expiries of periodic timers
+ *          over a day, against the calendar of the RTC model.
+ */
+
+#include "test.h"
+#include "board.h"
+#include "sim.h"
+#include "rtc_periph.h"
+#include "rtc.h"
+#include "stm32f4xx_hal.h"
+#include <stdlib.h>
+
+#define TEST_PERIODS                86400
+
+/* 2024-02-28, the day before a leap day */
+#define TEST_DAY                    8824
+
+static void TimerCallbackFromISR(void);
+
+static RTC_Timer_t timer;
+static RTC_Timestamp_t *expiries;
+static uint32_t expiryCount;
+
+/**
+ * Run a periodic timer for a number of periods from a time of the day, and
+ * check that the periods don't drift: each one lasts the whole ticks around
+ * the period and, as the fractions of tick are carried over, they add up to
+ * the exact number of ticks.
+ *
+ * @param   period      Timer period (ms).
+ * @param   seconds     Start time, in seconds since midnight.
+ */
+static void CheckDrift(uint32_t period, uint32_t seconds)
+{
+    uint64_t frequency;
+    uint64_t expected;
+    uint64_t step;
+    uint32_t index;
+
+    RtcPeriph_SetCalendar(TEST_DAY, seconds);
+    frequency = RTC_GetTimestampFrequency();
+    step = period * frequency / 1000;
+
+    expiries = calloc(TEST_PERIODS + 1, sizeof(expiries[0]));
+    expiryCount = 0;
+
+    RTC_StartTimer(&timer, period, period, TimerCallbackFromISR);
+
+    while (expiryCount <= TEST_PERIODS)
+    {
+        Sim_Idle(SIM_MS(period));
+    }
+
+    RTC_StopTimer(&timer);
+
+    for (index = 1; index <= TEST_PERIODS; index++)
+    {
+        if (!CHECK_RANGE(step, step + 1,
+                expiries[index] - expiries[index - 1]))
+        {
+            break;
+        }
+    }
+
+    expected = (uint64_t) TEST_PERIODS * period * frequency / 1000;
+    CHECK_EQUAL(0, (uint64_t) TEST_PERIODS * period * frequency % 1000);
+    CHECK_EQUAL(expected, expiries[TEST_PERIODS] - expiries[0]);
+
+    free(expiries);
+}
+
+/**
+ * A second timer over a day, across midnight into a leap day.
+ */
+static void TestDriftSecond(void)
+{
+    CheckDrift(1000, 23 * 3600);
+}
+
+/**
+ * A 10ms timer, 2.56 ticks at 256Hz, over 86400 periods across midnight.
+ */
+static void TestDriftTenMs(void)
+{
+    CheckDrift(10, 23 * 3600 + 55 * 60);
+}
+
+static void TimerCallbackFromISR(void)
+{
+    if (expiryCount <= TEST_PERIODS)
+    {
+        expiries[expiryCount++] = RTC_GetTimestamp();
+    }
+}
+
+int main(void)
+{
+    Board_Init();
+
+    /* Nothing below needs the HAL tick, which would take most of the
+     * simulation time of a day */
+    HAL_SuspendTick();
+
+    Test_Run("drift_1s", TestDriftSecond);
+    Test_Run("drift_10ms", TestDriftTenMs);
+
+    return Test_Summary();
+}